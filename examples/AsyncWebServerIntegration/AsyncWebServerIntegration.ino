@@ -8,7 +8,8 @@
  * 
  * This is an async version of WebServerIntegration.ino, using ESPAsyncWebServer
  * instead of the synchronous WebServer for better performance and non-blocking
- * operation.
+ * operation. The update itself runs in loop() with startUpdate() / poll(), so
+ * no extra FreeRTOS task (and stack) is needed.
  * 
  * Hardware: ESP32
  * 
@@ -54,27 +55,12 @@ bool updateInProgress = false;
 String lastError = "";
 bool updateScheduled = false;  // Flag to schedule update from loop()
 
-// FreeRTOS task handle for update task
-TaskHandle_t updateTaskHandle = NULL;
-
 // Progress callback for web interface
 void onProgress(int percent, size_t bytesRead, size_t totalBytes) {
   updateProgress = percent;
   LOGD_F("Update progress: %d%% (%u bytes)", percent, (unsigned)bytesRead);
 }
 
-// Server handle callback - ESPAsyncWebServer doesn't need this, but we keep it
-// for compatibility with GitFirmwareUpdate API
-void onServerHandle() {
-  // ESPAsyncWebServer handles requests asynchronously, so this is a no-op
-  // but we keep it for API compatibility
-  // Cooperative yield to allow async_tcp task to run
-  yield();
-}
-
-// Forward declaration
-void updateTask(void *parameter);
-
 // Generate HTML page
 String generateHTML() {
   String html = "<!DOCTYPE html><html><head><meta charset='utf-8'>";
@@ -155,7 +141,7 @@ String generateHTML() {
   html += "    html+='<p><strong>Remote Version:</strong> '+(d.remoteVersion||'Not checked')+'</p>';";
   html += "    html+='<p><strong>Firmware URL:</strong> '+(d.firmwareUrl||'N/A')+'</p>';";
   html += "    html+='<p><strong>Update In Progress:</strong> '+(d.updateInProgress?'Yes':'No')+'</p>';";
-  html += "    if(d.updateInProgress) html+='<p><strong>Progress:</strong> '+d.updateProgress+'%</p>';";
+  html += "    if(d.updateInProgress) html+='<p><strong>Progress:</strong> '+d.updateProgress+'%'+(d.etaMs?' ('+Math.round(d.bytesPerSecond/1024)+' KB/s, '+Math.ceil(d.etaMs/1000)+' s left)':'')+'</p>';";
   html += "    html+='</div>';";
   html += "    if(d.releaseNotes) html+='<div class=\"status info\"><strong>Release Notes:</strong> '+d.releaseNotes+'</div>';";
   html += "    document.getElementById('status').innerHTML=html;";
@@ -218,40 +204,23 @@ void handleStartUpdate(AsyncWebServerRequest *request) {
   updateProgress = 0;
   lastError = "";
   
-  // Return HTTP 202 Accepted - update will be processed asynchronously
+  // Return HTTP 202 Accepted - loop() starts the update and advances it with poll()
   request->send(202, "text/plain", "Update scheduled. Device will restart when complete.");
-  
-  // Create FreeRTOS task for update (runs on core 1, separate from async_tcp on core 0)
-  // This prevents watchdog timeout on async_tcp task
-  if (updateTaskHandle == NULL) {
-    xTaskCreatePinnedToCore(
-      updateTask,           // Task function
-      "UpdateTask",         // Task name
-      16384,                // Stack size (16KB - enough for update operations)
-      NULL,                 // Parameters
-      1,                    // Priority (lower than async_tcp)
-      &updateTaskHandle,    // Task handle
-      1                     // Core ID (use core 1, async_tcp typically runs on core 0)
-    );
-    
-    if (updateTaskHandle == NULL) {
-      updateInProgress = false;
-      updateScheduled = false;
-      lastError = "Failed to create update task";
-      LOGE(F("Failed to create update task"));
-    }
-  }
 }
 
 // Status handler
 void handleStatus(AsyncWebServerRequest *request) {
+  // Consistent snapshot, safe to read from the async_tcp task while loop() downloads
+  GitFirmwareUpdate::ProgressSnapshot progress = fwUpdate.getProgressSnapshot();
   String json = "{";
   json += "\"currentVersion\":\""; json += FW_CURRENT_VERSION; json += "\",";
   json += "\"remoteVersion\":\""; json += fwUpdate.getRemoteVersion(); json += "\",";
   json += "\"firmwareUrl\":\""; json += fwUpdate.getFirmwareUrl(); json += "\",";
   json += "\"releaseNotes\":\""; json += fwUpdate.getReleaseNotes(); json += "\",";
   json += "\"updateInProgress\":"; json += (updateInProgress ? "true" : "false"); json += ",";
-  json += "\"updateProgress\":"; json += String(updateProgress);
+  json += "\"updateProgress\":"; json += String(updateInProgress ? progress.percent : 0); json += ",";
+  json += "\"bytesPerSecond\":"; json += String(progress.bytesPerSecond); json += ",";
+  json += "\"etaMs\":"; json += String(progress.etaMs);
   json += "}";
   request->send(200, "application/json", json);
 }
@@ -261,25 +230,6 @@ void handleNotFound(AsyncWebServerRequest *request) {
   request->send(404, "text/plain", "Not found");
 }
 
-// Update task function - runs in separate FreeRTOS task
-void updateTask(void *parameter) {
-  LOGD(F("Update task started"));
-  
-  // Perform update (this will block, but in separate task)
-  // This allows async_tcp task to continue running and reset watchdog
-  if (!fwUpdate.performUpdate()) {
-    updateInProgress = false;
-    updateScheduled = false;
-    lastError = fwUpdate.getLastErrorString();
-    LOGE_F("Update failed: %s", lastError.c_str());
-  }
-  // If successful, device will restart, so we never reach here
-  
-  updateTaskHandle = NULL;
-  updateScheduled = false;
-  vTaskDelete(NULL);  // Delete this task
-}
-
 void setup() {
   Serial.begin(115200);
   delay(1000);
@@ -288,7 +238,6 @@ void setup() {
 
   // Configure firmware update
   fwUpdate.setProgressCallback(onProgress);
-  fwUpdate.setServerHandleCallback(onServerHandle);
   fwUpdate.setTimeout(60000);
 
   // Connect to WiFi
@@ -322,22 +271,31 @@ void setup() {
 
 void loop() {
   // ESPAsyncWebServer handles requests asynchronously, so no need to call
-  // handleClient() in the loop. However, we can add other non-blocking tasks here.
-  
-  // Alternative: If you prefer to run update in loop() instead of FreeRTOS task,
-  // uncomment this and remove the updateTask() function:
-  /*
-  if (updateScheduled && !updateInProgress) {
-    updateInProgress = true;
-    if (!fwUpdate.performUpdate()) {
+  // handleClient() in the loop.
+  static bool updateRunning = false;
+
+  // Start the update here, not in the request handler (async_tcp task)
+  if (updateScheduled) {
+    updateScheduled = false;
+    updateRunning = fwUpdate.startUpdate();
+    if (!updateRunning) {
+      updateInProgress = false;
+      lastError = "Update already running";
+    }
+  }
+
+  if (updateRunning) {
+    // Each poll() downloads for at most ~20 ms, so the rest of loop() keeps running.
+    // On success poll() restarts the device.
+    if (fwUpdate.poll() == GitFirmwareUpdate::STATE_FAILED) {
+      updateRunning = false;
       updateInProgress = false;
-      updateScheduled = false;
       lastError = fwUpdate.getLastErrorString();
-      LOGE(String("Update failed: " + lastError).c_str());
+      LOGE_F("Update failed: %s", lastError.c_str());
     }
+  } else {
+    delay(100);
   }
-  */
-  
-  delay(100);
-}
 
+  // ... other non-blocking work ...
+}
@@ -64,6 +64,7 @@ void setup() {
 
   // Configure firmware update settings
   fwUpdate.setProgressCallback(onProgress);  // Register progress callback
+  fwUpdate.setProgressThrottle(5, 500);      // At most every 5% and 500 ms
   fwUpdate.setTimeout(60000);                 // Set 60 second timeout
   fwUpdate.setRetryCount(2);                 // Retry up to 2 times on failure
   fwUpdate.setCertificateValidation(false);   // Skip cert validation (default)
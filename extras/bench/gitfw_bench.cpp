@@ -0,0 +1,498 @@
+/**
+ * @file gitfw_bench.cpp
+ * @brief Host benchmark: firmware download path over a simulated network
+ *
+ * Build (Linux):
+ *   g++ -O2 -std=c++11 -pthread -I../../src gitfw_bench.cpp ../../src/GitFirmwareTransport.cpp \
+ *       ../../src/GitFirmwareSink.cpp ../../src/GitFirmwareInflate.cpp \
+ *       ../../src/GitFirmwareSha256.cpp ../../src/GitFirmwarePipeline.cpp -o gitfw_bench
+ *
+ * Usage:
+ *   gitfw_bench [options]
+ *     --size N        Image size in KB (random data, default 1024)
+ *     --image FILE    Serve FILE instead of random data
+ *     --inflate       Image is gzip / zlib / deflate: inflate it like a compressed OTA
+ *     --bw N          Bandwidth in KB/s (default 0 = unlimited)
+ *     --rtt N         Round trip time in ms (default 0)
+ *     --jitter N      Extra random delay per segment, 0..N ms (default 0)
+ *     --loss P        Segment loss in percent, each loss stalls for one RTO (default 0)
+ *     --chunked       Transfer-Encoding: chunked instead of Content-Length
+ *     --segment N     Server write size in bytes (default 1460)
+ *     --buf N         Client read buffer in bytes (default 1024, as in the update loop)
+ *     --wait N        Client wait per read() in ms (default 50, as in the update loop)
+ *     --poll-delay    Old update loop: read without waiting, delay(1) when empty
+ *     --pipeline N    Use GitFirmwarePipeline with N buffers of 4 KB (default 0 = sequential)
+ *     --sha256        Hash the image like a latest.json "sha256" check
+ *     --histogram     Print log2 histograms of read / write latency and read size
+ *     --out FILE      Write through FileSink (default: discard)
+ *     --runs N        Repetitions (default 5)
+ *     --seed N        Random seed for data, jitter and loss (default 1)
+ *
+ * The client side runs the same host stand-ins the library uses for testing
+ * (PosixHttpTransport, GitFirmwareInflater, GitFirmwareSha256, FileSink,
+ * GitFirmwarePipeline) with the read loop of GitFirmwareUpdate. The server
+ * is a forked process, so CPU time only counts the client.
+ *
+ * The network is simulated in the server: responses wait two RTTs
+ * (handshake + request), the body is paced to the bandwidth in segments,
+ * and a lost segment is delayed by a retransmission timeout of
+ * max(200 ms, 2 * RTT) like TCP would.
+ *
+ * Output per run: throughput (MB/s), time to first body byte (ms) and
+ * client CPU time per MB (ms); the summary line shows the medians.
+ * With --histogram, the per-call distributions over all runs follow as
+ * "lowerBound:count" pairs (GIT_FIRMWARE_USE_HISTOGRAM format).
+ */
+
+#include "GitFirmwareTransport.h"
+#include "GitFirmwareSink.h"
+#include "GitFirmwareInflate.h"
+#include "GitFirmwareSha256.h"
+#include "GitFirmwarePipeline.h"
+#include "GitFirmwareHistogram.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+typedef std::vector<uint8_t> Bytes;
+
+struct Options {
+  size_t sizeKb = 1024;
+  const char* image = nullptr;
+  bool inflate = false;
+  uint32_t bandwidthKb = 0;
+  uint32_t rttMs = 0;
+  uint32_t jitterMs = 0;
+  double lossPercent = 0;
+  bool chunked = false;
+  size_t segment = 1460;
+  size_t bufSize = 1024;
+  uint32_t waitMs = 50;
+  bool pollDelay = false;
+  uint8_t pipelineBuffers = 0;
+  bool sha256 = false;
+  bool histogram = false;
+  const char* out = nullptr;
+  int runs = 5;
+  unsigned seed = 1;
+};
+
+static double nowMs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static uint32_t nowUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)(ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+static double cpuMs() {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000.0 +
+         (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000.0;
+}
+
+static void sleepUntil(double ms) {
+  struct timespec ts;
+  ts.tv_sec = (time_t)(ms / 1000);
+  ts.tv_nsec = (long)((ms - ts.tv_sec * 1000.0) * 1e6);
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+}
+
+static bool readFile(const char* path, Bytes& out) {
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  uint8_t buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+    out.insert(out.end(), buf, buf + n);
+  }
+  fclose(f);
+  return true;
+}
+
+static bool sendAll(int fd, const void* data, size_t len) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  while (len > 0) {
+    ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+    if (n <= 0) return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+// ---- Simulated server (child process) ----
+
+static void serveOne(int fd, const Options& o, const Bytes& image) {
+  // Read the request head
+  char req[2048];
+  size_t len = 0;
+  while (len < sizeof(req) - 1) {
+    ssize_t n = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+    if (n <= 0) return;
+    len += n;
+    req[len] = '\0';
+    if (strstr(req, "\r\n\r\n")) break;
+  }
+
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  double t = nowMs() + 2.0 * o.rttMs;  // Handshake + request
+  sleepUntil(t);
+
+  char head[256];
+  if (o.chunked) {
+    snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n"
+             "Connection: close\r\n\r\n");
+  } else {
+    snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Length: %u\r\n"
+             "Connection: close\r\n\r\n", (unsigned)image.size());
+  }
+  if (!sendAll(fd, head, strlen(head))) return;
+
+  double rto = std::max(200.0, 2.0 * o.rttMs);
+  double msPerByte = o.bandwidthKb ? 1000.0 / (o.bandwidthKb * 1024.0) : 0;
+  double start = nowMs();
+  double stall = 0;  // Accumulated retransmission stalls
+  for (size_t pos = 0; pos < image.size();) {
+    size_t n = std::min(o.segment, image.size() - pos);
+    if (o.lossPercent > 0 && rand() % 10000 < o.lossPercent * 100) {
+      stall += rto;
+    }
+    double jitter = o.jitterMs ? (rand() % (o.jitterMs * 1000 + 1)) / 1000.0 : 0;
+    if (msPerByte > 0 || stall > 0 || jitter > 0) {
+      sleepUntil(start + pos * msPerByte + stall + jitter);
+    }
+    if (o.chunked) {
+      char size[16];
+      snprintf(size, sizeof(size), "%x\r\n", (unsigned)n);
+      if (!sendAll(fd, size, strlen(size))) return;
+    }
+    if (!sendAll(fd, &image[pos], n)) return;
+    if (o.chunked && !sendAll(fd, "\r\n", 2)) return;
+    pos += n;
+  }
+  if (o.chunked) {
+    sendAll(fd, "0\r\n\r\n", 5);
+  }
+}
+
+static void serve(int listenFd, const Options& o, const Bytes& image) {
+  srand(o.seed + 1);
+  for (;;) {
+    int fd = accept(listenFd, nullptr, nullptr);
+    if (fd < 0) return;
+    serveOne(fd, o, image);
+    shutdown(fd, SHUT_WR);
+    close(fd);
+  }
+}
+
+// ---- Client (measured) ----
+
+// Discards the image, so only network and decode cost is measured
+class NullSink : public GitFirmwareSink {
+public:
+  bool begin(size_t) override { return true; }
+  size_t write(const uint8_t*, size_t len) override { return len; }
+  bool end() override { return true; }
+  void abort() override {}
+  int getError() const override { return 0; }
+};
+
+struct Client {
+  GitFirmwareTransport* transport;
+  GitFirmwareSink* sink;
+  GitFirmwareInflater* inflater;   ///< nullptr for raw images
+  GitFirmwareSha256* hash;         ///< nullptr without --sha256
+  size_t received;
+  size_t written;
+  double firstByteMs;              ///< nowMs() of the first body byte, 0 until then
+  bool failed;
+};
+
+// Per-call distributions over all runs (--histogram)
+static GitFirmwareHistogram readUs;
+static GitFirmwareHistogram writeUs;
+static GitFirmwareHistogram readBytes;
+
+// Timed transport read (the reader side of both loops)
+static int timedRead(GitFirmwareTransport& transport, uint8_t* buf, size_t capacity, uint32_t waitMs) {
+  uint32_t start = nowUs();
+  int n = transport.read(buf, capacity, waitMs);
+  if (n > 0) {
+    readUs.add(nowUs() - start);
+    readBytes.add(n);
+  }
+  return n;
+}
+
+static bool writeOut(void* ctx, const uint8_t* data, size_t len) {
+  Client* c = static_cast<Client*>(ctx);
+  if (c->hash) {
+    c->hash->update(data, len);
+  }
+  uint32_t start = nowUs();
+  size_t n = c->sink->write(data, len);
+  writeUs.add(nowUs() - start);
+  if (n != len) {
+    return false;
+  }
+  c->written += len;
+  return true;
+}
+
+static bool consume(void* ctx, const uint8_t* buf, size_t len) {
+  Client* c = static_cast<Client*>(ctx);
+  if (c->firstByteMs == 0) {
+    c->firstByteMs = nowMs();
+  }
+  c->received += len;
+  if (c->inflater) {
+    if (c->inflater->feed(buf, len) == GitFirmwareInflater::INFLATE_ERROR) {
+      fprintf(stderr, "inflate: %s\n", c->inflater->errorString());
+      c->failed = true;
+      return false;
+    }
+    return true;
+  }
+  return writeOut(ctx, buf, len);
+}
+
+static int pipelineRead(void* ctx, uint8_t* buf, size_t capacity) {
+  Client* c = static_cast<Client*>(ctx);
+  for (;;) {
+    int n = timedRead(*c->transport, buf, capacity, 20);
+    if (n > 0) return n;
+    if (n == 0) continue;
+    return n == GitFirmwareTransport::READ_EOF ? 0 : -1;
+  }
+}
+
+struct RunResult {
+  double mbPerSec;
+  double ttfbMs;
+  double cpuMsPerMb;
+};
+
+static bool runOnce(const Options& o, const char* url, RunResult& r, uint8_t digest[32]) {
+  PosixHttpTransport transport;
+  NullSink nullSink;
+  FileSink fileSink(o.out ? o.out : "");
+  GitFirmwareSink& sink = o.out ? static_cast<GitFirmwareSink&>(fileSink)
+                                : static_cast<GitFirmwareSink&>(nullSink);
+  GitFirmwareInflater inflater;
+  GitFirmwareSha256 hash;
+
+  Client c;
+  memset(&c, 0, sizeof(c));
+  c.transport = &transport;
+  c.sink = &sink;
+
+  double cpu0 = cpuMs();
+  double t0 = nowMs();
+
+  transport.setTimeout(30000);
+  int code = transport.open(url, false);
+  if (code != 200) {
+    fprintf(stderr, "HTTP %d\n", code);
+    return false;
+  }
+  if (!sink.begin(0)) {
+    fprintf(stderr, "sink begin failed\n");
+    return false;
+  }
+  if (o.inflate) {
+    if (!inflater.begin(GitFirmwareInflater::FORMAT_AUTO, writeOut, &c)) {
+      fprintf(stderr, "inflate window allocation failed\n");
+      return false;
+    }
+    c.inflater = &inflater;
+  }
+  if (o.sha256) {
+    hash.begin();
+    c.hash = &hash;
+  }
+
+  bool ok = true;
+  if (o.pipelineBuffers > 0) {
+    GitFirmwarePipeline pipeline(o.pipelineBuffers, 4096);
+    ok = pipeline.run(pipelineRead, &c, consume, &c, nullptr) == GitFirmwarePipeline::PIPELINE_OK;
+  } else {
+    std::vector<uint8_t> buf(o.bufSize);
+    for (;;) {
+      int n = timedRead(transport, buf.data(), buf.size(), o.pollDelay ? 0 : o.waitMs);
+      if (n == 0) {
+        if (o.pollDelay) usleep(1000);
+        continue;
+      }
+      if (n == GitFirmwareTransport::READ_EOF) break;
+      if (n < 0 || !consume(&c, buf.data(), n)) {
+        ok = false;
+        break;
+      }
+    }
+  }
+  transport.close();
+  if (c.hash) {
+    c.hash->finish(digest);
+  }
+  ok = ok && !c.failed && sink.end();
+  inflater.end();
+
+  double elapsed = nowMs() - t0;
+  double cpu = cpuMs() - cpu0;
+  double mb = c.written / (1024.0 * 1024.0);
+  if (!ok || c.written == 0) {
+    fprintf(stderr, "download failed after %u bytes\n", (unsigned)c.received);
+    return false;
+  }
+  r.mbPerSec = mb / (elapsed / 1000.0);
+  r.ttfbMs = c.firstByteMs - t0;
+  r.cpuMsPerMb = cpu / mb;
+  return true;
+}
+
+static double median(std::vector<double> v) {
+  std::sort(v.begin(), v.end());
+  size_t n = v.size();
+  return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+static bool parseArgs(int argc, char** argv, Options& o) {
+  for (int i = 1; i < argc; i++) {
+    const char* a = argv[i];
+    const char* v = i + 1 < argc ? argv[i + 1] : nullptr;
+    bool takesValue = true;
+    if (!strcmp(a, "--inflate")) { o.inflate = true; takesValue = false; }
+    else if (!strcmp(a, "--chunked")) { o.chunked = true; takesValue = false; }
+    else if (!strcmp(a, "--sha256")) { o.sha256 = true; takesValue = false; }
+    else if (!strcmp(a, "--poll-delay")) { o.pollDelay = true; takesValue = false; }
+    else if (!strcmp(a, "--histogram")) { o.histogram = true; takesValue = false; }
+    else if (!v) return false;
+    else if (!strcmp(a, "--size")) o.sizeKb = strtoul(v, nullptr, 10);
+    else if (!strcmp(a, "--image")) o.image = v;
+    else if (!strcmp(a, "--bw")) o.bandwidthKb = strtoul(v, nullptr, 10);
+    else if (!strcmp(a, "--rtt")) o.rttMs = strtoul(v, nullptr, 10);
+    else if (!strcmp(a, "--jitter")) o.jitterMs = strtoul(v, nullptr, 10);
+    else if (!strcmp(a, "--loss")) o.lossPercent = atof(v);
+    else if (!strcmp(a, "--segment")) o.segment = strtoul(v, nullptr, 10);
+    else if (!strcmp(a, "--buf")) o.bufSize = strtoul(v, nullptr, 10);
+    else if (!strcmp(a, "--wait")) o.waitMs = strtoul(v, nullptr, 10);
+    else if (!strcmp(a, "--pipeline")) o.pipelineBuffers = (uint8_t)strtoul(v, nullptr, 10);
+    else if (!strcmp(a, "--out")) o.out = v;
+    else if (!strcmp(a, "--runs")) o.runs = atoi(v);
+    else if (!strcmp(a, "--seed")) o.seed = strtoul(v, nullptr, 10);
+    else return false;
+    if (takesValue) i++;
+  }
+  return o.segment > 0 && o.bufSize > 0 && o.runs > 0;
+}
+
+int main(int argc, char** argv) {
+  Options o;
+  if (!parseArgs(argc, argv, o)) {
+    fprintf(stderr, "usage: see the header of gitfw_bench.cpp\n");
+    return 2;
+  }
+
+  Bytes image;
+  if (o.image) {
+    if (!readFile(o.image, image)) return 1;
+  } else {
+    srand(o.seed);
+    image.resize(o.sizeKb * 1024);
+    for (size_t i = 0; i < image.size(); i++) image[i] = (uint8_t)rand();
+  }
+  if (image.empty()) {
+    fprintf(stderr, "empty image\n");
+    return 1;
+  }
+
+  int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t addrLen = sizeof(addr);
+  if (listenFd < 0 || bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+      listen(listenFd, 4) != 0 || getsockname(listenFd, (struct sockaddr*)&addr, &addrLen) != 0) {
+    perror("listen");
+    return 1;
+  }
+
+  pid_t server = fork();
+  if (server == 0) {
+    serve(listenFd, o, image);
+    _exit(0);
+  }
+  close(listenFd);
+
+  char url[64];
+  snprintf(url, sizeof(url), "http://127.0.0.1:%u/firmware.bin", ntohs(addr.sin_port));
+
+  printf("image %u bytes%s, bw %u KB/s, rtt %u ms, jitter %u ms, loss %.2f%%, %s, "
+         "buf %u, %s %u ms, %s%s\n",
+         (unsigned)image.size(), o.inflate ? " (inflated)" : "", o.bandwidthKb, o.rttMs,
+         o.jitterMs, o.lossPercent, o.chunked ? "chunked" : "Content-Length",
+         (unsigned)o.bufSize, o.pollDelay ? "poll delay" : "wait",
+         o.pollDelay ? 1u : o.waitMs, o.pipelineBuffers ? "pipeline" : "sequential",
+         o.sha256 ? ", sha256" : "");
+  printf("%4s %10s %10s %12s\n", "run", "MB/s", "TTFB ms", "CPU ms/MB");
+
+  std::vector<double> rate, ttfb, cpu;
+  uint8_t digest[32];
+  int rc = 0;
+  for (int run = 1; run <= o.runs; run++) {
+    RunResult r;
+    if (!runOnce(o, url, r, digest)) {
+      rc = 1;
+      break;
+    }
+    printf("%4d %10.2f %10.2f %12.2f\n", run, r.mbPerSec, r.ttfbMs, r.cpuMsPerMb);
+    rate.push_back(r.mbPerSec);
+    ttfb.push_back(r.ttfbMs);
+    cpu.push_back(r.cpuMsPerMb);
+  }
+  if (!rate.empty()) {
+    printf("%4s %10.2f %10.2f %12.2f\n", "med", median(rate), median(ttfb), median(cpu));
+  }
+  if (o.histogram && rc == 0) {
+    char buckets[256];
+    readUs.format(buckets, sizeof(buckets));
+    printf("read us     (mean %u, max %u): %s\n", readUs.mean(), readUs.max(), buckets);
+    writeUs.format(buckets, sizeof(buckets));
+    printf("write us    (mean %u, max %u): %s\n", writeUs.mean(), writeUs.max(), buckets);
+    readBytes.format(buckets, sizeof(buckets));
+    printf("read bytes  (mean %u, max %u): %s\n", readBytes.mean(), readBytes.max(), buckets);
+  }
+  if (o.sha256 && rc == 0) {
+    printf("sha256 ");
+    for (int i = 0; i < 32; i++) printf("%02x", digest[i]);
+    printf("\n");
+  }
+
+  kill(server, SIGTERM);
+  waitpid(server, nullptr, 0);
+  return rc;
+}
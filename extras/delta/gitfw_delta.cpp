@@ -0,0 +1,289 @@
+/**
+ * @file gitfw_delta.cpp
+ * @brief Host tool: create and apply GitFirmwareUpdate delta patches ("GFD1")
+ *
+ * Build (Linux / macOS):
+ *   g++ -O2 -std=c++11 -I../../src gitfw_delta.cpp ../../src/GitFirmwareDelta.cpp -o gitfw_delta
+ *
+ * Usage:
+ *   gitfw_delta diff  old.bin new.bin patch.gfd    Create a patch (verified by applying it)
+ *   gitfw_delta apply old.bin patch.gfd out.bin    Rebuild new.bin with the device code path
+ *
+ * Publish the patch gzip compressed (gzip -9 -n patch.gfd) and reference it
+ * from latest.json:
+ *
+ *   "delta": { "from": "1.0.4", "url": "http://.../1.0.4-1.0.5.gfd.gz", "compression": "gzip" }
+ *
+ * The generator is a simple bsdiff-like matcher: exact matches from a hash
+ * index of the old image seed a region, the region is extended while at
+ * least half of the bytes still match (typical for relocated code), and
+ * the region is written as COPY (exact runs) and ADD (byte differences).
+ */
+
+#include "GitFirmwareDelta.h"
+#include "GitFirmwareCrc32.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+typedef std::vector<uint8_t> Bytes;
+
+static const size_t KEY_LEN = 8;         // Bytes hashed per index entry
+static const size_t MIN_MATCH = 16;      // Shortest exact match that seeds a region
+static const size_t MIN_COPY = 8;        // Shortest exact run written as COPY inside a region
+static const int HASH_BITS = 20;
+static const int MAX_CHAIN = 64;         // Candidates checked per position
+
+static bool readFile(const char* path, Bytes& out) {
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  uint8_t buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+    out.insert(out.end(), buf, buf + n);
+  }
+  fclose(f);
+  return true;
+}
+
+static bool writeFile(const char* path, const Bytes& data) {
+  FILE* f = fopen(path, "wb");
+  if (!f || fwrite(data.data(), 1, data.size(), f) != data.size()) {
+    perror(path);
+    if (f) fclose(f);
+    return false;
+  }
+  return fclose(f) == 0;
+}
+
+static void putLe32(Bytes& out, uint32_t v) {
+  for (int i = 0; i < 4; i++) out.push_back((uint8_t)(v >> (8 * i)));
+}
+
+static void putVarint(Bytes& out, uint32_t v) {
+  uint8_t tmp[5];
+  size_t n = GitFirmwareDeltaPatcher::putVarint(v, tmp);
+  out.insert(out.end(), tmp, tmp + n);
+}
+
+static uint32_t hashKey(const uint8_t* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return (uint32_t)((v * 0x9E3779B97F4A7C15ull) >> (64 - HASH_BITS));
+}
+
+class PatchWriter {
+public:
+  explicit PatchWriter(Bytes& out) : _out(out), _oldCursor(0) {}
+
+  void insert(const uint8_t* data, size_t len) {
+    if (len == 0) return;
+    _out.push_back(GitFirmwareDeltaPatcher::OP_INSERT);
+    putVarint(_out, (uint32_t)len);
+    _out.insert(_out.end(), data, data + len);
+  }
+
+  void copy(size_t oldPos, size_t len) {
+    op(GitFirmwareDeltaPatcher::OP_COPY, oldPos, len);
+    _oldCursor = oldPos + len;
+  }
+
+  void add(size_t oldPos, const uint8_t* oldData, const uint8_t* newData, size_t len) {
+    op(GitFirmwareDeltaPatcher::OP_ADD, oldPos, len);
+    for (size_t i = 0; i < len; i++) {
+      _out.push_back((uint8_t)(newData[i] - oldData[i]));
+    }
+    _oldCursor = oldPos + len;
+  }
+
+  size_t oldCursor() const { return _oldCursor; }
+
+private:
+  Bytes& _out;
+  size_t _oldCursor;
+
+  void op(uint8_t code, size_t oldPos, size_t len) {
+    int64_t seek = (int64_t)oldPos - (int64_t)_oldCursor;
+    uint32_t zigzag = (uint32_t)((seek << 1) ^ (seek >> 63));
+    _out.push_back(code);
+    putVarint(_out, zigzag);
+    putVarint(_out, (uint32_t)len);
+  }
+};
+
+static size_t matchLength(const Bytes& a, size_t ia, const Bytes& b, size_t ib) {
+  size_t n = 0;
+  while (ia + n < a.size() && ib + n < b.size() && a[ia + n] == b[ib + n]) n++;
+  return n;
+}
+
+static Bytes makePatch(const Bytes& oldImg, const Bytes& newImg) {
+  Bytes patch;
+  patch.insert(patch.end(), GitFirmwareDeltaPatcher::MAGIC, GitFirmwareDeltaPatcher::MAGIC + 4);
+  putLe32(patch, (uint32_t)oldImg.size());
+  putLe32(patch, gitFirmwareCrc32(0, oldImg.data(), oldImg.size()));
+  putLe32(patch, (uint32_t)newImg.size());
+  putLe32(patch, gitFirmwareCrc32(0, newImg.data(), newImg.size()));
+
+  // Hash chains over every position of the old image
+  std::vector<int32_t> head((size_t)1 << HASH_BITS, -1);
+  std::vector<int32_t> prev(oldImg.size(), -1);
+  for (size_t i = 0; i + KEY_LEN <= oldImg.size(); i++) {
+    uint32_t h = hashKey(&oldImg[i]);
+    prev[i] = head[h];
+    head[h] = (int32_t)i;
+  }
+
+  PatchWriter writer(patch);
+  size_t i = 0;
+  size_t literalStart = 0;
+
+  while (i < newImg.size()) {
+    // Prefer continuing at the old cursor (no seek), then the longest indexed match
+    size_t bestPos = 0;
+    size_t bestLen = 0;
+    if (writer.oldCursor() < oldImg.size()) {
+      bestPos = writer.oldCursor();
+      bestLen = matchLength(oldImg, bestPos, newImg, i);
+    }
+    if (bestLen < MIN_MATCH && i + KEY_LEN <= newImg.size()) {
+      int chain = 0;
+      for (int32_t c = head[hashKey(&newImg[i])]; c >= 0 && chain < MAX_CHAIN; c = prev[c], chain++) {
+        size_t len = matchLength(oldImg, (size_t)c, newImg, i);
+        if (len > bestLen) {
+          bestLen = len;
+          bestPos = (size_t)c;
+        }
+      }
+    }
+    if (bestLen < MIN_MATCH) {
+      i++;
+      continue;
+    }
+
+    writer.insert(&newImg[literalStart], i - literalStart);
+
+    // Extend forward while matches outnumber mismatches (bsdiff scoring)
+    size_t regionLen = bestLen;
+    long score = 0;
+    long bestScore = 0;
+    for (size_t k = bestLen; bestPos + k < oldImg.size() && i + k < newImg.size(); k++) {
+      score += oldImg[bestPos + k] == newImg[i + k] ? 1 : -1;
+      if (score > bestScore) {
+        bestScore = score;
+        regionLen = k + 1;
+      }
+      if (score < bestScore - 64) break;
+    }
+
+    // Emit the region as exact runs (COPY) and difference stretches (ADD)
+    size_t k = 0;
+    while (k < regionLen) {
+      size_t run = 0;
+      while (k + run < regionLen && oldImg[bestPos + k + run] == newImg[i + k + run]) run++;
+      if (run >= MIN_COPY || k + run == regionLen) {
+        if (run > 0) writer.copy(bestPos + k, run);
+        k += run;
+        continue;
+      }
+      // Difference stretch: until the next exact run of MIN_COPY bytes
+      size_t end = k + run;
+      while (end < regionLen) {
+        size_t r = 0;
+        while (end + r < regionLen && r < MIN_COPY && oldImg[bestPos + end + r] == newImg[i + end + r]) r++;
+        if (r >= MIN_COPY) break;
+        end += r + 1;
+      }
+      if (end > regionLen) end = regionLen;
+      writer.add(bestPos + k, &oldImg[bestPos + k], &newImg[i + k], end - k);
+      k = end;
+    }
+
+    i += regionLen;
+    literalStart = i;
+  }
+  writer.insert(&newImg[literalStart], newImg.size() - literalStart);
+  return patch;
+}
+
+// Apply side: same code the device runs
+static bool sourceRead(void* ctx, uint32_t offset, uint8_t* buf, size_t len) {
+  const Bytes* img = static_cast<const Bytes*>(ctx);
+  if ((size_t)offset + len > img->size()) return false;
+  memcpy(buf, img->data() + offset, len);
+  return true;
+}
+
+static bool outputWrite(void* ctx, const uint8_t* data, size_t len) {
+  Bytes* out = static_cast<Bytes*>(ctx);
+  out->insert(out->end(), data, data + len);
+  return true;
+}
+
+static bool applyPatch(const Bytes& oldImg, const Bytes& patch, Bytes& out) {
+  GitFirmwareDeltaPatcher patcher;
+  patcher.begin(sourceRead, const_cast<Bytes*>(&oldImg), (uint32_t)oldImg.size(), outputWrite, &out);
+
+  // Feed in uneven chunks, like network reads
+  GitFirmwareDeltaPatcher::Status status = GitFirmwareDeltaPatcher::DELTA_NEED_INPUT;
+  size_t pos = 0;
+  size_t chunk = 1;
+  while (pos < patch.size() && status == GitFirmwareDeltaPatcher::DELTA_NEED_INPUT) {
+    size_t n = patch.size() - pos < chunk ? patch.size() - pos : chunk;
+    status = patcher.feed(&patch[pos], n);
+    pos += n;
+    chunk = chunk * 3 % 1459 + 1;
+  }
+  if (status != GitFirmwareDeltaPatcher::DELTA_DONE) {
+    fprintf(stderr, "apply failed: %s\n",
+            status == GitFirmwareDeltaPatcher::DELTA_ERROR ? patcher.errorString() : "patch truncated");
+    return false;
+  }
+  return true;
+}
+
+static int usage() {
+  fprintf(stderr,
+          "usage: gitfw_delta diff  old.bin new.bin patch.gfd\n"
+          "       gitfw_delta apply old.bin patch.gfd out.bin\n");
+  return 2;
+}
+
+int main(int argc, char** argv) {
+  if (argc != 5) return usage();
+
+  if (strcmp(argv[1], "diff") == 0) {
+    Bytes oldImg, newImg;
+    if (!readFile(argv[2], oldImg) || !readFile(argv[3], newImg)) return 1;
+    if (newImg.empty()) {
+      fprintf(stderr, "%s is empty\n", argv[3]);
+      return 1;
+    }
+    Bytes patch = makePatch(oldImg, newImg);
+
+    Bytes check;
+    if (!applyPatch(oldImg, patch, check) || check != newImg) {
+      fprintf(stderr, "internal error: patch does not reproduce %s\n", argv[3]);
+      return 1;
+    }
+    if (!writeFile(argv[4], patch)) return 1;
+    printf("%s: %zu bytes (new image %zu bytes, %.1f%%)\n", argv[4], patch.size(), newImg.size(),
+           100.0 * patch.size() / newImg.size());
+    return 0;
+  }
+
+  if (strcmp(argv[1], "apply") == 0) {
+    Bytes oldImg, patch, out;
+    if (!readFile(argv[2], oldImg) || !readFile(argv[3], patch)) return 1;
+    if (!applyPatch(oldImg, patch, out)) return 1;
+    if (!writeFile(argv[4], out)) return 1;
+    printf("%s: %zu bytes\n", argv[4], out.size());
+    return 0;
+  }
+
+  return usage();
+}
@@ -0,0 +1,239 @@
+/**
+ * @file gitfw_inflate.cpp
+ * @brief Host tool: decompress with GitFirmwareInflater and test it against zlib
+ *
+ * Build (Linux / macOS):
+ *   g++ -O2 -std=c++11 -I../../src gitfw_inflate.cpp ../../src/GitFirmwareInflate.cpp \
+ *       -lz -o gitfw_inflate
+ *
+ * Usage:
+ *   gitfw_inflate in.gz out.bin              Decompress like a compressed OTA (format
+ *                                           detected: gzip, zlib or raw deflate)
+ *   gitfw_inflate selftest                   Streams made by zlib, inflated by the device
+ *                                           code: gzip / zlib / raw, stored / fixed /
+ *                                           dynamic blocks, fed 1 byte and 4 KB at a
+ *                                           time; corrupted CRC32 / Adler-32 trailers
+ *     --chunk N       Input bytes per feed() for decompressing a file (default 1024)
+ *     --size N        selftest data size in KB (default 96, more than the window)
+ *
+ * zlib only produces the test streams; the inflater itself has no dependency.
+ */
+
+#include "GitFirmwareInflate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <zlib.h>
+
+typedef std::vector<uint8_t> Bytes;
+
+struct Options {
+  size_t chunk = 1024;
+  size_t sizeKb = 96;
+};
+
+static bool readFile(const char* path, Bytes& out) {
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.insert(out.end(), buf, buf + n);
+  fclose(f);
+  return true;
+}
+
+static bool collect(void* ctx, const uint8_t* data, size_t len) {
+  Bytes* out = static_cast<Bytes*>(ctx);
+  out->insert(out->end(), data, data + len);
+  return true;
+}
+
+// Inflate in into out, chunk bytes per feed(); returns the last status
+static GitFirmwareInflater::Status inflate(GitFirmwareInflater::Format format, const Bytes& in,
+                                           size_t chunk, Bytes& out, const char** error) {
+  GitFirmwareInflater inflater;
+  out.clear();
+  GitFirmwareInflater::Status status = GitFirmwareInflater::INFLATE_ERROR;
+  if (inflater.begin(format, collect, &out)) {
+    status = GitFirmwareInflater::INFLATE_NEED_INPUT;
+    for (size_t pos = 0; pos < in.size() && status == GitFirmwareInflater::INFLATE_NEED_INPUT;
+         pos += chunk) {
+      size_t n = in.size() - pos < chunk ? in.size() - pos : chunk;
+      status = inflater.feed(in.data() + pos, n);
+    }
+  }
+  if (error) *error = inflater.errorString();
+  inflater.end();
+  return status;
+}
+
+static int decompressFile(const Options& o, const char* inPath, const char* outPath) {
+  Bytes in, out;
+  if (!readFile(inPath, in)) return 1;
+  const char* error = "";
+  GitFirmwareInflater::Status status =
+      inflate(GitFirmwareInflater::FORMAT_AUTO, in, o.chunk, out, &error);
+  if (status != GitFirmwareInflater::INFLATE_DONE) {
+    fprintf(stderr, "%s\n", status == GitFirmwareInflater::INFLATE_ERROR ? error : "truncated stream");
+    return 1;
+  }
+  FILE* f = fopen(outPath, "wb");
+  if (!f || fwrite(out.data(), 1, out.size(), f) != out.size()) {
+    perror(outPath);
+    return 1;
+  }
+  fclose(f);
+  printf("%u -> %u bytes\n", (unsigned)in.size(), (unsigned)out.size());
+  return 0;
+}
+
+// Compress with zlib; windowBits picks the framing (15 zlib, 31 gzip, -15 raw)
+static bool compress(const Bytes& in, int level, int strategy, int windowBits, Bytes& out) {
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+  if (deflateInit2(&z, level, Z_DEFLATED, windowBits, 8, strategy) != Z_OK) return false;
+  out.resize(deflateBound(&z, in.size()) + 64);
+  z.next_in = const_cast<Bytef*>(in.data());
+  z.avail_in = (uInt)in.size();
+  z.next_out = out.data();
+  z.avail_out = (uInt)out.size();
+  int ret = deflate(&z, Z_FINISH);
+  out.resize(z.total_out);
+  deflateEnd(&z);
+  return ret == Z_STREAM_END;
+}
+
+// Firmware-like data: repeated strings and tables with variations, random runs
+static Bytes testData(size_t size) {
+  static const char* const WORDS[] = {
+    "[GitFirmwareUpdate] ", "Downloading ", "latest.json ", "https://github.com/",
+    "firmware.bin ", "\x00\x00\x00\x00", "\xff\xff", "esp_ota_", "\n"
+  };
+  Bytes data;
+  srand(1);
+  while (data.size() < size) {
+    int pick = rand() % 12;
+    if (pick < 9) {
+      const char* w = WORDS[pick];
+      size_t n = pick == 5 ? 4 : pick == 6 ? 2 : strlen(w);
+      data.insert(data.end(), w, w + n);
+    } else if (pick < 11) {
+      for (int i = rand() % 64; i > 0; i--) data.push_back((uint8_t)rand());
+    } else if (data.size() > 40000) {
+      // Far match, more than half the window back
+      size_t from = data.size() - 20000 - rand() % 12000;
+      for (size_t i = 0; i < 200; i++) data.push_back(data[from + i]);
+    }
+  }
+  data.resize(size);
+  return data;
+}
+
+#define CHECK(cond, what)                           \
+  do {                                              \
+    bool ok_ = (cond);                              \
+    printf("%-44s %s\n", what, ok_ ? "ok" : "FAIL"); \
+    if (!ok_) failures++;                           \
+  } while (0)
+
+static int selftest(const Options& o) {
+  static const struct {
+    const char* name;
+    GitFirmwareInflater::Format format;
+    int windowBits;
+    size_t header;                           // Bytes before the first deflate block
+  } FRAMES[] = {
+    { "gzip", GitFirmwareInflater::FORMAT_GZIP, 31, 10 },
+    { "zlib", GitFirmwareInflater::FORMAT_ZLIB, 15, 2 },
+    { "raw", GitFirmwareInflater::FORMAT_RAW, -15, 0 },
+  };
+  static const struct {
+    const char* name;
+    int level;
+    int strategy;
+    int btype;                               // BTYPE of the first block
+  } BLOCKS[] = {
+    { "stored", 0, Z_DEFAULT_STRATEGY, 0 },
+    { "fixed", 9, Z_FIXED, 1 },
+    { "dynamic", 9, Z_DEFAULT_STRATEGY, 2 },
+  };
+  static const size_t CHUNKS[] = { 1, 4096 };
+
+  Bytes data = testData(o.sizeKb * 1024);
+  Bytes packed, out;
+  int failures = 0;
+  char what[64];
+
+  for (const auto& frame : FRAMES) {
+    for (const auto& block : BLOCKS) {
+      bool made = compress(data, block.level, block.strategy, frame.windowBits, packed) &&
+                  packed.size() > frame.header && ((packed[frame.header] >> 1) & 3) == block.btype;
+      snprintf(what, sizeof(what), "%s %s: zlib made the stream", frame.name, block.name);
+      CHECK(made, what);
+      if (!made) continue;
+      for (size_t chunk : CHUNKS) {
+        snprintf(what, sizeof(what), "%s %s, %u byte feeds", frame.name, block.name, (unsigned)chunk);
+        CHECK(inflate(frame.format, packed, chunk, out, nullptr) == GitFirmwareInflater::INFLATE_DONE &&
+              out == data, what);
+      }
+      if (frame.format != GitFirmwareInflater::FORMAT_RAW) {
+        snprintf(what, sizeof(what), "%s %s, detected", frame.name, block.name);
+        CHECK(inflate(GitFirmwareInflater::FORMAT_AUTO, packed, 4096, out, nullptr) ==
+                  GitFirmwareInflater::INFLATE_DONE && out == data, what);
+      }
+    }
+  }
+
+  // Trailers: gzip CRC32 is 8 bytes from the end (then ISIZE), zlib Adler-32 the last 4
+  for (int windowBits : { 31, 15 }) {
+    bool gzip = windowBits == 31;
+    compress(data, 9, Z_DEFAULT_STRATEGY, windowBits, packed);
+    Bytes corrupt = packed;
+    corrupt[corrupt.size() - (gzip ? 8 : 1)] ^= 0x01;
+    CHECK(inflate(gzip ? GitFirmwareInflater::FORMAT_GZIP : GitFirmwareInflater::FORMAT_ZLIB,
+                  corrupt, 4096, out, nullptr) == GitFirmwareInflater::INFLATE_ERROR,
+          gzip ? "gzip, corrupted CRC32" : "zlib, corrupted Adler-32");
+    if (gzip) {
+      corrupt = packed;
+      corrupt[corrupt.size() - 1] ^= 0x01;
+      CHECK(inflate(GitFirmwareInflater::FORMAT_GZIP, corrupt, 4096, out, nullptr) ==
+                GitFirmwareInflater::INFLATE_ERROR, "gzip, corrupted ISIZE");
+    }
+    corrupt.assign(packed.begin(), packed.end() - 2);
+    CHECK(inflate(gzip ? GitFirmwareInflater::FORMAT_GZIP : GitFirmwareInflater::FORMAT_ZLIB,
+                  corrupt, 4096, out, nullptr) == GitFirmwareInflater::INFLATE_NEED_INPUT,
+          gzip ? "gzip, truncated trailer not done" : "zlib, truncated trailer not done");
+  }
+
+  printf("%s\n", failures == 0 ? "all passed" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+  Options o;
+  std::vector<const char*> args;
+  for (int i = 1; i < argc; i++) {
+    const char* a = argv[i];
+    const char* v = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (!strncmp(a, "--", 2) && !v) {
+      args.clear();
+      break;
+    }
+    if (!strcmp(a, "--chunk")) o.chunk = strtoul(v, nullptr, 10), i++;
+    else if (!strcmp(a, "--size")) o.sizeKb = strtoul(v, nullptr, 10), i++;
+    else args.push_back(a);
+  }
+
+  if (args.size() == 2 && o.chunk > 0) {
+    return decompressFile(o, args[0], args[1]);
+  }
+  if (args.size() == 1 && !strcmp(args[0], "selftest") && o.sizeKb > 0) {
+    return selftest(o);
+  }
+  fprintf(stderr, "usage: see the header of gitfw_inflate.cpp\n");
+  return 2;
+}
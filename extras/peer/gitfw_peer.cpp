@@ -0,0 +1,242 @@
+/**
+ * @file gitfw_peer.cpp
+ * @brief Host tool: LAN peer cache server and client (GitFirmwarePeer.h)
+ *
+ * Build (Linux):
+ *   g++ -O2 -std=c++11 -I../../src gitfw_peer.cpp ../../src/GitFirmwarePeer.cpp \
+ *       ../../src/GitFirmwareTransport.cpp ../../src/GitFirmwareSha256.cpp -o gitfw_peer
+ *
+ * Usage:
+ *   gitfw_peer serve image.bin              Serve image.bin like a device (until killed)
+ *   gitfw_peer fetch <sha256> out.bin       Find a peer, download and verify the image
+ *   gitfw_peer selftest                     Both over loopback: discovery, full and
+ *                                           ranged download, unknown image
+ *     --port N        HTTP port (default 8288)
+ *     --discovery N   Discovery port (default 8289)
+ *     --query ADDR    Where fetch / selftest send the query (default 255.255.255.255,
+ *                     selftest 127.0.0.1)
+ *     --size N        selftest image size in KB (random data, default 512)
+ *
+ * The server is the device code (GitFirmwarePeerServer::handle() in a loop),
+ * the client is GitFirmwarePeerFinder plus PosixHttpTransport with the
+ * digest check GitFirmwareUpdate applies to a peer download.
+ */
+
+#include "GitFirmwarePeer.h"
+#include "GitFirmwareSha256.h"
+#include "GitFirmwareTransport.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+typedef std::vector<uint8_t> Bytes;
+
+struct Options {
+  uint16_t port = GIT_FIRMWARE_PEER_HTTP_PORT;
+  uint16_t discovery = GIT_FIRMWARE_PEER_DISCOVERY_PORT;
+  const char* query = nullptr;
+  size_t sizeKb = 512;
+};
+
+static bool readFile(const char* path, Bytes& out) {
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.insert(out.end(), buf, buf + n);
+  fclose(f);
+  return true;
+}
+
+static void toHex(const uint8_t digest[32], char hex[65]) {
+  for (int i = 0; i < 32; i++) snprintf(hex + i * 2, 3, "%02x", digest[i]);
+}
+
+static bool memoryRead(void* ctx, uint32_t offset, uint8_t* buf, size_t len) {
+  const Bytes* image = static_cast<const Bytes*>(ctx);
+  if (offset + len > image->size()) return false;
+  memcpy(buf, image->data() + offset, len);
+  return true;
+}
+
+// Serve image until killed
+static int serve(const Options& o, Bytes& image, bool quiet) {
+  uint8_t digest[32];
+  GitFirmwareSha256 hash;
+  hash.begin();
+  hash.update(image.data(), image.size());
+  hash.finish(digest);
+
+  GitFirmwarePeerServer server;
+  server.setImage(digest, (uint32_t)image.size(), memoryRead, &image);
+  if (!server.begin(o.port, o.discovery)) {
+    perror("server begin");
+    return 1;
+  }
+  if (!quiet) {
+    char hex[65];
+    toHex(digest, hex);
+    printf("serving %u bytes, sha256 %s, http %u, discovery %u\n",
+           (unsigned)image.size(), hex, o.port, o.discovery);
+    fflush(stdout);
+  }
+  for (;;) {
+    server.handle();
+    usleep(1000);  // A device loop() with other work
+  }
+}
+
+// GET url (with an optional Range), body into out; returns the HTTP status
+static int download(const char* url, const char* range, Bytes& out) {
+  PosixHttpTransport transport;
+  transport.setTimeout(5000);
+  if (range) {
+    transport.addRequestHeader("Range", range);
+  }
+  int code = transport.open(url, false);
+  out.clear();
+  uint8_t buf[1024];
+  for (;;) {
+    int n = transport.read(buf, sizeof(buf), 50);
+    if (n == GitFirmwareTransport::READ_EOF) break;
+    if (n < 0) {
+      code = -1;
+      break;
+    }
+    out.insert(out.end(), buf, buf + n);
+  }
+  transport.close();
+  return code;
+}
+
+// Find a peer for sha256 and download the image into out (verified)
+static bool fetch(const Options& o, const char* sha256, Bytes& out) {
+  GitFirmwarePeerFinder finder(o.discovery, 500);
+  if (o.query) finder.setQueryAddress(o.query);
+  char url[128];
+  if (!finder.find(sha256, url, sizeof(url))) {
+    fprintf(stderr, "no peer has %s\n", sha256);
+    return false;
+  }
+  printf("peer: %s\n", url);
+  int code = download(url, nullptr, out);
+  if (code != 200) {
+    fprintf(stderr, "HTTP %d\n", code);
+    return false;
+  }
+  uint8_t expected[32], digest[32];
+  GitFirmwareSha256 hash;
+  hash.begin();
+  hash.update(out.data(), out.size());
+  hash.finish(digest);
+  if (!GitFirmwareSha256::parseHex(sha256, expected) || memcmp(digest, expected, 32) != 0) {
+    fprintf(stderr, "sha256 mismatch\n");
+    return false;
+  }
+  printf("%u bytes, sha256 verified\n", (unsigned)out.size());
+  return true;
+}
+
+#define CHECK(cond, what)                           \
+  do {                                              \
+    bool ok_ = (cond);                              \
+    printf("%-44s %s\n", what, ok_ ? "ok" : "FAIL"); \
+    if (!ok_) failures++;                           \
+  } while (0)
+
+static int selftest(Options o) {
+  if (!o.query) o.query = "127.0.0.1";
+  Bytes image(o.sizeKb * 1024);
+  srand(1);
+  for (size_t i = 0; i < image.size(); i++) image[i] = (uint8_t)rand();
+  uint8_t digest[32];
+  GitFirmwareSha256 hash;
+  hash.begin();
+  hash.update(image.data(), image.size());
+  hash.finish(digest);
+  char hex[65];
+  toHex(digest, hex);
+
+  pid_t server = fork();
+  if (server == 0) {
+    _exit(serve(o, image, true));
+  }
+  usleep(100000);  // Let the server bind
+
+  int failures = 0;
+  Bytes body;
+  CHECK(fetch(o, hex, body) && body == image, "discover and download");
+
+  char url[128];
+  snprintf(url, sizeof(url), "http://127.0.0.1:%u/gitfw/%s.bin", o.port, hex);
+  size_t half = image.size() / 2;
+  char range[32];
+  snprintf(range, sizeof(range), "bytes=%u-", (unsigned)half);
+  CHECK(download(url, range, body) == 206 && body == Bytes(image.begin() + half, image.end()),
+        "resume with Range (206)");
+  CHECK(download(url, "bytes=0-99", body) == 206 && body == Bytes(image.begin(), image.begin() + 100),
+        "bounded Range");
+  snprintf(range, sizeof(range), "bytes=%u-", (unsigned)image.size());
+  CHECK(download(url, range, body) == 416, "Range past the end (416)");
+
+  char other[65];
+  memcpy(other, hex, sizeof(other));
+  other[0] = other[0] == '0' ? '1' : '0';
+  GitFirmwarePeerFinder finder(o.discovery, 200);
+  finder.setQueryAddress(o.query);
+  CHECK(!finder.find(other, url, sizeof(url)), "no answer for another image");
+  snprintf(url, sizeof(url), "http://127.0.0.1:%u/gitfw/%s.bin", o.port, other);
+  CHECK(download(url, nullptr, body) == 404, "another image (404)");
+
+  kill(server, SIGTERM);
+  waitpid(server, nullptr, 0);
+  printf("%s\n", failures == 0 ? "all passed" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+  Options o;
+  std::vector<const char*> args;
+  for (int i = 1; i < argc; i++) {
+    const char* a = argv[i];
+    const char* v = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (!strncmp(a, "--", 2) && !v) {
+      args.clear();
+      break;
+    }
+    if (!strcmp(a, "--port")) o.port = (uint16_t)atoi(v), i++;
+    else if (!strcmp(a, "--discovery")) o.discovery = (uint16_t)atoi(v), i++;
+    else if (!strcmp(a, "--query")) o.query = v, i++;
+    else if (!strcmp(a, "--size")) o.sizeKb = strtoul(v, nullptr, 10), i++;
+    else args.push_back(a);
+  }
+
+  if (args.size() == 2 && !strcmp(args[0], "serve")) {
+    Bytes image;
+    if (!readFile(args[1], image) || image.empty()) return 1;
+    return serve(o, image, false);
+  }
+  if (args.size() == 3 && !strcmp(args[0], "fetch")) {
+    Bytes image;
+    if (!fetch(o, args[1], image)) return 1;
+    FILE* f = fopen(args[2], "wb");
+    if (!f || fwrite(image.data(), 1, image.size(), f) != image.size()) {
+      perror(args[2]);
+      return 1;
+    }
+    fclose(f);
+    return 0;
+  }
+  if (args.size() == 1 && !strcmp(args[0], "selftest") && o.sizeKb > 0) {
+    return selftest(o);
+  }
+  fprintf(stderr, "usage: see the header of gitfw_peer.cpp\n");
+  return 2;
+}
@@ -0,0 +1,51 @@
+/**
+ * @file GitFirmwareCheckpoint.cpp
+ * @brief Implementation of GitFirmwareCheckpoint
+ */
+
+#include "GitFirmwareCheckpoint.h"
+#include "GitFirmwareCrc32.h"
+#include <string.h>
+
+const char* const GitFirmwareCheckpoint::KEY = "checkpoint";
+
+// Bump when the layout of GitFirmwareCheckpoint changes
+static const uint32_t CHECKPOINT_MAGIC = 0x31434647;  // "GFC1"
+
+struct CheckpointRecord {
+  uint32_t magic;
+  GitFirmwareCheckpoint data;
+  uint32_t crc;                ///< CRC32 of magic + data
+};
+
+static uint32_t recordCrc(const CheckpointRecord& record) {
+  return gitFirmwareCrc32(0, reinterpret_cast<const uint8_t*>(&record),
+                          offsetof(CheckpointRecord, crc));
+}
+
+bool GitFirmwareCheckpoint::load(GitFirmwareStore& store) {
+  CheckpointRecord record;
+  if (store.load(KEY, &record, sizeof(record)) != sizeof(record) ||
+      record.magic != CHECKPOINT_MAGIC || record.crc != recordCrc(record)) {
+    return false;
+  }
+  *this = record.data;
+  // Strings come from storage: make sure they are terminated
+  url[sizeof(url) - 1] = '\0';
+  validator[sizeof(validator) - 1] = '\0';
+  fromVersion[sizeof(fromVersion) - 1] = '\0';
+  return true;
+}
+
+bool GitFirmwareCheckpoint::save(GitFirmwareStore& store) const {
+  CheckpointRecord record;
+  memset(&record, 0, sizeof(record));  // Deterministic padding for the CRC
+  record.magic = CHECKPOINT_MAGIC;
+  record.data = *this;
+  record.crc = recordCrc(record);
+  return store.save(KEY, &record, sizeof(record));
+}
+
+void GitFirmwareCheckpoint::clear(GitFirmwareStore& store) {
+  store.remove(KEY);
+}
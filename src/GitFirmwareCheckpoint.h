@@ -0,0 +1,53 @@
+/**
+ * @file GitFirmwareCheckpoint.h
+ * @brief Persisted download progress for resuming an update after a reboot
+ *
+ * While an image is downloaded, GitFirmwareUpdate periodically records
+ * how much of it is safely on flash (GitFirmwareSink::commit()) together
+ * with the URL and the server's validator (ETag / Last-Modified). After a
+ * power loss the next update of the same URL continues writing at that
+ * offset with a Range request instead of starting from byte 0.
+ *
+ * The record is stored as one blob with a magic and a CRC32, so a torn or
+ * stale write is detected and ignored.
+ *
+ * Plain C++ only (no Arduino types) so it compiles and is testable on the host.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "GitFirmwareStore.h"
+
+/**
+ * @struct GitFirmwareCheckpoint
+ * @brief Resume point of an interrupted download
+ */
+struct GitFirmwareCheckpoint {
+  /// Store key of the record
+  static const char* const KEY;
+
+  uint32_t offset;             ///< Image bytes committed to the sink (resume point)
+  int32_t totalSize;           ///< Content-Length of the image, -1 if unknown
+  char url[256];               ///< Image URL
+  char validator[64];          ///< ETag or Last-Modified of the image
+  char fromVersion[16];        ///< Firmware version that was running when the download started
+
+  /**
+   * @brief Read and verify the record
+   *
+   * @return false if there is no valid record
+   */
+  bool load(GitFirmwareStore& store);
+
+  /**
+   * @brief Write the record
+   */
+  bool save(GitFirmwareStore& store) const;
+
+  /**
+   * @brief Delete the record
+   */
+  static void clear(GitFirmwareStore& store);
+};
@@ -0,0 +1,34 @@
+/**
+ * @file GitFirmwareCrc32.h
+ * @brief CRC32 (IEEE 802.3, as used by gzip and zlib's crc32()) for GitFirmwareUpdate
+ *
+ * Nibble-table variant: 64 bytes of table instead of 1 KB, fast enough
+ * to keep up with network reads. Plain C++ only (usable on the host).
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Update a running CRC32
+ *
+ * @param crc Previous result (0 for the first call)
+ * @param data Input bytes
+ * @param len Input length
+ * @return CRC32 of all data so far (same value as zlib crc32())
+ */
+inline uint32_t gitFirmwareCrc32(uint32_t crc, const uint8_t* data, size_t len) {
+  static const uint32_t NIBBLE[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+  };
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    crc = (crc >> 4) ^ NIBBLE[crc & 15];
+    crc = (crc >> 4) ^ NIBBLE[crc & 15];
+  }
+  return ~crc;
+}
@@ -0,0 +1,268 @@
+/**
+ * @file GitFirmwareDelta.cpp
+ * @brief Implementation of GitFirmwareDeltaPatcher
+ */
+
+#include "GitFirmwareDelta.h"
+#include "GitFirmwareCrc32.h"
+#include <string.h>
+
+const uint8_t GitFirmwareDeltaPatcher::MAGIC[4] = { 'G', 'F', 'D', '1' };
+
+static uint32_t readLe32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+GitFirmwareDeltaPatcher::GitFirmwareDeltaPatcher()
+  : _source(nullptr),
+    _sourceCtx(nullptr),
+    _sourceCapacity(0),
+    _output(nullptr),
+    _outputCtx(nullptr),
+    _state(S_ERROR),
+    _header{0},
+    _headerLen(0),
+    _sourceSize(0),
+    _targetSize(0),
+    _targetCrc(0),
+    _op(0),
+    _varint(0),
+    _varintShift(0),
+    _remaining(0),
+    _oldPos(0),
+    _outPos(0),
+    _crc(0),
+    _buf{0},
+    _error(nullptr) {
+}
+
+void GitFirmwareDeltaPatcher::begin(SourceFn source, void* sourceCtx, uint32_t sourceCapacity,
+                                    OutputFn output, void* outputCtx) {
+  _source = source;
+  _sourceCtx = sourceCtx;
+  _sourceCapacity = sourceCapacity;
+  _output = output;
+  _outputCtx = outputCtx;
+  _state = S_HEADER;
+  _headerLen = 0;
+  _sourceSize = 0;
+  _targetSize = 0;
+  _targetCrc = 0;
+  _oldPos = 0;
+  _outPos = 0;
+  _crc = 0;
+  _error = nullptr;
+}
+
+GitFirmwareDeltaPatcher::Status GitFirmwareDeltaPatcher::fail(const char* reason) {
+  _state = S_ERROR;
+  _error = reason;
+  return DELTA_ERROR;
+}
+
+size_t GitFirmwareDeltaPatcher::putVarint(uint32_t value, uint8_t* out) {
+  size_t n = 0;
+  while (value >= 0x80) {
+    out[n++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  out[n++] = (uint8_t)value;
+  return n;
+}
+
+GitFirmwareDeltaPatcher::Status GitFirmwareDeltaPatcher::feed(const uint8_t* data, size_t len) {
+  const uint8_t* p = data;
+  const uint8_t* end = data + len;
+
+  while (p < end) {
+    switch (_state) {
+      case S_HEADER: {
+        size_t n = HEADER_SIZE - _headerLen;
+        if (n > (size_t)(end - p)) n = end - p;
+        memcpy(_header + _headerLen, p, n);
+        _headerLen += n;
+        p += n;
+        if (_headerLen == HEADER_SIZE && !parseHeader()) {
+          return DELTA_ERROR;
+        }
+        break;
+      }
+
+      case S_OP:
+        _op = *p++;
+        if (_op > OP_INSERT) {
+          return fail("Unknown patch record");
+        }
+        _varint = 0;
+        _varintShift = 0;
+        _state = _op == OP_INSERT ? S_LEN : S_SEEK;
+        break;
+
+      case S_SEEK: {
+        int r = varintByte(*p++);
+        if (r < 0) return DELTA_ERROR;
+        if (r == 0) break;
+        // Zigzag: 0, -1, 1, -2, ... -> 0, 1, 2, 3, ...
+        int64_t seek = (int64_t)(_varint >> 1) ^ -(int64_t)(_varint & 1);
+        int64_t pos = (int64_t)_oldPos + seek;
+        if (pos < 0 || pos > (int64_t)_sourceSize) {
+          return fail("Patch seeks outside the base image");
+        }
+        _oldPos = (uint32_t)pos;
+        _varint = 0;
+        _varintShift = 0;
+        _state = S_LEN;
+        break;
+      }
+
+      case S_LEN: {
+        int r = varintByte(*p++);
+        if (r < 0) return DELTA_ERROR;
+        if (r == 0) break;
+        _remaining = _varint;
+        if (!startRecord()) return DELTA_ERROR;
+        break;
+      }
+
+      case S_DATA: {
+        size_t n = _remaining;
+        if (n > (size_t)(end - p)) n = end - p;
+        if (_op == OP_ADD) {
+          if (n > sizeof(_buf)) n = sizeof(_buf);
+          if (!_source(_sourceCtx, _oldPos, _buf, n)) {
+            return fail("Base image read failed");
+          }
+          for (size_t i = 0; i < n; i++) {
+            _buf[i] += p[i];
+          }
+          if (!emit(_buf, n)) return DELTA_ERROR;
+          _oldPos += n;
+        } else if (!emit(p, n)) {
+          return DELTA_ERROR;
+        }
+        p += n;
+        _remaining -= n;
+        if (_remaining == 0 && !finishRecord()) return DELTA_ERROR;
+        break;
+      }
+
+      case S_DONE:
+        return fail("Trailing data after patch");
+
+      case S_ERROR:
+        return DELTA_ERROR;
+    }
+  }
+
+  if (_state == S_ERROR) return DELTA_ERROR;
+  return _state == S_DONE ? DELTA_DONE : DELTA_NEED_INPUT;
+}
+
+bool GitFirmwareDeltaPatcher::parseHeader() {
+  if (memcmp(_header, MAGIC, sizeof(MAGIC)) != 0) {
+    fail("Not a GFD1 patch");
+    return false;
+  }
+  _sourceSize = readLe32(_header + 4);
+  uint32_t sourceCrc = readLe32(_header + 8);
+  _targetSize = readLe32(_header + 12);
+  _targetCrc = readLe32(_header + 16);
+
+  if (_sourceSize > _sourceCapacity) {
+    fail("Patch base larger than the running image");
+    return false;
+  }
+  if (_targetSize == 0) {
+    fail("Patch has an empty target");
+    return false;
+  }
+
+  // Refuse to build anything from the wrong base image
+  uint32_t crc = 0;
+  for (uint32_t pos = 0; pos < _sourceSize; ) {
+    size_t n = _sourceSize - pos;
+    if (n > sizeof(_buf)) n = sizeof(_buf);
+    if (!_source(_sourceCtx, pos, _buf, n)) {
+      fail("Base image read failed");
+      return false;
+    }
+    crc = gitFirmwareCrc32(crc, _buf, n);
+    pos += n;
+  }
+  if (crc != sourceCrc) {
+    fail("Patch does not match the running image");
+    return false;
+  }
+
+  _state = S_OP;
+  return true;
+}
+
+int GitFirmwareDeltaPatcher::varintByte(uint8_t b) {
+  if (_varintShift > 28 || (_varintShift == 28 && (b & 0xf0))) {
+    fail("Patch varint overflow");
+    return -1;
+  }
+  _varint |= (uint32_t)(b & 0x7f) << _varintShift;
+  _varintShift += 7;
+  return (b & 0x80) ? 0 : 1;
+}
+
+bool GitFirmwareDeltaPatcher::startRecord() {
+  if (_remaining > _targetSize - _outPos) {
+    fail("Patch record exceeds target size");
+    return false;
+  }
+  if (_op != OP_INSERT && _remaining > _sourceSize - _oldPos) {
+    fail("Patch record exceeds base image");
+    return false;
+  }
+
+  if (_op == OP_COPY) {
+    // No payload: copy straight from the old image
+    if (!copyOld(_remaining)) return false;
+    _remaining = 0;
+  }
+  if (_remaining == 0) {
+    return finishRecord();
+  }
+  _state = S_DATA;
+  return true;
+}
+
+bool GitFirmwareDeltaPatcher::finishRecord() {
+  if (_outPos < _targetSize) {
+    _state = S_OP;
+    return true;
+  }
+  if (_crc != _targetCrc) {
+    fail("Patched image CRC32 mismatch");
+    return false;
+  }
+  _state = S_DONE;
+  return true;
+}
+
+bool GitFirmwareDeltaPatcher::copyOld(uint32_t len) {
+  while (len > 0) {
+    size_t n = len > sizeof(_buf) ? sizeof(_buf) : len;
+    if (!_source(_sourceCtx, _oldPos, _buf, n)) {
+      fail("Base image read failed");
+      return false;
+    }
+    if (!emit(_buf, n)) return false;
+    _oldPos += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool GitFirmwareDeltaPatcher::emit(const uint8_t* data, size_t len) {
+  _crc = gitFirmwareCrc32(_crc, data, len);
+  _outPos += len;
+  if (!_output(_outputCtx, data, len)) {
+    fail("Patched image write failed");
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,178 @@
+/**
+ * @file GitFirmwareDelta.h
+ * @brief Streaming binary patch (delta OTA) applier for GitFirmwareUpdate
+ *
+ * A delta patch rebuilds the new image from the image that is currently
+ * running plus a small patch file. The patch is applied while it is being
+ * downloaded: feed() accepts patch bytes in arbitrary chunk sizes, reads
+ * the old image through a source callback (random access, e.g. the running
+ * app partition) and emits the new image through an output callback.
+ * Memory use is constant (one GIT_FIRMWARE_DELTA_BUF byte work buffer).
+ *
+ * Patch format "GFD1" (all integers little endian):
+ *
+ *   Header (20 bytes)
+ *     "GFD1"
+ *     u32 sourceSize   bytes of the old image the patch was made against
+ *     u32 sourceCrc    CRC32 of those bytes (checked before any output)
+ *     u32 targetSize   size of the new image
+ *     u32 targetCrc    CRC32 of the new image (checked at the end)
+ *
+ *   Records, until targetSize bytes were produced
+ *     0x00 COPY   varint seek, varint len              out = old[pos..]
+ *     0x01 ADD    varint seek, varint len, len bytes    out = old[pos..] + diff (mod 256)
+ *     0x02 INSERT varint len, len bytes                 out = literal bytes
+ *
+ *   "seek" is a zigzag-encoded signed offset applied to the old-image
+ *   cursor before the record; COPY / ADD advance the cursor by len.
+ *   Varints are LEB128 (7 bits per byte, low bits first).
+ *
+ * ADD records carry bsdiff-style byte differences, so code that only moved
+ * (changed addresses) becomes mostly zero bytes; serve the patch gzip
+ * compressed (GIT_FIRMWARE_USE_GZIP) for the full size reduction.
+ *
+ * Patches are generated on the host with extras/delta/gitfw_delta.cpp.
+ *
+ * Plain C++ only (no Arduino types) so it compiles and is testable on the host.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Work buffer for old-image reads (bytes, on the patcher object)
+#ifndef GIT_FIRMWARE_DELTA_BUF
+  #define GIT_FIRMWARE_DELTA_BUF 256
+#endif
+
+/**
+ * @class GitFirmwareDeltaPatcher
+ * @brief Incremental "GFD1" patch applier
+ */
+class GitFirmwareDeltaPatcher {
+public:
+  /// Patch file magic
+  static const uint8_t MAGIC[4];
+  /// Header size in bytes
+  static const size_t HEADER_SIZE = 20;
+
+  /**
+   * @enum Op
+   * @brief Record types
+   */
+  enum Op {
+    OP_COPY = 0,               ///< Copy bytes from the old image
+    OP_ADD,                    ///< Old image bytes plus difference bytes
+    OP_INSERT                  ///< Literal bytes
+  };
+
+  /**
+   * @enum Status
+   * @brief Result of feed()
+   */
+  enum Status {
+    DELTA_NEED_INPUT = 0,      ///< All input consumed, image not complete yet
+    DELTA_DONE,                ///< Image complete and target CRC verified
+    DELTA_ERROR                ///< Corrupt patch, wrong base image or callback failure
+  };
+
+  /**
+   * @typedef SourceFn
+   * @brief Reads the old image
+   * @return true if len bytes were read at offset
+   */
+  typedef bool (*SourceFn)(void* ctx, uint32_t offset, uint8_t* buf, size_t len);
+
+  /**
+   * @typedef OutputFn
+   * @brief Receives the new image
+   * @return true to continue, false to stop with DELTA_ERROR
+   */
+  typedef bool (*OutputFn)(void* ctx, const uint8_t* data, size_t len);
+
+  GitFirmwareDeltaPatcher();
+
+  /**
+   * @brief Reset state for a new patch
+   *
+   * @param source Old image reader
+   * @param sourceCtx Context passed to source
+   * @param sourceCapacity Readable bytes behind source (e.g. partition size)
+   * @param output Output callback
+   * @param outputCtx Context passed to output
+   */
+  void begin(SourceFn source, void* sourceCtx, uint32_t sourceCapacity,
+             OutputFn output, void* outputCtx);
+
+  /**
+   * @brief Apply a chunk of patch data
+   *
+   * The header is verified against the old image as soon as it is complete
+   * (reads sourceSize bytes through the source callback once).
+   */
+  Status feed(const uint8_t* data, size_t len);
+
+  /**
+   * @brief Size of the new image (0 until the header was parsed)
+   */
+  uint32_t targetSize() const { return _targetSize; }
+
+  /**
+   * @brief New image bytes emitted so far
+   */
+  uint32_t totalOut() const { return _outPos; }
+
+  /**
+   * @brief Human-readable reason for DELTA_ERROR (static string)
+   */
+  const char* errorString() const { return _error ? _error : ""; }
+
+  /**
+   * @brief Encode an unsigned varint (generator side)
+   *
+   * @param value Value to encode
+   * @param out Destination, at least 5 bytes
+   * @return bytes written
+   */
+  static size_t putVarint(uint32_t value, uint8_t* out);
+
+private:
+  enum State {
+    S_HEADER, S_OP, S_SEEK, S_LEN, S_DATA, S_DONE, S_ERROR
+  };
+
+  SourceFn _source;
+  void* _sourceCtx;
+  uint32_t _sourceCapacity;
+  OutputFn _output;
+  void* _outputCtx;
+
+  State _state;
+  uint8_t _header[HEADER_SIZE];
+  uint8_t _headerLen;
+
+  uint32_t _sourceSize;
+  uint32_t _targetSize;
+  uint32_t _targetCrc;
+
+  uint8_t _op;
+  uint32_t _varint;            ///< Varint being decoded
+  uint8_t _varintShift;
+  uint32_t _remaining;         ///< Bytes left in the current record
+
+  uint32_t _oldPos;            ///< Old image cursor
+  uint32_t _outPos;            ///< New image bytes produced
+  uint32_t _crc;               ///< CRC32 of the new image so far
+
+  uint8_t _buf[GIT_FIRMWARE_DELTA_BUF];
+  const char* _error;
+
+  Status fail(const char* reason);
+  bool parseHeader();
+  int varintByte(uint8_t b);
+  bool startRecord();
+  bool finishRecord();
+  bool emit(const uint8_t* data, size_t len);
+  bool copyOld(uint32_t len);
+};
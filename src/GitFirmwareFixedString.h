@@ -0,0 +1,45 @@
+/**
+ * @file GitFirmwareFixedString.h
+ * @brief Fixed-capacity string stored inline (no heap), for GIT_FIRMWARE_USE_ZERO_HEAP
+ *
+ * Supports the subset of Arduino String that GitFirmwareUpdate uses for its
+ * fields (assign, c_str(), length()), so the members can switch type with
+ * the build flag. Longer values are truncated and flagged by overflow().
+ * Plain C++ only (usable on the host).
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * @class GitFirmwareFixedString
+ * @brief Up to N - 1 characters plus terminator
+ */
+template <size_t N>
+class GitFirmwareFixedString {
+public:
+  GitFirmwareFixedString() : _len(0), _overflow(false) { _buf[0] = '\0'; }
+
+  GitFirmwareFixedString& operator=(const char* value) {
+    size_t len = value ? strlen(value) : 0;
+    _overflow = len >= N;
+    if (_overflow) len = N - 1;
+    memcpy(_buf, value ? value : "", len);
+    _buf[len] = '\0';
+    _len = len;
+    return *this;
+  }
+
+  const char* c_str() const { return _buf; }
+  size_t length() const { return _len; }
+
+  /// Last assignment was truncated
+  bool overflow() const { return _overflow; }
+
+private:
+  char _buf[N];
+  size_t _len;
+  bool _overflow;
+};
@@ -0,0 +1,92 @@
+/**
+ * @file GitFirmwareHistogram.h
+ * @brief Fixed-size log2 histogram for download latencies and read sizes
+ *
+ * Bucket 0 counts zeros, bucket i (1..BUCKETS-1) counts values in
+ * [2^(i-1), 2^i); the last bucket also takes everything larger. No heap,
+ * constant time per sample. Plain C++ only (usable on the host).
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @class GitFirmwareHistogram
+ * @brief Power-of-two bucket counts plus sample count, sum and maximum
+ */
+class GitFirmwareHistogram {
+public:
+  /// Bucket count: the last bucket starts at 2^(BUCKETS-2) (16384 µs / bytes)
+  static const uint8_t BUCKETS = 16;
+
+  GitFirmwareHistogram() { reset(); }
+
+  void reset() {
+    memset(_counts, 0, sizeof(_counts));
+    _samples = 0;
+    _sum = 0;
+    _max = 0;
+  }
+
+  /**
+   * @brief Count one sample
+   */
+  void add(uint32_t value) {
+    _counts[bucketOf(value)]++;
+    _samples++;
+    _sum += value;
+    if (value > _max) {
+      _max = value;
+    }
+  }
+
+  /// Samples in bucket (0 if out of range)
+  uint32_t count(uint8_t bucket) const { return bucket < BUCKETS ? _counts[bucket] : 0; }
+
+  /// Smallest value counted in bucket
+  static uint32_t lowerBound(uint8_t bucket) { return bucket == 0 ? 0 : (uint32_t)1 << (bucket - 1); }
+
+  uint32_t samples() const { return _samples; }
+  uint32_t max() const { return _max; }
+  uint32_t mean() const { return _samples ? (uint32_t)(_sum / _samples) : 0; }
+
+  /**
+   * @brief Bucket of a value: 0 for 0, else 1 + floor(log2(value)), clamped
+   */
+  static uint8_t bucketOf(uint32_t value) {
+    if (value == 0) return 0;
+    uint8_t bucket = (uint8_t)(32 - __builtin_clz(value));
+    return bucket < BUCKETS ? bucket : BUCKETS - 1;
+  }
+
+  /**
+   * @brief Write non-empty buckets as "lowerBound:count" pairs, e.g. "0:2 512:40 1024:7"
+   *
+   * @return length written (output is truncated to fit, always terminated)
+   */
+  size_t format(char* buf, size_t size) const {
+    if (size == 0) return 0;
+    size_t len = 0;
+    buf[0] = '\0';
+    for (uint8_t i = 0; i < BUCKETS; i++) {
+      if (_counts[i] == 0) continue;
+      int n = snprintf(buf + len, size - len, "%s%u:%u", len ? " " : "",
+                       (unsigned)lowerBound(i), (unsigned)_counts[i]);
+      if (n < 0 || (size_t)n >= size - len) {
+        return strlen(buf);
+      }
+      len += n;
+    }
+    return len;
+  }
+
+private:
+  uint32_t _counts[BUCKETS];
+  uint32_t _samples;
+  uint64_t _sum;
+  uint32_t _max;
+};
@@ -0,0 +1,622 @@
+/**
+ * @file GitFirmwareInflate.cpp
+ * @brief Implementation of GitFirmwareInflater
+ *
+ * Canonical Huffman decoding follows the approach of zlib's puff.c
+ * (count/symbol tables, bit-by-bit decode), restructured as a state
+ * machine so decoding can stop at any input byte and resume later.
+ */
+
+#include "GitFirmwareInflate.h"
+#include "GitFirmwareCrc32.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Length / distance base values and extra bits (RFC 1951, 3.2.5)
+static const uint16_t LEN_BASE[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t LEN_EXTRA[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t DIST_BASE[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+  8193, 12289, 16385, 24577
+};
+static const uint8_t DIST_EXTRA[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+// Order of code length code lengths (RFC 1951, 3.2.7)
+static const uint8_t CLEN_ORDER[19] = {
+  16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+// gzip header flags
+static const uint8_t GZ_FHCRC = 0x02;
+static const uint8_t GZ_FEXTRA = 0x04;
+static const uint8_t GZ_FNAME = 0x08;
+static const uint8_t GZ_FCOMMENT = 0x10;
+
+GitFirmwareInflater::GitFirmwareInflater()
+  : _in(nullptr),
+    _inEnd(nullptr),
+    _bitBuf(0),
+    _bitCount(0),
+    _state(S_ERROR),
+    _format(FORMAT_AUTO),
+    _lastBlock(false),
+    _gzipStep(0),
+    _gzipFlags(0),
+    _skip(0),
+    _nlen(0), _ndist(0), _ncode(0), _index(0),
+    _pendingSym(0),
+    _copyLen(0),
+    _copyDist(0),
+    _storedLen(0),
+    _window(nullptr),
+    _ownsWindow(false),
+    _pos(0),
+    _flushPos(0),
+    _totalOut(0),
+    _output(nullptr),
+    _outputCtx(nullptr),
+    _crc(0),
+    _adlerA(1), _adlerB(0),
+    _error(nullptr) {
+  _lenCode.symbol = _lenSymbol;
+  _distCode.symbol = _distSymbol;
+}
+
+GitFirmwareInflater::~GitFirmwareInflater() {
+  end();
+}
+
+bool GitFirmwareInflater::begin(Format format, OutputFn output, void* ctx, uint8_t* window) {
+  if (window) {
+    end();
+    _window = window;
+  } else if (!_window) {
+    _window = (uint8_t*)malloc(WINDOW);
+    _ownsWindow = true;
+    if (!_window) {
+      _state = S_ERROR;
+      _error = "Out of memory for inflate window";
+      return false;
+    }
+  }
+
+  _format = format;
+  _output = output;
+  _outputCtx = ctx;
+  _bitBuf = 0;
+  _bitCount = 0;
+  _lastBlock = false;
+  _gzipStep = 0;
+  _pos = 0;
+  _flushPos = 0;
+  _totalOut = 0;
+  _crc = 0;
+  _adlerA = 1;
+  _adlerB = 0;
+  _error = nullptr;
+
+  switch (format) {
+    case FORMAT_GZIP: _state = S_GZIP_HEADER; break;
+    case FORMAT_ZLIB: _state = S_ZLIB_HEADER; break;
+    case FORMAT_RAW:  _state = S_BLOCK_HEADER; break;
+    default:          _state = S_DETECT; break;
+  }
+  return true;
+}
+
+void GitFirmwareInflater::end() {
+  if (_ownsWindow) {
+    free(_window);
+  }
+  _window = nullptr;
+  _ownsWindow = false;
+}
+
+bool GitFirmwareInflater::formatFromName(const char* name, Format& format) {
+  static const struct { const char* name; Format format; } NAMES[] = {
+    { "gzip", FORMAT_GZIP }, { "x-gzip", FORMAT_GZIP },
+    { "deflate", FORMAT_ZLIB }, { "zlib", FORMAT_ZLIB },
+    { "raw-deflate", FORMAT_RAW }, { "auto", FORMAT_AUTO }
+  };
+  if (!name) return false;
+  for (size_t i = 0; i < sizeof(NAMES) / sizeof(NAMES[0]); i++) {
+    const char* a = name;
+    const char* b = NAMES[i].name;
+    while (*a && *b && (*a | 0x20) == *b) { a++; b++; }
+    if (*a == '\0' && *b == '\0') {
+      format = NAMES[i].format;
+      return true;
+    }
+  }
+  return false;
+}
+
+GitFirmwareInflater::Status GitFirmwareInflater::fail(const char* reason) {
+  _state = S_ERROR;
+  if (!_error) _error = reason;
+  return INFLATE_ERROR;
+}
+
+bool GitFirmwareInflater::need(uint8_t n) {
+  while (_bitCount < n) {
+    if (_in == _inEnd) return false;
+    _bitBuf |= (uint32_t)(*_in++) << _bitCount;
+    _bitCount += 8;
+  }
+  return true;
+}
+
+uint32_t GitFirmwareInflater::bits(uint8_t n) {
+  uint32_t v = n < 32 ? (_bitBuf & ((1UL << n) - 1)) : _bitBuf;
+  _bitBuf = n < 32 ? (_bitBuf >> n) : 0;
+  _bitCount -= n;
+  return v;
+}
+
+// Returns symbol, -1 if more input is needed (nothing consumed), -2 if invalid
+int GitFirmwareInflater::decode(const Huffman& h) {
+  while (_bitCount <= 24 && _in < _inEnd) {
+    _bitBuf |= (uint32_t)(*_in++) << _bitCount;
+    _bitCount += 8;
+  }
+
+  int code = 0;   // Bits being decoded
+  int first = 0;  // First code of length len
+  int index = 0;  // Index of first code of length len in symbol table
+  for (uint8_t len = 1; len <= 15; len++) {
+    if (len > _bitCount) return -1;
+    code |= (_bitBuf >> (len - 1)) & 1;
+    int count = h.count[len];
+    if (code - count < first) {
+      bits(len);
+      return h.symbol[index + (code - first)];
+    }
+    index += count;
+    first += count;
+    first <<= 1;
+    code <<= 1;
+  }
+  return -2;
+}
+
+// Returns 0 for a complete code, > 0 if incomplete, < 0 if over-subscribed
+int GitFirmwareInflater::build(Huffman& h, const uint8_t* lengths, uint16_t n) {
+  for (uint8_t len = 0; len < 16; len++) h.count[len] = 0;
+  for (uint16_t sym = 0; sym < n; sym++) h.count[lengths[sym]]++;
+  if (h.count[0] == n) return 0;  // No codes: complete, but decoding will fail
+
+  int left = 1;
+  for (uint8_t len = 1; len < 16; len++) {
+    left <<= 1;
+    left -= h.count[len];
+    if (left < 0) return left;
+  }
+
+  uint16_t offs[16];
+  offs[1] = 0;
+  for (uint8_t len = 1; len < 15; len++) offs[len + 1] = offs[len] + h.count[len];
+  for (uint16_t sym = 0; sym < n; sym++) {
+    if (lengths[sym] != 0) h.symbol[offs[lengths[sym]]++] = sym;
+  }
+  return left;
+}
+
+void GitFirmwareInflater::buildFixed() {
+  uint16_t sym = 0;
+  for (; sym < 144; sym++) _lengths[sym] = 8;
+  for (; sym < 256; sym++) _lengths[sym] = 9;
+  for (; sym < 280; sym++) _lengths[sym] = 7;
+  for (; sym < 288; sym++) _lengths[sym] = 8;
+  build(_lenCode, _lengths, 288);
+  for (sym = 0; sym < 30; sym++) _lengths[sym] = 5;
+  build(_distCode, _lengths, 30);
+}
+
+void GitFirmwareInflater::checksum(const uint8_t* data, size_t len) {
+  if (_format == FORMAT_GZIP) {
+    _crc = gitFirmwareCrc32(_crc, data, len);
+  } else if (_format == FORMAT_ZLIB) {
+    // Largest block before the 32-bit sums can overflow (zlib NMAX)
+    while (len > 0) {
+      size_t n = len > 5552 ? 5552 : len;
+      len -= n;
+      while (n--) {
+        _adlerA += *data++;
+        _adlerB += _adlerA;
+      }
+      _adlerA %= 65521;
+      _adlerB %= 65521;
+    }
+  }
+}
+
+bool GitFirmwareInflater::flush() {
+  if (_pos > _flushPos) {
+    checksum(_window + _flushPos, _pos - _flushPos);
+    if (!_output(_outputCtx, _window + _flushPos, _pos - _flushPos)) {
+      _error = "Output write failed";
+      return false;
+    }
+    _flushPos = _pos;
+  }
+  return true;
+}
+
+bool GitFirmwareInflater::putByte(uint8_t b) {
+  _window[_pos++] = b;
+  _totalOut++;
+  if (_pos == WINDOW) {
+    if (!flush()) return false;
+    _pos = 0;
+    _flushPos = 0;
+  }
+  return true;
+}
+
+// Advance the state machine by one unit of work.
+// Returns false when more input is needed or a final state is reached.
+bool GitFirmwareInflater::step() {
+  switch (_state) {
+    case S_DETECT: {
+      if (!need(16)) return false;
+      uint8_t b0 = _bitBuf & 0xff;
+      uint8_t b1 = (_bitBuf >> 8) & 0xff;
+      if (b0 == 0x1f && b1 == 0x8b) {
+        _format = FORMAT_GZIP;
+        _state = S_GZIP_HEADER;
+      } else if ((b0 & 0x0f) == 8 && ((b0 << 8) | b1) % 31 == 0) {
+        _format = FORMAT_ZLIB;
+        _state = S_ZLIB_HEADER;
+      } else {
+        _format = FORMAT_RAW;
+        _state = S_BLOCK_HEADER;
+      }
+      return true;
+    }
+
+    case S_GZIP_HEADER:
+      switch (_gzipStep) {
+        case 0:  // ID1 ID2 CM FLG
+          if (!need(32)) return false;
+          if (bits(8) != 0x1f || bits(8) != 0x8b || bits(8) != 8) {
+            fail("Not a gzip stream");
+            return false;
+          }
+          _gzipFlags = bits(8);
+          if (_gzipFlags & 0xe0) {
+            fail("Reserved gzip flags set");
+            return false;
+          }
+          _skip = 6;  // MTIME, XFL, OS
+          _gzipStep = 1;
+          return true;
+        case 1:  // Fixed header tail
+        case 3:  // FEXTRA payload
+        case 7:  // FHCRC
+          while (_skip > 0) {
+            if (!need(8)) return false;
+            bits(8);
+            _skip--;
+          }
+          _gzipStep++;
+          if (_gzipStep == 8) _state = S_BLOCK_HEADER;
+          return true;
+        case 2:
+          if (_gzipFlags & GZ_FEXTRA) {
+            if (!need(16)) return false;
+            _skip = bits(16);
+          }
+          _gzipStep = 3;
+          return true;
+        case 4:  // FNAME
+        case 5:  // FCOMMENT
+          if (_gzipFlags & (_gzipStep == 4 ? GZ_FNAME : GZ_FCOMMENT)) {
+            for (;;) {
+              if (!need(8)) return false;
+              if (bits(8) == 0) break;
+            }
+          }
+          _gzipStep++;
+          return true;
+        default:  // 6
+          _skip = (_gzipFlags & GZ_FHCRC) ? 2 : 0;
+          _gzipStep = 7;
+          return true;
+      }
+
+    case S_ZLIB_HEADER: {
+      if (!need(16)) return false;
+      uint32_t cmf = bits(8);
+      uint32_t flg = bits(8);
+      if ((cmf & 0x0f) != 8 || ((cmf << 8) | flg) % 31 != 0) {
+        fail("Not a zlib stream");
+        return false;
+      }
+      if (flg & 0x20) {
+        fail("zlib preset dictionary not supported");
+        return false;
+      }
+      if ((1UL << ((cmf >> 4) + 8)) > WINDOW) {
+        fail("Compression window larger than inflate window");
+        return false;
+      }
+      _state = S_BLOCK_HEADER;
+      return true;
+    }
+
+    case S_BLOCK_HEADER: {
+      if (!need(3)) return false;
+      _lastBlock = bits(1);
+      uint32_t type = bits(2);
+      if (type == 0) {
+        _state = S_STORED_LEN;
+      } else if (type == 1) {
+        buildFixed();
+        _state = S_CODES;
+      } else if (type == 2) {
+        _state = S_TABLE_COUNTS;
+      } else {
+        fail("Invalid block type");
+        return false;
+      }
+      return true;
+    }
+
+    case S_STORED_LEN: {
+      bits(_bitCount & 7);  // Skip to byte boundary (idempotent)
+      if (!need(32)) return false;
+      uint32_t len = bits(16);
+      uint32_t nlen = bits(16);
+      if (len != (~nlen & 0xffff)) {
+        fail("Stored block length mismatch");
+        return false;
+      }
+      _storedLen = len;
+      _state = S_STORED_COPY;
+      return true;
+    }
+
+    case S_STORED_COPY:
+      while (_storedLen > 0) {
+        uint8_t b;
+        if (_bitCount >= 8) {
+          b = bits(8);
+        } else if (_in < _inEnd) {
+          b = *_in++;
+        } else {
+          return false;
+        }
+        if (!putByte(b)) {
+          fail("Output write failed");
+          return false;
+        }
+        _storedLen--;
+      }
+      _state = _lastBlock ? S_TRAILER : S_BLOCK_HEADER;
+      return true;
+
+    case S_TABLE_COUNTS:
+      if (!need(14)) return false;
+      _nlen = bits(5) + 257;
+      _ndist = bits(5) + 1;
+      _ncode = bits(4) + 4;
+      if (_nlen > 286 || _ndist > 30) {
+        fail("Bad dynamic table counts");
+        return false;
+      }
+      memset(_lengths, 0, 19);
+      _index = 0;
+      _state = S_TABLE_CLEN;
+      return true;
+
+    case S_TABLE_CLEN:
+      while (_index < _ncode) {
+        if (!need(3)) return false;
+        _lengths[CLEN_ORDER[_index++]] = bits(3);
+      }
+      // Code length code must be complete
+      if (build(_lenCode, _lengths, 19) != 0) {
+        fail("Bad code length code");
+        return false;
+      }
+      _index = 0;
+      _state = S_TABLE_LENS;
+      return true;
+
+    case S_TABLE_LENS:
+      while (_index < _nlen + _ndist) {
+        int sym = decode(_lenCode);
+        if (sym == -1) return false;
+        if (sym < 0) {
+          fail("Bad code length symbol");
+          return false;
+        }
+        if (sym < 16) {
+          _lengths[_index++] = sym;
+        } else {
+          _pendingSym = sym;
+          _state = S_TABLE_REPEAT;
+          return true;
+        }
+      }
+      if (_lengths[256] == 0) {
+        fail("Missing end-of-block code");
+        return false;
+      }
+      {
+        // Incomplete codes are only allowed for a single length-1 code
+        int err = build(_lenCode, _lengths, _nlen);
+        if (err < 0 || (err > 0 && _nlen - _lenCode.count[0] != 1)) {
+          fail("Bad literal/length code");
+          return false;
+        }
+        err = build(_distCode, _lengths + _nlen, _ndist);
+        if (err < 0 || (err > 0 && _ndist - _distCode.count[0] != 1)) {
+          fail("Bad distance code");
+          return false;
+        }
+      }
+      _state = S_CODES;
+      return true;
+
+    case S_TABLE_REPEAT: {
+      uint8_t len = 0;
+      uint32_t rep;
+      if (_pendingSym == 16) {
+        if (_index == 0) {
+          fail("Repeat with no previous length");
+          return false;
+        }
+        if (!need(2)) return false;
+        len = _lengths[_index - 1];
+        rep = 3 + bits(2);
+      } else if (_pendingSym == 17) {
+        if (!need(3)) return false;
+        rep = 3 + bits(3);
+      } else {
+        if (!need(7)) return false;
+        rep = 11 + bits(7);
+      }
+      if (_index + rep > (uint32_t)(_nlen + _ndist)) {
+        fail("Too many code lengths");
+        return false;
+      }
+      while (rep--) _lengths[_index++] = len;
+      _state = S_TABLE_LENS;
+      return true;
+    }
+
+    case S_CODES:
+      for (;;) {
+        int sym = decode(_lenCode);
+        if (sym == -1) return false;
+        if (sym < 0) {
+          fail("Bad literal/length symbol");
+          return false;
+        }
+        if (sym < 256) {
+          if (!putByte((uint8_t)sym)) {
+            fail("Output write failed");
+            return false;
+          }
+          continue;
+        }
+        if (sym == 256) {
+          _state = _lastBlock ? S_TRAILER : S_BLOCK_HEADER;
+          return true;
+        }
+        sym -= 257;
+        if (sym >= 29) {
+          fail("Bad length symbol");
+          return false;
+        }
+        _pendingSym = sym;
+        _state = S_LEN_EXTRA;
+        return true;
+      }
+
+    case S_LEN_EXTRA:
+      if (!need(LEN_EXTRA[_pendingSym])) return false;
+      _copyLen = LEN_BASE[_pendingSym] + bits(LEN_EXTRA[_pendingSym]);
+      _state = S_DIST;
+      return true;
+
+    case S_DIST: {
+      int sym = decode(_distCode);
+      if (sym == -1) return false;
+      if (sym < 0 || sym >= 30) {
+        fail("Bad distance symbol");
+        return false;
+      }
+      _pendingSym = sym;
+      _state = S_DIST_EXTRA;
+      return true;
+    }
+
+    case S_DIST_EXTRA:
+      if (!need(DIST_EXTRA[_pendingSym])) return false;
+      _copyDist = DIST_BASE[_pendingSym] + bits(DIST_EXTRA[_pendingSym]);
+      if (_copyDist > _totalOut || _copyDist > WINDOW) {
+        fail("Distance too far back");
+        return false;
+      }
+      _state = S_COPY;
+      return true;
+
+    case S_COPY:
+      while (_copyLen > 0) {
+        if (!putByte(_window[(_pos - _copyDist) & (WINDOW - 1)])) {
+          fail("Output write failed");
+          return false;
+        }
+        _copyLen--;
+      }
+      _state = S_CODES;
+      return true;
+
+    case S_TRAILER:
+      if (!flush()) {
+        fail("Output write failed");
+        return false;
+      }
+      bits(_bitCount & 7);  // Trailer is byte aligned
+      if (_format == FORMAT_GZIP) {
+        if (!need(32)) return false;
+        if (_gzipStep == 8) {
+          uint32_t crc = bits(16);
+          crc |= bits(16) << 16;
+          if (crc != _crc) {
+            fail("gzip CRC32 mismatch");
+            return false;
+          }
+          _gzipStep = 9;
+          return true;
+        }
+        uint32_t isize = bits(16);
+        isize |= bits(16) << 16;
+        if (isize != (uint32_t)_totalOut) {
+          fail("gzip size mismatch");
+          return false;
+        }
+      } else if (_format == FORMAT_ZLIB) {
+        if (!need(32)) return false;
+        uint32_t adler = bits(8) << 24;
+        adler |= bits(8) << 16;
+        adler |= bits(8) << 8;
+        adler |= bits(8);
+        if (adler != ((_adlerB << 16) | _adlerA)) {
+          fail("zlib Adler-32 mismatch");
+          return false;
+        }
+      }
+      _state = S_DONE;
+      return false;
+
+    default:  // S_DONE, S_ERROR
+      return false;
+  }
+}
+
+GitFirmwareInflater::Status GitFirmwareInflater::feed(const uint8_t* data, size_t len) {
+  if (_state == S_ERROR) return INFLATE_ERROR;
+  if (_state == S_DONE) return INFLATE_DONE;
+  if (!_window) return fail("Inflater not started");
+
+  _in = data;
+  _inEnd = data + len;
+  while (step()) {}
+  _in = _inEnd = nullptr;
+
+  if (_state == S_ERROR) return INFLATE_ERROR;
+  if (!flush()) return fail("Output write failed");
+  return _state == S_DONE ? INFLATE_DONE : INFLATE_NEED_INPUT;
+}
@@ -0,0 +1,178 @@
+/**
+ * @file GitFirmwareInflate.h
+ * @brief Streaming gzip / zlib / raw deflate decompressor for GitFirmwareUpdate
+ *
+ * Push-style inflater: feed() accepts compressed bytes in arbitrary
+ * chunk sizes (as they come off the socket) and emits decompressed data
+ * through an output callback. The only large buffer is the sliding
+ * window (32 KB by default), so the whole image is never held in RAM.
+ *
+ * Decoder state survives between feed() calls at any bit position, which
+ * lets the caller stop after any network read (non-blocking use).
+ *
+ * Plain C++ only (no Arduino types) so it compiles and is testable on the host.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Sliding window size (power of two). Must be >= the compressor's window;
+// gzip / zlib default to 32 KB. Smaller values only work for images
+// compressed with a matching window (e.g. zlib wbits < 15).
+#ifndef GIT_FIRMWARE_INFLATE_WINDOW
+  #define GIT_FIRMWARE_INFLATE_WINDOW 32768
+#endif
+
+/**
+ * @class GitFirmwareInflater
+ * @brief Incremental RFC 1951 inflater with RFC 1952 (gzip) / RFC 1950 (zlib) framing
+ */
+class GitFirmwareInflater {
+public:
+  /**
+   * @enum Format
+   * @brief Container format of the compressed stream
+   */
+  enum Format {
+    FORMAT_AUTO = 0,           ///< Detect gzip / zlib from the first bytes, else raw deflate
+    FORMAT_GZIP,               ///< gzip member (header, deflate, CRC32 + ISIZE)
+    FORMAT_ZLIB,               ///< zlib (header, deflate, Adler-32)
+    FORMAT_RAW                 ///< Raw deflate without framing
+  };
+
+  /**
+   * @enum Status
+   * @brief Result of feed()
+   */
+  enum Status {
+    INFLATE_NEED_INPUT = 0,    ///< All input consumed, stream not finished yet
+    INFLATE_DONE,              ///< End of stream reached and trailer verified
+    INFLATE_ERROR              ///< Corrupt data, checksum mismatch or output failure
+  };
+
+  /**
+   * @typedef OutputFn
+   * @brief Receives decompressed data
+   * @return true to continue, false to stop with INFLATE_ERROR
+   */
+  typedef bool (*OutputFn)(void* ctx, const uint8_t* data, size_t len);
+
+  GitFirmwareInflater();
+  ~GitFirmwareInflater();
+
+  /**
+   * @brief Reset state and allocate the window (if not already allocated)
+   *
+   * @param format Container format
+   * @param output Output callback
+   * @param ctx Context passed to output
+   * @param window Optional caller-provided window of GIT_FIRMWARE_INFLATE_WINDOW
+   *               bytes (nullptr = allocate from heap)
+   * @return false if the window could not be allocated
+   */
+  bool begin(Format format, OutputFn output, void* ctx, uint8_t* window = nullptr);
+
+  /**
+   * @brief Decompress a chunk of input
+   *
+   * Consumes all of data unless the stream ends or an error occurs.
+   * Output produced by this call is flushed before returning.
+   */
+  Status feed(const uint8_t* data, size_t len);
+
+  /**
+   * @brief Release the window (if heap-allocated)
+   */
+  void end();
+
+  /**
+   * @brief Total decompressed bytes emitted
+   */
+  size_t totalOut() const { return _totalOut; }
+
+  /**
+   * @brief Human-readable reason for INFLATE_ERROR (static string)
+   */
+  const char* errorString() const { return _error ? _error : ""; }
+
+  /**
+   * @brief Parse a format name ("gzip", "zlib", "deflate", "none")
+   *
+   * @param name Format name from latest.json or Content-Encoding (case-insensitive)
+   * @param format Output format
+   * @return true if name denotes a compressed format
+   */
+  static bool formatFromName(const char* name, Format& format);
+
+private:
+  struct Huffman {
+    uint16_t count[16];        ///< Number of codes of each length
+    uint16_t* symbol;          ///< Symbols ordered by code
+  };
+
+  enum State {
+    S_DETECT, S_GZIP_HEADER, S_ZLIB_HEADER, S_BLOCK_HEADER,
+    S_STORED_LEN, S_STORED_COPY, S_TABLE_COUNTS, S_TABLE_CLEN,
+    S_TABLE_LENS, S_TABLE_REPEAT, S_CODES, S_LEN_EXTRA, S_DIST,
+    S_DIST_EXTRA, S_COPY, S_TRAILER, S_DONE, S_ERROR
+  };
+
+  static const size_t WINDOW = GIT_FIRMWARE_INFLATE_WINDOW;
+
+  // Input cursor (valid during feed())
+  const uint8_t* _in;
+  const uint8_t* _inEnd;
+  uint32_t _bitBuf;
+  uint8_t _bitCount;
+
+  State _state;
+  Format _format;
+  bool _lastBlock;
+  uint8_t _gzipStep;           ///< Sub-step inside the gzip header
+  uint8_t _gzipFlags;
+  uint32_t _skip;              ///< Header bytes still to skip
+
+  // Dynamic table construction
+  uint16_t _nlen, _ndist, _ncode, _index;
+  uint16_t _pendingSym;
+  uint8_t _lengths[320];       ///< Code lengths (literal/length + distance)
+
+  // Current block codes (also used for the code length code)
+  uint16_t _lenSymbol[288];
+  uint16_t _distSymbol[30];
+  Huffman _lenCode;
+  Huffman _distCode;
+
+  // Match in progress
+  uint32_t _copyLen;
+  uint32_t _copyDist;
+  uint32_t _storedLen;
+
+  // Output window
+  uint8_t* _window;
+  bool _ownsWindow;
+  size_t _pos;                 ///< Next write position in window
+  size_t _flushPos;            ///< Start of not-yet-emitted output
+  size_t _totalOut;
+  OutputFn _output;
+  void* _outputCtx;
+
+  // Integrity
+  uint32_t _crc;               ///< CRC32 (gzip) of output
+  uint32_t _adlerA, _adlerB;   ///< Adler-32 (zlib) of output
+
+  const char* _error;
+
+  bool need(uint8_t n);
+  uint32_t bits(uint8_t n);
+  int decode(const Huffman& h);
+  static int build(Huffman& h, const uint8_t* lengths, uint16_t n);
+  void buildFixed();
+  bool putByte(uint8_t b);
+  bool flush();
+  Status fail(const char* reason);
+  void checksum(const uint8_t* data, size_t len);
+  bool step();
+};
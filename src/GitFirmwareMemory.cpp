@@ -0,0 +1,73 @@
+/**
+ * @file GitFirmwareMemory.cpp
+ * @brief ESP32 (heap_caps / FreeRTOS) and host (glibc / pthread) memory measurements
+ */
+
+#include "GitFirmwareMemory.h"
+
+#include <string.h>
+
+GitFirmwareMemory::Probe GitFirmwareMemory::_probe = nullptr;
+
+void GitFirmwareMemory::sample(GitFirmwareMemorySample& out) {
+  Probe probe = _probe;
+  if (probe) {
+    probe(out);
+  } else {
+    defaultProbe(out);
+  }
+}
+
+void GitFirmwareMemory::setProbe(Probe probe) {
+  _probe = probe;
+}
+
+#if defined(ARDUINO)
+
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+void GitFirmwareMemory::defaultProbe(GitFirmwareMemorySample& out) {
+  out.freeHeap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  out.largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  // ESP-IDF counts stack in bytes (StackType_t is uint8_t)
+  out.stackFree = uxTaskGetStackHighWaterMark(nullptr);
+}
+
+#else  // Host (glibc / pthread)
+
+#include <pthread.h>
+#if defined(__GLIBC__)
+  #include <malloc.h>
+#endif
+
+void GitFirmwareMemory::defaultProbe(GitFirmwareMemorySample& out) {
+  memset(&out, 0, sizeof(out));
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  struct mallinfo2 info = mallinfo2();
+  out.freeHeap = (uint32_t)info.fordblks;
+  // glibc does not report its largest free chunk; largestBlock stays 0
+#endif
+
+#if defined(__GLIBC__)
+  // Deepest stack pointer seen by a sample on this thread, against the thread's stack bounds
+  static thread_local uintptr_t lowest = 0;
+  char marker;
+  uintptr_t sp = (uintptr_t)&marker;
+  if (lowest == 0 || sp < lowest) {
+    lowest = sp;
+  }
+  pthread_attr_t attr;
+  if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+    void* base = nullptr;
+    size_t size = 0;
+    if (pthread_attr_getstack(&attr, &base, &size) == 0 && lowest > (uintptr_t)base) {
+      out.stackFree = (uint32_t)(lowest - (uintptr_t)base);  // Stack grows down from base + size
+    }
+    pthread_attr_destroy(&attr);
+  }
+#endif
+}
+
+#endif
@@ -0,0 +1,51 @@
+/**
+ * @file GitFirmwareMemory.h
+ * @brief Heap and stack measurements taken around the update phases
+ *
+ * On ESP32 the values come from heap_caps (8-bit capable heap) and the
+ * FreeRTOS stack high-water mark of the calling task. On the host, glibc
+ * mallinfo2() and the thread's stack bounds stand in for them; setProbe()
+ * replaces the source (e.g. with counters of an instrumented allocator).
+ * Plain C++ types only (usable on the host).
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @struct GitFirmwareMemorySample
+ * @brief One measurement (bytes)
+ */
+struct GitFirmwareMemorySample {
+  uint32_t freeHeap;       ///< Free heap (host: free bytes held by malloc)
+  uint32_t largestBlock;   ///< Largest allocatable block (host: 0 = not measurable)
+  uint32_t stackFree;      ///< Least free stack of the calling task so far (host: over the samples taken)
+};
+
+/**
+ * @class GitFirmwareMemory
+ * @brief Takes GitFirmwareMemorySample measurements
+ */
+class GitFirmwareMemory {
+public:
+  typedef void (*Probe)(GitFirmwareMemorySample& sample);
+
+  /**
+   * @brief Measure now, with the installed probe or the platform default
+   */
+  static void sample(GitFirmwareMemorySample& out);
+
+  /**
+   * @brief Replace the measurement source (nullptr = platform default)
+   */
+  static void setProbe(Probe probe);
+
+  /**
+   * @brief Platform default measurement
+   */
+  static void defaultProbe(GitFirmwareMemorySample& out);
+
+private:
+  static Probe _probe;
+};
@@ -0,0 +1,124 @@
+/**
+ * @file GitFirmwareMirrors.cpp
+ * @brief Implementation of GitFirmwareMirrors
+ */
+
+#include "GitFirmwareMirrors.h"
+#include "GitFirmwareCrc32.h"
+#include <string.h>
+
+GitFirmwareMirrors::GitFirmwareMirrors()
+  : _count(0) {
+  memset(_stats, 0, sizeof(_stats));
+}
+
+void GitFirmwareMirrors::assign(const char* const* urls, uint8_t count) {
+  if (count > MAX) {
+    count = MAX;
+  }
+  Stats previous[MAX];
+  memcpy(previous, _stats, sizeof(previous));
+  uint8_t previousCount = _count;
+
+  memset(_stats, 0, sizeof(_stats));
+  for (uint8_t i = 0; i < count; i++) {
+    uint32_t key = gitFirmwareCrc32(0, reinterpret_cast<const uint8_t*>(urls[i]), strlen(urls[i]));
+    for (uint8_t j = 0; j < previousCount; j++) {
+      if (previous[j].key == key) {
+        _stats[i] = previous[j];
+        break;
+      }
+    }
+    _stats[i].key = key;
+  }
+  _count = count;
+}
+
+// Same smoothing as the progress rate: about four samples
+static uint32_t smooth(uint32_t average, uint32_t sample) {
+  return average == 0 ? sample : (uint32_t)(((uint64_t)average * 3 + sample) / 4);
+}
+
+void GitFirmwareMirrors::recordLatency(uint8_t index, uint32_t ms) {
+  if (index < _count) {
+    _stats[index].latencyMs = smooth(_stats[index].latencyMs, ms > 0 ? ms : 1);
+  }
+}
+
+void GitFirmwareMirrors::recordThroughput(uint8_t index, size_t bytes, uint32_t ms) {
+  if (index < _count && ms > 0) {
+    uint32_t rate = (uint32_t)((uint64_t)bytes * 1000 / ms);
+    _stats[index].bytesPerSecond = smooth(_stats[index].bytesPerSecond, rate > 0 ? rate : 1);
+  }
+}
+
+void GitFirmwareMirrors::recordSuccess(uint8_t index) {
+  if (index < _count) {
+    Stats& stats = _stats[index];
+    if (stats.successes < UINT16_MAX) {
+      stats.successes++;
+    }
+    stats.failStreak = 0;
+  }
+}
+
+void GitFirmwareMirrors::recordFailure(uint8_t index, uint32_t nowMs) {
+  if (index < _count) {
+    Stats& stats = _stats[index];
+    if (stats.failures < UINT16_MAX) {
+      stats.failures++;
+    }
+    if (stats.failStreak < UINT8_MAX) {
+      stats.failStreak++;
+    }
+    stats.failedAtMs = nowMs;
+  }
+}
+
+bool GitFirmwareMirrors::healthy(uint8_t index, uint32_t nowMs) const {
+  const Stats& stats = _stats[index];
+  if (stats.failStreak == 0) {
+    return true;
+  }
+  uint8_t shift = stats.failStreak - 1 < 4 ? stats.failStreak - 1 : 4;
+  return nowMs - stats.failedAtMs >= (BACKOFF_MS << shift);
+}
+
+uint32_t GitFirmwareMirrors::score(const Stats& stats) {
+  return (uint32_t)((uint64_t)stats.bytesPerSecond * (stats.successes + 1) /
+                    ((uint32_t)stats.successes + stats.failures + 1));
+}
+
+bool GitFirmwareMirrors::better(uint8_t a, uint8_t b) const {
+  const Stats& sa = _stats[a];
+  const Stats& sb = _stats[b];
+  if ((sa.bytesPerSecond > 0) != (sb.bytesPerSecond > 0)) {
+    return sa.bytesPerSecond > 0;  // Measured before unmeasured
+  }
+  if (sa.bytesPerSecond > 0) {
+    return score(sa) > score(sb);
+  }
+  if (sa.latencyMs > 0 && sb.latencyMs > 0) {
+    return sa.latencyMs < sb.latencyMs;
+  }
+  return false;  // List order
+}
+
+uint8_t GitFirmwareMirrors::pick(uint32_t nowMs, uint8_t excludeMask) const {
+  uint8_t best = NONE;
+  uint8_t oldestFailure = NONE;
+  for (uint8_t i = 0; i < _count; i++) {
+    if (excludeMask & (1u << i)) {
+      continue;
+    }
+    if (healthy(i, nowMs)) {
+      if (best == NONE || better(i, best)) {
+        best = i;
+      }
+    } else if (oldestFailure == NONE ||
+               nowMs - _stats[i].failedAtMs > nowMs - _stats[oldestFailure].failedAtMs) {
+      oldestFailure = i;
+    }
+  }
+  return best != NONE ? best : oldestFailure;
+}
@@ -0,0 +1,103 @@
+/**
+ * @file GitFirmwareMirrors.h
+ * @brief Per-mirror latency, throughput and error statistics, and mirror selection
+ *
+ * A mirror list holds several URLs of the same file (latest.json or the
+ * image). Statistics are keyed by the CRC32 of the URL, so they survive a
+ * new latest.json with the same mirrors. pick() returns the healthy mirror
+ * with the best throughput, weighted by its success ratio; mirrors without
+ * a throughput measurement rank behind measured ones, by latency, then in
+ * list order. A failed mirror is skipped for a backoff that doubles with
+ * every consecutive failure.
+ *
+ * Times are passed in (millis()), so it runs unchanged on the host.
+ * Plain C++ only (usable on the host).
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// URLs per mirror list, including the primary one (at most 8)
+#ifndef GIT_FIRMWARE_MAX_MIRRORS
+  #define GIT_FIRMWARE_MAX_MIRRORS 4
+#endif
+
+/**
+ * @class GitFirmwareMirrors
+ * @brief Statistics and selection for one mirror list
+ */
+class GitFirmwareMirrors {
+public:
+  static const uint8_t MAX = GIT_FIRMWARE_MAX_MIRRORS;
+  /// pick() result when every mirror is excluded
+  static const uint8_t NONE = 0xFF;
+  /// Skip time after the first failure; doubles per further consecutive failure (up to 16x)
+  static const uint32_t BACKOFF_MS = 30000;
+
+  static_assert(MAX >= 1 && MAX <= 8, "GIT_FIRMWARE_MAX_MIRRORS must be 1..8 (exclusion mask is 8 bits)");
+
+  /**
+   * @struct Stats
+   * @brief Everything known about one mirror
+   */
+  struct Stats {
+    uint32_t key;            ///< CRC32 of the URL
+    uint32_t bytesPerSecond; ///< Smoothed throughput, 0 = not measured
+    uint32_t latencyMs;      ///< Smoothed time until the response headers, 0 = not measured
+    uint16_t successes;
+    uint16_t failures;
+    uint8_t failStreak;      ///< Consecutive failures
+    uint32_t failedAtMs;     ///< millis() of the last failure
+  };
+
+  GitFirmwareMirrors();
+
+  /**
+   * @brief Set the URLs of the list (at most MAX are used)
+   *
+   * Statistics of URLs that were in the previous list are kept, in the new order.
+   */
+  void assign(const char* const* urls, uint8_t count);
+
+  uint8_t count() const { return _count; }
+
+  /**
+   * @brief Statistics of mirror index (index < count())
+   */
+  const Stats& stats(uint8_t index) const { return _stats[index]; }
+
+  void recordLatency(uint8_t index, uint32_t ms);
+
+  /**
+   * @brief Add a throughput sample (ignored when ms is 0)
+   */
+  void recordThroughput(uint8_t index, size_t bytes, uint32_t ms);
+
+  void recordSuccess(uint8_t index);
+  void recordFailure(uint8_t index, uint32_t nowMs);
+
+  /**
+   * @brief True if the mirror has not failed recently (backoff over)
+   */
+  bool healthy(uint8_t index, uint32_t nowMs) const;
+
+  /**
+   * @brief Best mirror not in excludeMask (bit i = index i)
+   *
+   * Healthy mirrors first; if none is, the one whose last failure is oldest.
+   *
+   * @return index, or NONE if all are excluded
+   */
+  uint8_t pick(uint32_t nowMs, uint8_t excludeMask = 0) const;
+
+private:
+  Stats _stats[MAX];
+  uint8_t _count;
+
+  /// Throughput weighted by (successes + 1) / (successes + failures + 1)
+  static uint32_t score(const Stats& stats);
+  /// True if a ranks before b (both healthy or both unhealthy)
+  bool better(uint8_t a, uint8_t b) const;
+};
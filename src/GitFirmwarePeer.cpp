@@ -0,0 +1,458 @@
+/**
+ * @file GitFirmwarePeer.cpp
+ * @brief Implementation of GitFirmwarePeerServer and GitFirmwarePeerFinder
+ */
+
+#include "GitFirmwarePeer.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#if defined(ARDUINO)
+  #include <Arduino.h>
+  #include <esp_ota_ops.h>
+  #include <lwip/sockets.h>
+
+static uint32_t nowMs() {
+  return millis();
+}
+#else  // Host (POSIX sockets)
+  #include <arpa/inet.h>
+  #include <netinet/in.h>
+  #include <sys/select.h>
+  #include <sys/socket.h>
+  #include <time.h>
+
+static uint32_t nowMs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+#endif
+
+#ifndef MSG_NOSIGNAL
+  #define MSG_NOSIGNAL 0
+#endif
+
+static const size_t HEX_LEN = GitFirmwareSha256::DIGEST_SIZE * 2;
+
+// A peer that makes no progress (request or download) for this long is dropped
+static const uint32_t IDLE_TIMEOUT_MS = 5000;
+
+// Discovery queries sent within the finder's wait time (UDP may drop one)
+static const uint32_t QUERY_COUNT = 3;
+
+static void setNonBlocking(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+static bool wouldBlock() {
+  return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+static struct sockaddr_in ipv4Address(uint32_t address, uint16_t port) {
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = address;
+  return addr;
+}
+
+// Dotted IPv4 to network byte order
+static bool parseIPv4(const char* s, uint32_t& address) {
+  uint8_t octets[4];
+  for (int i = 0; i < 4; i++) {
+    char* end;
+    unsigned long v = strtoul(s, &end, 10);
+    if (end == s || v > 255 || *end != (i < 3 ? '.' : '\0')) {
+      return false;
+    }
+    octets[i] = (uint8_t)v;
+    s = end + 1;
+  }
+  memcpy(&address, octets, 4);
+  return true;
+}
+
+// Value of header name in a request head ("Name: value\r\n"), nullptr if absent
+static const char* findHeader(const char* head, const char* name) {
+  size_t nameLen = strlen(name);
+  for (const char* line = strstr(head, "\r\n"); line; line = strstr(line, "\r\n")) {
+    line += 2;
+    if (strncasecmp(line, name, nameLen) == 0 && line[nameLen] == ':') {
+      const char* value = line + nameLen + 1;
+      while (*value == ' ') {
+        value++;
+      }
+      return value;
+    }
+  }
+  return nullptr;
+}
+
+// ---------------------------------------------------------------------------
+// GitFirmwarePeerServer
+// ---------------------------------------------------------------------------
+
+GitFirmwarePeerServer::GitFirmwarePeerServer()
+  : _listen(-1),
+    _udp(-1),
+    _client(-1),
+    _httpPort(0),
+    _hex{0},
+    _size(0),
+    _read(nullptr),
+    _readCtx(nullptr),
+    _request{0},
+    _requestLen(0),
+    _activeMs(0),
+    _sending(false),
+    _offset(0),
+    _end(0),
+    _bufPos(0),
+    _bufLen(0),
+    _bytesServed(0),
+    _downloadsServed(0) {
+}
+
+GitFirmwarePeerServer::~GitFirmwarePeerServer() {
+  end();
+}
+
+void GitFirmwarePeerServer::setImage(const uint8_t digest[GitFirmwareSha256::DIGEST_SIZE], uint32_t size,
+                                     ReadFn read, void* ctx) {
+  closeClient();  // A running download would continue with other bytes
+  for (size_t i = 0; i < GitFirmwareSha256::DIGEST_SIZE; i++) {
+    snprintf(_hex + i * 2, 3, "%02x", digest[i]);
+  }
+  _size = size;
+  _read = read;
+  _readCtx = ctx;
+}
+
+#if defined(ARDUINO)
+bool GitFirmwarePeerServer::partitionRead(void* ctx, uint32_t offset, uint8_t* buf, size_t len) {
+  return esp_partition_read(static_cast<const esp_partition_t*>(ctx), offset, buf, len) == ESP_OK;
+}
+
+bool GitFirmwarePeerServer::setPartitionImage(const esp_partition_t* partition, uint32_t size) {
+  closeClient();  // _buf is free for hashing
+  _hex[0] = '\0';
+  if (!partition || size == 0 || size > partition->size) {
+    return false;
+  }
+  GitFirmwareSha256 hash;
+  hash.begin();
+  for (uint32_t offset = 0; offset < size;) {
+    size_t n = size - offset < sizeof(_buf) ? size - offset : sizeof(_buf);
+    if (!partitionRead((void*)partition, offset, _buf, n)) {
+      return false;
+    }
+    hash.update(_buf, n);
+    offset += n;
+  }
+  uint8_t digest[GitFirmwareSha256::DIGEST_SIZE];
+  hash.finish(digest);
+  setImage(digest, size, partitionRead, (void*)partition);
+  return true;
+}
+
+bool GitFirmwarePeerServer::setRunningImage() {
+  return setPartitionImage(esp_ota_get_running_partition(), ESP.getSketchSize());
+}
+#endif
+
+bool GitFirmwarePeerServer::begin(uint16_t httpPort, uint16_t discoveryPort) {
+  end();
+  _httpPort = httpPort;
+  _listen = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  _udp = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (_listen < 0 || _udp < 0) {
+    end();
+    return false;
+  }
+  int one = 1;
+  setsockopt(_listen, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  setsockopt(_udp, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in tcpAddr = ipv4Address(htonl(INADDR_ANY), httpPort);
+  struct sockaddr_in udpAddr = ipv4Address(htonl(INADDR_ANY), discoveryPort);
+  if (bind(_listen, (struct sockaddr*)&tcpAddr, sizeof(tcpAddr)) != 0 || listen(_listen, 2) != 0 ||
+      bind(_udp, (struct sockaddr*)&udpAddr, sizeof(udpAddr)) != 0) {
+    end();
+    return false;
+  }
+  setNonBlocking(_listen);
+  setNonBlocking(_udp);
+  return true;
+}
+
+void GitFirmwarePeerServer::end() {
+  closeClient();
+  if (_listen >= 0) {
+    close(_listen);
+    _listen = -1;
+  }
+  if (_udp >= 0) {
+    close(_udp);
+    _udp = -1;
+  }
+}
+
+void GitFirmwarePeerServer::handle() {
+  if (_udp >= 0) {
+    answerQueries();
+  }
+  if (_client < 0 && _listen >= 0) {
+    acceptClient();
+  }
+  if (_client >= 0 && !_sending) {
+    readRequest();
+  }
+  if (_client >= 0 && _sending) {
+    sendResponse();
+  }
+  if (_client >= 0 && nowMs() - _activeMs >= IDLE_TIMEOUT_MS) {
+    closeClient();
+  }
+}
+
+void GitFirmwarePeerServer::answerQueries() {
+  char query[96];
+  for (;;) {
+    struct sockaddr_in from;
+    socklen_t fromLen = sizeof(from);
+    int n = recvfrom(_udp, query, sizeof(query) - 1, 0, (struct sockaddr*)&from, &fromLen);
+    if (n <= 0) {
+      return;
+    }
+    query[n] = '\0';
+    if (_hex[0] == '\0' || (size_t)n < 5 + HEX_LEN || strncmp(query, "GFWP?", 5) != 0 ||
+        strncasecmp(query + 5, _hex, HEX_LEN) != 0) {
+      continue;  // Another image (or not a query)
+    }
+    char answer[96];
+    int len = snprintf(answer, sizeof(answer), "GFWP!%s %u", _hex, (unsigned)_httpPort);
+    sendto(_udp, answer, len, 0, (struct sockaddr*)&from, fromLen);
+  }
+}
+
+void GitFirmwarePeerServer::acceptClient() {
+  int fd = accept(_listen, nullptr, nullptr);
+  if (fd < 0) {
+    return;
+  }
+  setNonBlocking(fd);
+  _client = fd;
+  _requestLen = 0;
+  _request[0] = '\0';
+  _sending = false;
+  _activeMs = nowMs();
+}
+
+void GitFirmwarePeerServer::readRequest() {
+  while (_requestLen < sizeof(_request) - 1) {
+    int n = recv(_client, _request + _requestLen, sizeof(_request) - 1 - _requestLen, 0);
+    if (n < 0 && wouldBlock()) {
+      return;
+    }
+    if (n <= 0) {
+      closeClient();
+      return;
+    }
+    _requestLen += n;
+    _request[_requestLen] = '\0';
+    _activeMs = nowMs();
+    if (strstr(_request, "\r\n\r\n")) {
+      startResponse();
+      return;
+    }
+  }
+  closeClient();  // Request head too long
+}
+
+void GitFirmwarePeerServer::startResponse() {
+  // "GET /gitfw/<sha256 hex>.bin HTTP/1.1"
+  const char* status = "200 OK";
+  uint32_t start = 0;
+  uint32_t end = _size;
+  if (strncmp(_request, "GET /gitfw/", 11) != 0) {
+    status = "400 Bad Request";
+  } else if (_hex[0] == '\0' || strncasecmp(_request + 11, _hex, HEX_LEN) != 0 ||
+             strncmp(_request + 11 + HEX_LEN, ".bin ", 5) != 0) {
+    status = "404 Not Found";
+  } else {
+    // "Range: bytes=first-" or "bytes=first-last"; If-Range always matches (the URL names the content)
+    const char* range = findHeader(_request, "Range");
+    if (range) {
+      char* next;
+      unsigned long first = strncmp(range, "bytes=", 6) == 0 ? strtoul(range + 6, &next, 10) : 0;
+      if (strncmp(range, "bytes=", 6) != 0 || next == range + 6 || *next != '-' || first >= _size) {
+        status = "416 Range Not Satisfiable";
+      } else {
+        unsigned long last = next[1] >= '0' && next[1] <= '9' ? strtoul(next + 1, nullptr, 10) : _size - 1;
+        if (last < first) {
+          status = "416 Range Not Satisfiable";
+        } else {
+          status = "206 Partial Content";
+          start = first;
+          end = last + 1 < _size ? last + 1 : _size;
+        }
+      }
+    }
+  }
+
+  char* head = reinterpret_cast<char*>(_buf);
+  int len;
+  if (status[0] == '2') {
+    len = snprintf(head, sizeof(_buf),
+                   "HTTP/1.1 %s\r\nContent-Type: application/octet-stream\r\nContent-Length: %u\r\n"
+                   "Accept-Ranges: bytes\r\nETag: \"%s\"\r\n",
+                   status, (unsigned)(end - start), _hex);
+    if (status[2] == '6') {
+      len += snprintf(head + len, sizeof(_buf) - len, "Content-Range: bytes %u-%u/%u\r\n",
+                      (unsigned)start, (unsigned)(end - 1), (unsigned)_size);
+    }
+    _offset = start;
+    _end = end;
+  } else {
+    len = snprintf(head, sizeof(_buf), "HTTP/1.1 %s\r\nContent-Length: 0\r\n", status);
+    if (status[0] == '4' && status[2] == '6') {
+      len += snprintf(head + len, sizeof(_buf) - len, "Content-Range: bytes */%u\r\n", (unsigned)_size);
+    }
+    _offset = 0;
+    _end = 0;
+  }
+  len += snprintf(head + len, sizeof(_buf) - len, "Connection: close\r\n\r\n");
+  _bufPos = 0;
+  _bufLen = len;
+  _sending = true;
+}
+
+void GitFirmwarePeerServer::sendResponse() {
+  size_t sent = 0;
+  while (sent < SLICE_BYTES) {
+    if (_bufPos == _bufLen) {
+      if (_offset >= _end) {
+        if (_end > 0) {
+          _downloadsServed++;
+        }
+        closeClient();
+        return;
+      }
+      size_t n = _end - _offset < sizeof(_buf) ? _end - _offset : sizeof(_buf);
+      if (!_read(_readCtx, _offset, _buf, n)) {
+        closeClient();  // The peer sees a short body and falls back
+        return;
+      }
+      _offset += n;
+      _bytesServed += n;
+      _bufPos = 0;
+      _bufLen = n;
+    }
+    int n = send(_client, _buf + _bufPos, _bufLen - _bufPos, MSG_NOSIGNAL);
+    if (n < 0 && wouldBlock()) {
+      return;  // Socket buffer full, continue on the next call
+    }
+    if (n <= 0) {
+      closeClient();
+      return;
+    }
+    _bufPos += n;
+    sent += n;
+    _activeMs = nowMs();
+  }
+}
+
+void GitFirmwarePeerServer::closeClient() {
+  if (_client >= 0) {
+    close(_client);
+    _client = -1;
+  }
+  _sending = false;
+}
+
+// ---------------------------------------------------------------------------
+// GitFirmwarePeerFinder
+// ---------------------------------------------------------------------------
+
+GitFirmwarePeerFinder::GitFirmwarePeerFinder(uint16_t discoveryPort, uint32_t waitMs)
+  : _port(discoveryPort),
+    _waitMs(waitMs),
+    _address("255.255.255.255") {
+}
+
+bool GitFirmwarePeerFinder::find(const char* sha256, char* url, size_t size) {
+  uint32_t target;
+  if (!sha256 || strlen(sha256) != HEX_LEN || !parseIPv4(_address, target)) {
+    return false;
+  }
+  int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (fd < 0) {
+    return false;
+  }
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &one, sizeof(one));
+  struct sockaddr_in to = ipv4Address(target, _port);
+  char query[96];
+  int queryLen = snprintf(query, sizeof(query), "GFWP?%s", sha256);
+
+  bool found = false;
+  uint32_t start = nowMs();
+  uint32_t queries = 0;
+  while (!found) {
+    uint32_t elapsed = nowMs() - start;
+    if (elapsed >= _waitMs) {
+      break;
+    }
+    // Query at 0, 1/3 and 2/3 of the wait time
+    if (queries < QUERY_COUNT && elapsed >= queries * _waitMs / QUERY_COUNT) {
+      sendto(fd, query, queryLen, 0, (struct sockaddr*)&to, sizeof(to));
+      queries++;
+    }
+    // Until the next query or the end; 0 when elapsed is already past it (a late loop)
+    uint32_t deadline = queries < QUERY_COUNT ? queries * _waitMs / QUERY_COUNT : _waitMs;
+    if (deadline > _waitMs) {
+      deadline = _waitMs;
+    }
+    uint32_t waitMs = elapsed < deadline ? deadline - elapsed : 0;
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(fd, &readSet);
+    struct timeval tv;
+    tv.tv_sec = waitMs / 1000;
+    tv.tv_usec = (waitMs % 1000) * 1000;
+    if (select(fd + 1, &readSet, nullptr, nullptr, &tv) <= 0) {
+      continue;
+    }
+
+    char answer[96];
+    struct sockaddr_in from;
+    socklen_t fromLen = sizeof(from);
+    int n = recvfrom(fd, answer, sizeof(answer) - 1, 0, (struct sockaddr*)&from, &fromLen);
+    if (n < (int)(5 + HEX_LEN + 2)) {
+      continue;
+    }
+    answer[n] = '\0';
+    // "GFWP!<sha256 hex> <port>"
+    if (strncmp(answer, "GFWP!", 5) != 0 || strncasecmp(answer + 5, sha256, HEX_LEN) != 0 ||
+        answer[5 + HEX_LEN] != ' ') {
+      continue;
+    }
+    unsigned long port = strtoul(answer + 5 + HEX_LEN + 1, nullptr, 10);
+    if (port == 0 || port > 65535) {
+      continue;
+    }
+    const uint8_t* ip = reinterpret_cast<const uint8_t*>(&from.sin_addr.s_addr);
+    int len = snprintf(url, size, "http://%u.%u.%u.%u:%u/gitfw/%s.bin",
+                       ip[0], ip[1], ip[2], ip[3], (unsigned)port, sha256);
+    found = len > 0 && (size_t)len < size;
+    break;  // First answer wins
+  }
+  close(fd);
+  return found;
+}
@@ -0,0 +1,187 @@
+/**
+ * @file GitFirmwarePeer.h
+ * @brief LAN peer cache: serve the firmware image to other devices, find a device that has it
+ *
+ * A device running GitFirmwarePeerServer answers discovery queries for the
+ * image it holds (usually its own running image) and serves it over plain
+ * HTTP/1.1 with Range support. GitFirmwarePeerFinder broadcasts a query
+ * for the image named by latest.json and returns the URL of the first peer
+ * that answers. GitFirmwareUpdate (GIT_FIRMWARE_USE_PEERS, setPeerFinder())
+ * downloads from there and falls back to the latest.json URL when the peer
+ * fails. Images are addressed by their SHA-256 and verified against
+ * latest.json, so a peer cannot substitute another image.
+ *
+ * Protocol:
+ *   query  (UDP broadcast to the discovery port): "GFWP?<sha256 hex>"
+ *   answer (UDP to the sender):                  "GFWP!<sha256 hex> <http port>"
+ *   image  GET /gitfw/<sha256 hex>.bin           (200 / 206, ETag is the hash)
+ *
+ * BSD sockets only (lwIP on ESP32, POSIX on the host), so server and finder
+ * also run on a Linux host; see extras/peer.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "GitFirmwareSha256.h"
+
+#if defined(ARDUINO)
+  #include <esp_partition.h>
+#endif
+
+// TCP port of the image endpoint
+#ifndef GIT_FIRMWARE_PEER_HTTP_PORT
+  #define GIT_FIRMWARE_PEER_HTTP_PORT 8288
+#endif
+
+// UDP port of the discovery queries
+#ifndef GIT_FIRMWARE_PEER_DISCOVERY_PORT
+  #define GIT_FIRMWARE_PEER_DISCOVERY_PORT 8289
+#endif
+
+/**
+ * @class GitFirmwarePeerServer
+ * @brief Serves one image to peers; driven by handle() from the main loop
+ *
+ * One download is served at a time, further peers wait in the listen
+ * backlog. handle() never blocks: it answers pending queries and sends at
+ * most about SLICE_BYTES of the current download per call.
+ */
+class GitFirmwarePeerServer {
+public:
+  /**
+   * @brief Image reader: copy len bytes at offset into buf
+   * @return false on a read error (the download is cut off)
+   */
+  typedef bool (*ReadFn)(void* ctx, uint32_t offset, uint8_t* buf, size_t len);
+
+  /// Bytes sent per handle() call at most
+  static const size_t SLICE_BYTES = 16384;
+
+  GitFirmwarePeerServer();
+  ~GitFirmwarePeerServer();
+
+  /**
+   * @brief Image to serve
+   *
+   * @param digest SHA-256 of the size bytes (as in latest.json "sha256")
+   * @param size Image size in bytes
+   * @param read Reader (ctx is passed through)
+   */
+  void setImage(const uint8_t digest[GitFirmwareSha256::DIGEST_SIZE], uint32_t size,
+                ReadFn read, void* ctx);
+
+#if defined(ARDUINO)
+  /**
+   * @brief Serve the first size bytes of a partition (hashed here, about 1 s per MB)
+   *
+   * @return false on a read error (nothing is served)
+   */
+  bool setPartitionImage(const esp_partition_t* partition, uint32_t size);
+
+  /**
+   * @brief Serve the running firmware (ESP.getSketchSize() bytes of the running partition)
+   *
+   * Right after an update this is the image other devices are looking for.
+   */
+  bool setRunningImage();
+#endif
+
+  /**
+   * @brief Open the HTTP and discovery sockets
+   *
+   * @return false if a socket cannot be opened or bound
+   */
+  bool begin(uint16_t httpPort = GIT_FIRMWARE_PEER_HTTP_PORT,
+             uint16_t discoveryPort = GIT_FIRMWARE_PEER_DISCOVERY_PORT);
+
+  /**
+   * @brief Answer queries and continue the current download (call often)
+   */
+  void handle();
+
+  /**
+   * @brief Close all sockets
+   */
+  void end();
+
+  /// Image bytes sent so far (including downloads that were cut off)
+  uint32_t getBytesServed() const { return _bytesServed; }
+
+  /// Downloads served to the end
+  uint32_t getDownloadsServed() const { return _downloadsServed; }
+
+private:
+  int _listen;
+  int _udp;
+  int _client;
+  uint16_t _httpPort;
+  char _hex[GitFirmwareSha256::DIGEST_SIZE * 2 + 1]; ///< Digest of the image, "" = none
+  uint32_t _size;
+  ReadFn _read;
+  void* _readCtx;
+
+  // Current download
+  char _request[512];
+  size_t _requestLen;
+  uint32_t _activeMs;          ///< millis() of the last progress of the current download
+  bool _sending;               ///< Request parsed, sending _buf and the body
+  uint32_t _offset;            ///< Next image byte
+  uint32_t _end;               ///< One past the last image byte
+  uint8_t _buf[1024];          ///< Headers, then image data
+  size_t _bufPos;
+  size_t _bufLen;
+
+  uint32_t _bytesServed;
+  uint32_t _downloadsServed;
+
+  void answerQueries();
+  void acceptClient();
+  void readRequest();
+  void sendResponse();
+  void startResponse();
+  void closeClient();
+#if defined(ARDUINO)
+  static bool partitionRead(void* ctx, uint32_t offset, uint8_t* buf, size_t len);
+#endif
+};
+
+/**
+ * @class GitFirmwarePeerFinder
+ * @brief Finds a peer serving an image by broadcasting a discovery query
+ */
+class GitFirmwarePeerFinder {
+public:
+  /**
+   * @param discoveryPort UDP port of the peer servers
+   * @param waitMs How long to wait for an answer
+   */
+  explicit GitFirmwarePeerFinder(uint16_t discoveryPort = GIT_FIRMWARE_PEER_DISCOVERY_PORT,
+                                 uint32_t waitMs = 300);
+
+  /**
+   * @brief Where the query is sent (dotted IPv4, default "255.255.255.255")
+   *
+   * A directed broadcast (e.g. "192.168.1.255") or a single peer also work.
+   * The string must outlive this object.
+   */
+  void setQueryAddress(const char* address) { _address = address; }
+
+  /**
+   * @brief Ask the LAN for the image with this SHA-256
+   *
+   * Queries are repeated a few times within the wait time (UDP loss).
+   *
+   * @param sha256 Image digest as hex (from latest.json)
+   * @param url Receives "http://<peer>:<port>/gitfw/<sha256>.bin"
+   * @param size Capacity of url
+   * @return true if a peer answered (url set)
+   */
+  bool find(const char* sha256, char* url, size_t size);
+
+private:
+  uint16_t _port;
+  uint32_t _waitMs;
+  const char* _address;
+};
@@ -0,0 +1,242 @@
+/**
+ * @file GitFirmwarePipeline.cpp
+ * @brief Implementation of GitFirmwarePipeline
+ */
+
+#include "GitFirmwarePipeline.h"
+#include <stdlib.h>
+
+#if defined(ARDUINO)
+  #include <freertos/FreeRTOS.h>
+  #include <freertos/task.h>
+  #include <freertos/queue.h>
+  #include <freertos/semphr.h>
+#else
+  #include <chrono>
+  #include <condition_variable>
+  #include <mutex>
+  #include <thread>
+#endif
+
+// Reader task stack: readBytes() + logging only, no large locals
+#ifndef GIT_FIRMWARE_PIPELINE_STACK
+  #define GIT_FIRMWARE_PIPELINE_STACK 4096
+#endif
+
+// Poll interval for stop/abort checks while waiting on a queue
+static const uint32_t PIPELINE_POLL_MS = 50;
+
+#if defined(ARDUINO)
+
+// FreeRTOS queue of slots (capacity == buffer count, so send never blocks)
+class GitFirmwarePipeline::SlotQueue {
+public:
+  explicit SlotQueue(uint8_t capacity) : _queue(xQueueCreate(capacity, sizeof(Slot))) {}
+  ~SlotQueue() { if (_queue) vQueueDelete(_queue); }
+  bool ok() const { return _queue != nullptr; }
+  void send(const Slot& slot) { xQueueSend(_queue, &slot, portMAX_DELAY); }
+  bool receive(Slot& slot, uint32_t timeoutMs) {
+    return xQueueReceive(_queue, &slot, pdMS_TO_TICKS(timeoutMs)) == pdTRUE;
+  }
+  uint8_t size() const { return (uint8_t)uxQueueMessagesWaiting(_queue); }
+private:
+  QueueHandle_t _queue;
+};
+
+#else
+
+// Host stand-in: bounded ring protected by a mutex/condition variable
+class GitFirmwarePipeline::SlotQueue {
+public:
+  explicit SlotQueue(uint8_t capacity) : _capacity(capacity), _head(0), _count(0) {}
+  bool ok() const { return true; }
+  void send(const Slot& slot) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _slots[(_head + _count) % _capacity] = slot;
+    _count++;
+    _cond.notify_one();
+  }
+  bool receive(Slot& slot, uint32_t timeoutMs) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (!_cond.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this] { return _count > 0; })) {
+      return false;
+    }
+    slot = _slots[_head];
+    _head = (uint8_t)((_head + 1) % _capacity);
+    _count--;
+    return true;
+  }
+  uint8_t size() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _count;
+  }
+private:
+  Slot _slots[MAX_BUFFERS];
+  uint8_t _capacity;
+  uint8_t _head;
+  uint8_t _count;
+  std::mutex _mutex;
+  std::condition_variable _cond;
+};
+
+#endif
+
+GitFirmwarePipeline::GitFirmwarePipeline(uint8_t bufferCount, size_t bufferSize, uint8_t* storage)
+  : _bufferCount(bufferCount < MIN_BUFFERS ? MIN_BUFFERS :
+                 (bufferCount > MAX_BUFFERS ? MAX_BUFFERS : bufferCount)),
+    _bufferSize(bufferSize),
+    _storage(nullptr),
+    _external(storage),
+    _freeSlots(nullptr),
+    _filledSlots(nullptr),
+    _stop(false),
+    _maxDepth(0),
+    _readFn(nullptr),
+    _readCtx(nullptr),
+    _abortFlag(nullptr),
+    _reader(nullptr),
+    _readerDone(nullptr) {
+}
+
+GitFirmwarePipeline::~GitFirmwarePipeline() {
+  release();
+}
+
+bool GitFirmwarePipeline::allocate() {
+  _storage = _external ? _external : (uint8_t*)malloc(_bufferCount * _bufferSize);
+  _freeSlots = new SlotQueue(_bufferCount);
+  _filledSlots = new SlotQueue(_bufferCount);
+#if defined(ARDUINO)
+  _readerDone = xSemaphoreCreateBinary();
+#endif
+  if (!_storage || !_freeSlots->ok() || !_filledSlots->ok()) {
+    return false;
+  }
+#if defined(ARDUINO)
+  if (!_readerDone) {
+    return false;
+  }
+#endif
+  for (uint8_t i = 0; i < _bufferCount; i++) {
+    Slot slot = { i, 0 };
+    _freeSlots->send(slot);
+  }
+  return true;
+}
+
+void GitFirmwarePipeline::release() {
+  delete _freeSlots;
+  delete _filledSlots;
+  _freeSlots = nullptr;
+  _filledSlots = nullptr;
+  if (_storage != _external) {
+    free(_storage);
+  }
+  _storage = nullptr;
+#if defined(ARDUINO)
+  if (_readerDone) {
+    vSemaphoreDelete((SemaphoreHandle_t)_readerDone);
+  }
+#endif
+  _readerDone = nullptr;
+}
+
+void GitFirmwarePipeline::readerLoop() {
+  for (;;) {
+    Slot slot;
+    if (!_freeSlots->receive(slot, PIPELINE_POLL_MS)) {
+      if (_stop) break;
+      continue;
+    }
+    if (_stop || (_abortFlag && *_abortFlag)) break;
+
+    int n = _readFn(_readCtx, _storage + slot.index * _bufferSize, _bufferSize);
+    slot.length = n;
+    _filledSlots->send(slot);
+    if (n <= 0) break;  // End of stream or read error, writer decides
+  }
+}
+
+void GitFirmwarePipeline::readerEntry(void* self) {
+  GitFirmwarePipeline* pipeline = static_cast<GitFirmwarePipeline*>(self);
+  pipeline->readerLoop();
+#if defined(ARDUINO)
+  xSemaphoreGive((SemaphoreHandle_t)pipeline->_readerDone);
+  vTaskDelete(NULL);
+#endif
+}
+
+bool GitFirmwarePipeline::startReader() {
+#if defined(ARDUINO)
+  // Same priority as the caller so neither side starves the other;
+  // no core affinity so single-core targets work too
+  TaskHandle_t handle = NULL;
+  BaseType_t ok = xTaskCreatePinnedToCore(readerEntry, "GitFwReader", GIT_FIRMWARE_PIPELINE_STACK,
+                                          this, uxTaskPriorityGet(NULL), &handle, tskNO_AFFINITY);
+  _reader = handle;
+  return ok == pdPASS;
+#else
+  _reader = new std::thread(readerEntry, this);
+  return true;
+#endif
+}
+
+void GitFirmwarePipeline::joinReader() {
+  if (!_reader) return;
+#if defined(ARDUINO)
+  xSemaphoreTake((SemaphoreHandle_t)_readerDone, portMAX_DELAY);
+#else
+  std::thread* thread = static_cast<std::thread*>(_reader);
+  thread->join();
+  delete thread;
+#endif
+  _reader = nullptr;
+}
+
+GitFirmwarePipeline::Result GitFirmwarePipeline::run(ReadFn readFn, void* readCtx,
+                                                     WriteFn writeFn, void* writeCtx,
+                                                     volatile bool* abortFlag) {
+  _readFn = readFn;
+  _readCtx = readCtx;
+  _abortFlag = abortFlag;
+  _stop = false;
+  _maxDepth = 0;
+
+  if (!allocate() || !startReader()) {
+    release();
+    return PIPELINE_SETUP_FAILED;
+  }
+
+  Result result = PIPELINE_OK;
+  for (;;) {
+    if (_abortFlag && *_abortFlag) {
+      result = PIPELINE_ABORTED;
+      break;
+    }
+
+    Slot slot;
+    if (!_filledSlots->receive(slot, PIPELINE_POLL_MS)) {
+      continue;
+    }
+
+    uint8_t depth = _filledSlots->size() + 1;
+    if (depth > _maxDepth) _maxDepth = depth;
+
+    if (slot.length == 0) break;
+    if (slot.length < 0) {
+      result = PIPELINE_READ_ERROR;
+      break;
+    }
+    if (!writeFn(writeCtx, _storage + slot.index * _bufferSize, (size_t)slot.length)) {
+      result = PIPELINE_WRITE_ERROR;
+      break;
+    }
+    _freeSlots->send(slot);
+  }
+
+  // Reader may still be inside readFn; it sees _stop on its next iteration
+  _stop = true;
+  joinReader();
+  release();
+  return result;
+}
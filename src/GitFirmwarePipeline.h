@@ -0,0 +1,130 @@
+/**
+ * @file GitFirmwarePipeline.h
+ * @brief Double-task download/flash pipeline for GitFirmwareUpdate
+ *
+ * Overlaps network reads with flash writes: a reader task drains the
+ * socket into a small ring of pre-allocated buffers while the calling
+ * task commits filled buffers to flash. Back-pressure is implicit: the
+ * reader blocks when every buffer is waiting to be written.
+ *
+ * On ESP32 the reader runs as a FreeRTOS task and buffers are handed over
+ * through FreeRTOS queues. On other platforms (Linux host builds) the same
+ * class uses std::thread. Both ends are ReadFn / WriteFn callbacks, so the
+ * pipeline runs on the host with any source and sink (see extras/bench).
+ *
+ * Plain C++ only (no Arduino types) so it compiles on the host.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @class GitFirmwarePipeline
+ * @brief Reader/writer pipeline over a fixed ring of buffers
+ */
+class GitFirmwarePipeline {
+public:
+  /**
+   * @typedef ReadFn
+   * @brief Producer callback, runs in the reader task
+   * @param ctx User context
+   * @param buf Buffer to fill
+   * @param capacity Buffer capacity in bytes
+   * @return bytes read (> 0), 0 at end of stream, negative on error
+   */
+  typedef int (*ReadFn)(void* ctx, uint8_t* buf, size_t capacity);
+
+  /**
+   * @typedef WriteFn
+   * @brief Consumer callback, runs in the calling task
+   * @param ctx User context
+   * @param buf Filled buffer
+   * @param len Number of valid bytes
+   * @return true on success, false to stop the pipeline
+   */
+  typedef bool (*WriteFn)(void* ctx, const uint8_t* buf, size_t len);
+
+  /**
+   * @enum Result
+   * @brief Outcome of run()
+   */
+  enum Result {
+    PIPELINE_OK = 0,           ///< Reader reached end of stream, all buffers written
+    PIPELINE_READ_ERROR,       ///< ReadFn returned an error
+    PIPELINE_WRITE_ERROR,      ///< WriteFn returned false
+    PIPELINE_ABORTED,          ///< Abort flag was raised
+    PIPELINE_SETUP_FAILED      ///< Buffers, queues or reader task could not be created
+  };
+
+  /**
+   * @brief Construct a pipeline (no allocation until run())
+   *
+   * @param bufferCount Number of ring buffers (2..8)
+   * @param bufferSize Size of each buffer in bytes
+   * @param storage Optional bufferCount * bufferSize bytes to use instead of
+   *                allocating the ring (must outlive the pipeline)
+   */
+  GitFirmwarePipeline(uint8_t bufferCount, size_t bufferSize, uint8_t* storage = nullptr);
+  ~GitFirmwarePipeline();
+
+  /**
+   * @brief Run the pipeline to completion
+   *
+   * Starts the reader task, writes filled buffers in the calling task and
+   * returns once the reader reports end of stream or an error/abort occurs.
+   * The reader task has always exited when this returns.
+   *
+   * @param readFn Producer callback (reader task)
+   * @param readCtx Context passed to readFn
+   * @param writeFn Consumer callback (calling task)
+   * @param writeCtx Context passed to writeFn
+   * @param abortFlag Optional flag polled by both sides (may be nullptr)
+   * @return Result code
+   */
+  Result run(ReadFn readFn, void* readCtx, WriteFn writeFn, void* writeCtx,
+             volatile bool* abortFlag);
+
+  /**
+   * @brief Largest number of buffers that were filled and waiting at once
+   *
+   * A value equal to the buffer count means the flash side was the
+   * bottleneck; a value of 1 means the network side was.
+   */
+  uint8_t getMaxQueueDepth() const { return _maxDepth; }
+
+  static const uint8_t MIN_BUFFERS = 2;
+  static const uint8_t MAX_BUFFERS = 8;
+
+private:
+  struct Slot {
+    uint8_t index;   ///< Buffer index in the ring
+    int32_t length;  ///< Bytes filled; <= 0 marks end of stream / error
+  };
+
+  class SlotQueue;
+
+  uint8_t _bufferCount;
+  size_t _bufferSize;
+  uint8_t* _storage;          ///< bufferCount * bufferSize bytes
+  uint8_t* _external;         ///< Caller-provided storage or nullptr
+  SlotQueue* _freeSlots;      ///< Empty buffers, reader -> fills them
+  SlotQueue* _filledSlots;    ///< Filled buffers, writer -> drains them
+  volatile bool _stop;        ///< Writer asks reader to stop early
+  uint8_t _maxDepth;
+
+  ReadFn _readFn;
+  void* _readCtx;
+  volatile bool* _abortFlag;
+
+  bool allocate();
+  void release();
+  void readerLoop();
+  bool startReader();
+  void joinReader();
+  static void readerEntry(void* self);
+
+  void* _reader;              ///< TaskHandle_t on ESP32, std::thread* on host
+  void* _readerDone;          ///< SemaphoreHandle_t on ESP32, unused on host
+};
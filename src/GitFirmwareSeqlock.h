@@ -0,0 +1,75 @@
+/**
+ * @file GitFirmwareSeqlock.h
+ * @brief Single-writer sequence lock for publishing small structs across tasks / cores
+ *
+ * The writer never blocks: it bumps a sequence counter to an odd value,
+ * copies the data and bumps it to the next even value. Readers copy the
+ * data and retry if the counter was odd or changed meanwhile, so they never
+ * see a half-written struct. Plain C++11 only (usable on the host).
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @class GitFirmwareSeqlock
+ * @brief Torn-read-free snapshot of a trivially copyable T
+ *
+ * Exactly one task may call write(); any number of tasks may call read().
+ */
+template <typename T>
+class GitFirmwareSeqlock {
+public:
+  GitFirmwareSeqlock() : _seq(0), _data() {}
+
+  /**
+   * @brief Publish a new value (writer task only, never blocks)
+   */
+  void write(const T& value) {
+    uint32_t seq = _seq.load(std::memory_order_relaxed);
+    _seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    copy(&_data, &value);
+    _seq.store(seq + 2, std::memory_order_release);
+  }
+
+  /**
+   * @brief Copy the last published value
+   *
+   * @param out Receives a consistent value (undefined if false is returned)
+   * @param attempts Copies to try while the writer is active
+   * @return false if every attempt overlapped a write. A reader on the
+   *         writer's core with a higher priority should then sleep briefly
+   *         so the writer can finish, instead of spinning.
+   */
+  bool read(T& out, uint8_t attempts = 4) const {
+    while (attempts-- > 0) {
+      uint32_t before = _seq.load(std::memory_order_acquire);
+      if (before & 1) {
+        continue;  // Write in progress
+      }
+      copy(&out, &_data);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (_seq.load(std::memory_order_relaxed) == before) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  std::atomic<uint32_t> _seq;  ///< Odd while a write is in progress
+  T _data;
+
+  // Byte copy through volatile: the compiler may not merge or reorder it across the fences
+  static void copy(volatile void* dst, const volatile void* src) {
+    volatile uint8_t* d = static_cast<volatile uint8_t*>(dst);
+    const volatile uint8_t* s = static_cast<const volatile uint8_t*>(src);
+    for (size_t i = 0; i < sizeof(T); i++) {
+      d[i] = s[i];
+    }
+  }
+};
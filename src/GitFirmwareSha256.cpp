@@ -0,0 +1,167 @@
+/**
+ * @file GitFirmwareSha256.cpp
+ * @brief Implementation of GitFirmwareSha256 (mbedtls on ESP32, portable on host)
+ */
+
+#include "GitFirmwareSha256.h"
+#include <string.h>
+
+bool GitFirmwareSha256::parseHex(const char* hex, uint8_t digest[DIGEST_SIZE]) {
+  if (!hex || strlen(hex) != DIGEST_SIZE * 2) {
+    return false;
+  }
+  for (size_t i = 0; i < DIGEST_SIZE * 2; i++) {
+    char c = hex[i];
+    uint8_t v;
+    if (c >= '0' && c <= '9') v = c - '0';
+    else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F') v = c - 'A' + 10;
+    else return false;
+    if (i & 1) digest[i / 2] |= v;
+    else digest[i / 2] = v << 4;
+  }
+  return true;
+}
+
+#if defined(ARDUINO)
+
+#include <mbedtls/version.h>
+
+// mbedtls 3.x (ESP32 Arduino core 3.x) renamed the *_ret functions
+#if MBEDTLS_VERSION_NUMBER >= 0x03000000
+  #define GIT_FIRMWARE_SHA256_STARTS mbedtls_sha256_starts
+  #define GIT_FIRMWARE_SHA256_UPDATE mbedtls_sha256_update
+  #define GIT_FIRMWARE_SHA256_FINISH mbedtls_sha256_finish
+#else
+  #define GIT_FIRMWARE_SHA256_STARTS mbedtls_sha256_starts_ret
+  #define GIT_FIRMWARE_SHA256_UPDATE mbedtls_sha256_update_ret
+  #define GIT_FIRMWARE_SHA256_FINISH mbedtls_sha256_finish_ret
+#endif
+
+GitFirmwareSha256::GitFirmwareSha256() {
+  mbedtls_sha256_init(&_ctx);
+}
+
+GitFirmwareSha256::~GitFirmwareSha256() {
+  mbedtls_sha256_free(&_ctx);
+}
+
+void GitFirmwareSha256::begin() {
+  GIT_FIRMWARE_SHA256_STARTS(&_ctx, 0);  // 0 = SHA-256 (not SHA-224)
+}
+
+void GitFirmwareSha256::update(const uint8_t* data, size_t len) {
+  GIT_FIRMWARE_SHA256_UPDATE(&_ctx, data, len);
+}
+
+void GitFirmwareSha256::finish(uint8_t digest[DIGEST_SIZE]) {
+  GIT_FIRMWARE_SHA256_FINISH(&_ctx, digest);
+}
+
+#else  // Host (portable)
+
+static const uint32_t K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t rotr(uint32_t x, int n) {
+  return (x >> n) | (x << (32 - n));
+}
+
+GitFirmwareSha256::GitFirmwareSha256() {
+  begin();
+}
+
+GitFirmwareSha256::~GitFirmwareSha256() {
+}
+
+void GitFirmwareSha256::begin() {
+  static const uint32_t H0[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  };
+  memcpy(_state, H0, sizeof(_state));
+  _length = 0;
+  _blockLen = 0;
+}
+
+void GitFirmwareSha256::transform(const uint8_t* block) {
+  uint32_t w[64];
+  for (int i = 0; i < 16; i++) {
+    w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+           ((uint32_t)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+  }
+  for (int i = 16; i < 64; i++) {
+    uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  uint32_t a = _state[0], b = _state[1], c = _state[2], d = _state[3];
+  uint32_t e = _state[4], f = _state[5], g = _state[6], h = _state[7];
+  for (int i = 0; i < 64; i++) {
+    uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+    uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  _state[0] += a; _state[1] += b; _state[2] += c; _state[3] += d;
+  _state[4] += e; _state[5] += f; _state[6] += g; _state[7] += h;
+}
+
+void GitFirmwareSha256::update(const uint8_t* data, size_t len) {
+  _length += len;
+  if (_blockLen > 0) {
+    size_t n = sizeof(_block) - _blockLen;
+    if (n > len) n = len;
+    memcpy(_block + _blockLen, data, n);
+    _blockLen += n;
+    data += n;
+    len -= n;
+    if (_blockLen < sizeof(_block)) return;
+    transform(_block);
+    _blockLen = 0;
+  }
+  while (len >= sizeof(_block)) {
+    transform(data);
+    data += sizeof(_block);
+    len -= sizeof(_block);
+  }
+  memcpy(_block, data, len);
+  _blockLen = len;
+}
+
+void GitFirmwareSha256::finish(uint8_t digest[DIGEST_SIZE]) {
+  uint64_t bits = _length * 8;
+  uint8_t pad = 0x80;
+  update(&pad, 1);
+  pad = 0;
+  while (_blockLen != 56) {
+    update(&pad, 1);
+  }
+  uint8_t len[8];
+  for (int i = 0; i < 8; i++) {
+    len[i] = (uint8_t)(bits >> (56 - 8 * i));
+  }
+  update(len, 8);
+  for (int i = 0; i < 8; i++) {
+    digest[i * 4] = (uint8_t)(_state[i] >> 24);
+    digest[i * 4 + 1] = (uint8_t)(_state[i] >> 16);
+    digest[i * 4 + 2] = (uint8_t)(_state[i] >> 8);
+    digest[i * 4 + 3] = (uint8_t)_state[i];
+  }
+}
+
+#endif
@@ -0,0 +1,63 @@
+/**
+ * @file GitFirmwareSha256.h
+ * @brief Incremental SHA-256 for verifying firmware images while they download
+ *
+ * On ESP32 this wraps mbedtls, which uses the SHA hardware accelerator.
+ * On the host a portable implementation is compiled instead.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(ARDUINO)
+  #include <mbedtls/sha256.h>
+#endif
+
+/**
+ * @class GitFirmwareSha256
+ * @brief SHA-256 (FIPS 180-4) over data fed in arbitrary chunks
+ */
+class GitFirmwareSha256 {
+public:
+  /// Digest size in bytes
+  static const size_t DIGEST_SIZE = 32;
+
+  GitFirmwareSha256();
+  ~GitFirmwareSha256();
+
+  /**
+   * @brief Start a new hash
+   */
+  void begin();
+
+  /**
+   * @brief Add data
+   */
+  void update(const uint8_t* data, size_t len);
+
+  /**
+   * @brief Finish and return the digest (call begin() before reusing)
+   */
+  void finish(uint8_t digest[DIGEST_SIZE]);
+
+  /**
+   * @brief Parse a 64 character hex digest (upper or lower case)
+   *
+   * @return false if hex is not a valid SHA-256 hex string
+   */
+  static bool parseHex(const char* hex, uint8_t digest[DIGEST_SIZE]);
+
+private:
+#if defined(ARDUINO)
+  mbedtls_sha256_context _ctx;
+#else
+  uint32_t _state[8];
+  uint64_t _length;            ///< Bytes hashed
+  uint8_t _block[64];
+  size_t _blockLen;
+
+  void transform(const uint8_t* block);
+#endif
+};
@@ -0,0 +1,333 @@
+/**
+ * @file GitFirmwareSink.cpp
+ * @brief ESP32 (Update) and host (file) sinks
+ */
+
+#include "GitFirmwareSink.h"
+
+#if defined(ARDUINO)
+
+#include <Update.h>
+#include <stdlib.h>
+#include <string.h>
+
+UpdateSink::UpdateSink(size_t blockSize)
+  : _blockSize(blockSize),
+    _buffer(nullptr),
+    _bufferLen(0),
+    _external(nullptr),
+    _externalSize(0) {
+}
+
+UpdateSink::~UpdateSink() {
+  releaseBuffer();
+}
+
+void UpdateSink::releaseBuffer() {
+  if (_buffer != _external) {
+    free(_buffer);
+  }
+  _buffer = nullptr;
+  _bufferLen = 0;
+}
+
+bool UpdateSink::begin(size_t size) {
+  releaseBuffer();
+  if (!Update.begin(size > 0 ? size : (size_t)UPDATE_SIZE_UNKNOWN)) {
+    return false;
+  }
+  if (_external && _blockSize > _externalSize) {
+    _blockSize = _externalSize;
+  }
+  if (_blockSize > 0) {
+    _buffer = _external ? _external : (uint8_t*)malloc(_blockSize);  // nullptr: unbuffered
+  }
+  return true;
+}
+
+bool UpdateSink::flush() {
+  if (_bufferLen == 0) {
+    return true;
+  }
+  bool ok = Update.write(_buffer, _bufferLen) == _bufferLen;
+  _bufferLen = 0;
+  return ok;
+}
+
+size_t UpdateSink::write(const uint8_t* buf, size_t len) {
+  if (!_buffer) {
+    return Update.write(const_cast<uint8_t*>(buf), len);
+  }
+  size_t done = 0;
+  while (done < len) {
+    // Block boundary and at least one block left: write it without copying
+    if (_bufferLen == 0 && len - done >= _blockSize) {
+      if (Update.write(const_cast<uint8_t*>(buf + done), _blockSize) != _blockSize) {
+        return done;
+      }
+      done += _blockSize;
+      continue;
+    }
+    size_t n = _blockSize - _bufferLen;
+    if (n > len - done) n = len - done;
+    memcpy(_buffer + _bufferLen, buf + done, n);
+    _bufferLen += n;
+    done += n;
+    if (_bufferLen == _blockSize && !flush()) {
+      return done - n;
+    }
+  }
+  return done;
+}
+
+bool UpdateSink::end() {
+  bool ok = flush();
+  releaseBuffer();
+  return ok && Update.end() && Update.isFinished();
+}
+
+void UpdateSink::abort() {
+  releaseBuffer();
+  // Always abort Update if it was started
+  if (Update.isRunning()) {
+    Update.abort();
+  }
+}
+
+int UpdateSink::getError() const {
+  return Update.getError();
+}
+
+PartitionSink::PartitionSink()
+  : _partition(nullptr),
+    _buffer(nullptr),
+    _external(nullptr),
+    _bufferLen(0),
+    _flushed(0),
+    _expected(0),
+    _error(0) {
+}
+
+PartitionSink::~PartitionSink() {
+  abort();
+}
+
+bool PartitionSink::open(size_t size, size_t offset) {
+  abort();
+  _error = 0;
+  _partition = esp_ota_get_next_update_partition(nullptr);
+  if (!_partition) {
+    _error = ESP_ERR_NOT_FOUND;
+    return false;
+  }
+  if (size > _partition->size || offset > _partition->size || (offset % SECTOR_SIZE) != 0) {
+    _error = ESP_ERR_INVALID_SIZE;
+    return false;
+  }
+  _buffer = _external ? _external : (uint8_t*)malloc(SECTOR_SIZE);
+  if (!_buffer) {
+    _error = ESP_ERR_NO_MEM;
+    return false;
+  }
+  _bufferLen = 0;
+  _flushed = offset;
+  _expected = size;
+  return true;
+}
+
+bool PartitionSink::begin(size_t size) {
+  return open(size, 0);
+}
+
+bool PartitionSink::resume(size_t size, size_t offset) {
+  // commit() only reports whole sectors, so offset starts an unwritten, unerased sector
+  return open(size, offset);
+}
+
+bool PartitionSink::flush() {
+  if (_bufferLen == 0) {
+    return true;
+  }
+  if (_flushed + SECTOR_SIZE > _partition->size) {
+    _error = ESP_ERR_INVALID_SIZE;
+    return false;
+  }
+  // Pad the last sector with erased-flash bytes (keeps 16-byte alignment for flash encryption)
+  size_t len = (_bufferLen + 15) & ~(size_t)15;
+  memset(_buffer + _bufferLen, 0xff, len - _bufferLen);
+  esp_err_t err = esp_partition_erase_range(_partition, _flushed, SECTOR_SIZE);
+  if (err == ESP_OK) {
+    err = esp_partition_write(_partition, _flushed, _buffer, len);
+  }
+  if (err != ESP_OK) {
+    _error = err;
+    return false;
+  }
+  _flushed += _bufferLen;
+  _bufferLen = 0;
+  return true;
+}
+
+size_t PartitionSink::write(const uint8_t* buf, size_t len) {
+  if (!_buffer) return 0;
+  size_t done = 0;
+  while (done < len) {
+    size_t n = SECTOR_SIZE - _bufferLen;
+    if (n > len - done) n = len - done;
+    memcpy(_buffer + _bufferLen, buf + done, n);
+    _bufferLen += n;
+    done += n;
+    if (_bufferLen == SECTOR_SIZE && !flush()) {
+      return done - n;
+    }
+  }
+  return done;
+}
+
+bool PartitionSink::end() {
+  if (!_buffer) return false;
+  bool ok = flush();
+  if (ok && _expected > 0 && _flushed != _expected) {
+    _error = ESP_ERR_INVALID_SIZE;
+    ok = false;
+  }
+  if (ok) {
+    // Verifies the image (header, segments, SHA-256) before switching
+    esp_err_t err = esp_ota_set_boot_partition(_partition);
+    if (err != ESP_OK) {
+      _error = err;
+      ok = false;
+    }
+  }
+  abort();
+  return ok;
+}
+
+bool PartitionSink::read(size_t offset, uint8_t* buf, size_t len) {
+  if (!_partition || offset + len > _flushed) {
+    return false;
+  }
+  return esp_partition_read(_partition, offset, buf, len) == ESP_OK;
+}
+
+void PartitionSink::abort() {
+  // Flash is left as is: the image is not bootable until end() succeeds
+  if (_buffer != _external) {
+    free(_buffer);
+  }
+  _buffer = nullptr;
+  _bufferLen = 0;
+}
+
+#else  // Host (file)
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+FileSink::FileSink(const char* path)
+  : _file(nullptr),
+    _expected(0),
+    _written(0),
+    _error(0) {
+  strncpy(_path, path, sizeof(_path) - 1);
+  _path[sizeof(_path) - 1] = '\0';
+  snprintf(_partPath, sizeof(_partPath), "%s.part", _path);
+}
+
+FileSink::~FileSink() {
+  abort();
+}
+
+bool FileSink::begin(size_t size) {
+  abort();
+  _expected = size;
+  _written = 0;
+  _error = 0;
+  _file = fopen(_partPath, "w+b");  // Readable for read()
+  if (!_file) {
+    _error = errno;
+    return false;
+  }
+  return true;
+}
+
+size_t FileSink::write(const uint8_t* buf, size_t len) {
+  if (!_file) return 0;
+  size_t n = fwrite(buf, 1, len, _file);
+  if (n != len) {
+    _error = errno;
+  }
+  _written += n;
+  return n;
+}
+
+bool FileSink::end() {
+  if (!_file) return false;
+  bool ok = fclose(_file) == 0;
+  _file = nullptr;
+  if (!ok || (_expected > 0 && _written != _expected)) {
+    _error = ok ? EIO : errno;
+    remove(_partPath);
+    return false;
+  }
+  if (rename(_partPath, _path) != 0) {
+    _error = errno;
+    remove(_partPath);
+    return false;
+  }
+  return true;
+}
+
+void FileSink::abort() {
+  if (_file) {
+    fclose(_file);
+    _file = nullptr;
+    remove(_partPath);
+  }
+}
+
+bool FileSink::resume(size_t size, size_t offset) {
+  abort();
+  _expected = size;
+  _error = 0;
+  _file = fopen(_partPath, "r+b");
+  if (!_file) {
+    _error = errno;
+    return false;
+  }
+  // Drop anything written after the last commit()
+  if (fseek(_file, 0, SEEK_END) != 0 || (size_t)ftell(_file) < offset ||
+      ftruncate(fileno(_file), offset) != 0 || fseek(_file, offset, SEEK_SET) != 0) {
+    _error = errno ? errno : EINVAL;
+    fclose(_file);
+    _file = nullptr;
+    return false;
+  }
+  _written = offset;
+  return true;
+}
+
+size_t FileSink::commit() {
+  if (!_file || fflush(_file) != 0 || fsync(fileno(_file)) != 0) {
+    return 0;
+  }
+  return _written;
+}
+
+bool FileSink::read(size_t offset, uint8_t* buf, size_t len) {
+  if (!_file || offset + len > _written || fflush(_file) != 0) {
+    return false;
+  }
+  return pread(fileno(_file), buf, len, offset) == (ssize_t)len;
+}
+
+void FileSink::suspend() {
+  // Keep "<path>.part" for resume()
+  if (_file) {
+    fclose(_file);
+    _file = nullptr;
+  }
+}
+
+#endif
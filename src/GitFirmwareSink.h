@@ -0,0 +1,246 @@
+/**
+ * @file GitFirmwareSink.h
+ * @brief Pluggable flash sink for GitFirmwareUpdate
+ *
+ * Downloaded firmware bytes are committed through a GitFirmwareSink.
+ * The default on ESP32 is UpdateSink (the global Update object).
+ * PartitionSink writes the OTA partition directly and, unlike Update, can
+ * continue a partially written image after a reboot (resume()). On a
+ * Linux host, FileSink writes the image to a file so the engine can be
+ * benchmarked without flashing a board.
+ *
+ * The interface uses plain C++ types only so it compiles on the host.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined(ARDUINO)
+  #include <esp_ota_ops.h>
+#endif
+
+/**
+ * @class GitFirmwareSink
+ * @brief Abstract firmware image writer (begin/write/end/abort)
+ */
+class GitFirmwareSink {
+public:
+  virtual ~GitFirmwareSink() {}
+
+  /**
+   * @brief Prepare for a new image
+   *
+   * @param size Image size in bytes, 0 if unknown
+   * @return true if ready to accept writes
+   */
+  virtual bool begin(size_t size) = 0;
+
+  /**
+   * @brief Append image data
+   *
+   * @return number of bytes written (== len on success)
+   */
+  virtual size_t write(const uint8_t* buf, size_t len) = 0;
+
+  /**
+   * @brief Finalize and validate the image
+   *
+   * @return true if the image is complete and will be booted / is usable
+   */
+  virtual bool end() = 0;
+
+  /**
+   * @brief Discard a partially written image (safe if not started)
+   */
+  virtual void abort() = 0;
+
+  /**
+   * @brief Continue an image started before a reboot
+   *
+   * @param size Image size in bytes, 0 if unknown
+   * @param offset Bytes already written, as returned by commit()
+   * @return true if ready to accept writes at offset (default: not supported)
+   */
+  virtual bool resume(size_t size, size_t offset) {
+    (void)size;
+    (void)offset;
+    return false;
+  }
+
+  /**
+   * @brief Make written data durable
+   *
+   * @return bytes that will survive a reboot (resume offset), 0 if
+   *         resume() is not supported
+   */
+  virtual size_t commit() { return 0; }
+
+  /**
+   * @brief Stop writing but keep committed data for resume() (default: abort)
+   */
+  virtual void suspend() { abort(); }
+
+  /**
+   * @brief Read back committed image data (e.g. to rebuild a hash after resume())
+   *
+   * @return true if len bytes at offset were read (default: not supported)
+   */
+  virtual bool read(size_t offset, uint8_t* buf, size_t len) {
+    (void)offset;
+    (void)buf;
+    (void)len;
+    return false;
+  }
+
+  /**
+   * @brief Implementation-specific error code for logging (0 = none)
+   */
+  virtual int getError() const = 0;
+};
+
+#if defined(ARDUINO)
+
+/**
+ * @class UpdateSink
+ * @brief ESP32 sink writing to the inactive OTA partition via Update (default)
+ *
+ * Data is passed to Update.write() as it arrives by default: Update
+ * already collects it into a flash sector buffer. With setBlockSize() the
+ * sink collects blocks itself (heap, allocated in begin()) so
+ * Update.write() is called once per block. If the block cannot be
+ * allocated, data is passed through unbuffered. setBuffer() provides the
+ * block instead of the heap.
+ */
+class UpdateSink : public GitFirmwareSink {
+public:
+  /// Default block size: unbuffered (Update buffers a sector itself)
+  static const size_t DEFAULT_BLOCK_SIZE = 0;
+
+  /**
+   * @param blockSize Bytes collected per Update.write() (0 = unbuffered)
+   */
+  explicit UpdateSink(size_t blockSize = DEFAULT_BLOCK_SIZE);
+  ~UpdateSink() override;
+
+  bool begin(size_t size) override;
+  size_t write(const uint8_t* buf, size_t len) override;
+  bool end() override;
+  void abort() override;
+  int getError() const override;
+
+  /**
+   * @brief Set the block size used from the next begin() on (0 = unbuffered)
+   *
+   * Use a multiple of 4096 so every Update.write() covers whole sectors.
+   */
+  void setBlockSize(size_t blockSize) { _blockSize = blockSize; }
+
+  /**
+   * @brief Use a caller-provided block buffer instead of allocating one in begin()
+   *
+   * The block size is limited to size. The buffer must outlive the sink.
+   *
+   * @param buffer Block buffer (nullptr = allocate from heap again)
+   * @param size Buffer size in bytes
+   */
+  void setBuffer(uint8_t* buffer, size_t size) {
+    _external = buffer;
+    _externalSize = buffer ? size : 0;
+  }
+
+private:
+  size_t _blockSize;
+  uint8_t* _buffer;        ///< Block buffer, nullptr when idle or unbuffered
+  size_t _bufferLen;
+  uint8_t* _external;      ///< Caller-provided block buffer or nullptr
+  size_t _externalSize;
+
+  bool flush();
+  void releaseBuffer();
+};
+
+/**
+ * @class PartitionSink
+ * @brief ESP32 sink writing the next OTA partition with esp_partition_* (resumable)
+ *
+ * Data is collected in one 4 KB flash sector buffer (heap, allocated in
+ * begin() / resume(), or provided with setBuffer()); each full sector is
+ * erased and written. commit()
+ * reports the sector-aligned amount already on flash. end() validates the
+ * image and selects it for the next boot (esp_ota_set_boot_partition).
+ */
+class PartitionSink : public GitFirmwareSink {
+public:
+  PartitionSink();
+  ~PartitionSink() override;
+
+  bool begin(size_t size) override;
+  size_t write(const uint8_t* buf, size_t len) override;
+  bool end() override;
+  void abort() override;
+  bool resume(size_t size, size_t offset) override;
+  size_t commit() override { return _flushed; }
+  void suspend() override { abort(); }  // Nothing to discard: flash keeps the prefix
+  bool read(size_t offset, uint8_t* buf, size_t len) override;
+  int getError() const override { return _error; }
+
+  /// Sector buffer size needed by setBuffer()
+  static const size_t SECTOR_SIZE = 4096;
+
+  /**
+   * @brief Use a caller-provided SECTOR_SIZE buffer instead of allocating one
+   *
+   * The buffer must outlive the sink. nullptr = allocate from heap again.
+   */
+  void setBuffer(uint8_t* buffer) { _external = buffer; }
+
+private:
+  const esp_partition_t* _partition;
+  uint8_t* _buffer;        ///< One sector, nullptr when idle
+  uint8_t* _external;      ///< Caller-provided sector buffer or nullptr
+  size_t _bufferLen;
+  size_t _flushed;         ///< Bytes on flash
+  size_t _expected;        ///< Size from begin(), 0 if unknown
+  int _error;              ///< esp_err_t of the last failure
+
+  bool open(size_t size, size_t offset);
+  bool flush();
+};
+
+#else
+
+/**
+ * @class FileSink
+ * @brief Host sink writing the image to a file
+ *
+ * Data goes to "<path>.part" and is renamed to path on end(), so a
+ * failed update never leaves a truncated image at path.
+ */
+class FileSink : public GitFirmwareSink {
+public:
+  explicit FileSink(const char* path);
+  ~FileSink() override;
+
+  bool begin(size_t size) override;
+  size_t write(const uint8_t* buf, size_t len) override;
+  bool end() override;
+  void abort() override;
+  bool resume(size_t size, size_t offset) override;
+  size_t commit() override;
+  void suspend() override;
+  bool read(size_t offset, uint8_t* buf, size_t len) override;
+  int getError() const override { return _error; }
+
+private:
+  char _path[256];
+  char _partPath[262];
+  FILE* _file;
+  size_t _expected;        ///< Size from begin(), 0 if unknown
+  size_t _written;
+  int _error;              ///< errno of the last failure
+};
+
+#endif
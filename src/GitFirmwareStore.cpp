@@ -0,0 +1,99 @@
+/**
+ * @file GitFirmwareStore.cpp
+ * @brief ESP32 (NVS) and host (file) key-value stores
+ */
+
+#include "GitFirmwareStore.h"
+
+#if defined(ARDUINO)
+
+PreferencesStore::PreferencesStore(const char* nvsNamespace)
+  : _namespace(nvsNamespace) {
+}
+
+size_t PreferencesStore::load(const char* key, void* buf, size_t capacity) {
+  if (!_prefs.begin(_namespace, true)) {
+    return 0;  // Namespace does not exist yet
+  }
+  size_t len = _prefs.getBytesLength(key);
+  if (len == 0 || len > capacity) {
+    _prefs.end();
+    return 0;
+  }
+  len = _prefs.getBytes(key, buf, len);
+  _prefs.end();
+  return len;
+}
+
+bool PreferencesStore::save(const char* key, const void* data, size_t len) {
+  if (!_prefs.begin(_namespace, false)) {
+    return false;
+  }
+  bool ok = _prefs.putBytes(key, data, len) == len;
+  _prefs.end();
+  return ok;
+}
+
+void PreferencesStore::remove(const char* key) {
+  if (_prefs.begin(_namespace, false)) {
+    if (_prefs.isKey(key)) {
+      _prefs.remove(key);
+    }
+    _prefs.end();
+  }
+}
+
+#else  // Host (files)
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+FileStore::FileStore(const char* directory) {
+  strncpy(_dir, directory, sizeof(_dir) - 1);
+  _dir[sizeof(_dir) - 1] = '\0';
+}
+
+void FileStore::path(const char* key, const char* suffix, char* out, size_t outSize) const {
+  snprintf(out, outSize, "%s/%s%s", _dir, key, suffix);
+}
+
+size_t FileStore::load(const char* key, void* buf, size_t capacity) {
+  char file[256];
+  path(key, "", file, sizeof(file));
+  FILE* f = fopen(file, "rb");
+  if (!f) {
+    return 0;
+  }
+  size_t len = fread(buf, 1, capacity, f);
+  bool tooLarge = len == capacity && fgetc(f) != EOF;
+  fclose(f);
+  return tooLarge ? 0 : len;
+}
+
+bool FileStore::save(const char* key, const void* data, size_t len) {
+  char file[256];
+  char tmp[260];
+  path(key, "", file, sizeof(file));
+  path(key, ".tmp", tmp, sizeof(tmp));
+
+  FILE* f = fopen(tmp, "wb");
+  if (!f) {
+    return false;
+  }
+  bool ok = fwrite(data, 1, len, f) == len && fflush(f) == 0 && fsync(fileno(f)) == 0;
+  ok = fclose(f) == 0 && ok;
+  if (!ok || rename(tmp, file) != 0) {
+    ::remove(tmp);
+    return false;
+  }
+  return true;
+}
+
+void FileStore::remove(const char* key) {
+  char file[256];
+  path(key, "", file, sizeof(file));
+  ::remove(file);
+}
+
+#endif
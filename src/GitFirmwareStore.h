@@ -0,0 +1,102 @@
+/**
+ * @file GitFirmwareStore.h
+ * @brief Small persistent key-value store for GitFirmwareUpdate state
+ *
+ * Used for the download checkpoint (GitFirmwareCheckpoint) so an update
+ * can continue after a reboot. The default on ESP32 is PreferencesStore
+ * (NVS); on a Linux host, FileStore keeps one file per key.
+ *
+ * The interface uses plain C++ types only so it compiles on the host.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(ARDUINO)
+  #include <Preferences.h>
+#endif
+
+/**
+ * @class GitFirmwareStore
+ * @brief Abstract blob store (load/save/remove by key)
+ *
+ * Keys are short ASCII names (NVS limit: 15 characters).
+ */
+class GitFirmwareStore {
+public:
+  virtual ~GitFirmwareStore() {}
+
+  /**
+   * @brief Read a value
+   *
+   * @param key Key name
+   * @param buf Destination
+   * @param capacity Size of buf
+   * @return bytes read, 0 if the key does not exist or does not fit
+   */
+  virtual size_t load(const char* key, void* buf, size_t capacity) = 0;
+
+  /**
+   * @brief Write a value (replaces the previous one atomically where possible)
+   *
+   * @return true on success
+   */
+  virtual bool save(const char* key, const void* data, size_t len) = 0;
+
+  /**
+   * @brief Delete a value (safe if it does not exist)
+   */
+  virtual void remove(const char* key) = 0;
+};
+
+#if defined(ARDUINO)
+
+/**
+ * @class PreferencesStore
+ * @brief ESP32 store in NVS via Preferences
+ */
+class PreferencesStore : public GitFirmwareStore {
+public:
+  /**
+   * @param nvsNamespace NVS namespace (max 15 characters, pointer must stay valid)
+   */
+  explicit PreferencesStore(const char* nvsNamespace = "gitfw");
+
+  size_t load(const char* key, void* buf, size_t capacity) override;
+  bool save(const char* key, const void* data, size_t len) override;
+  void remove(const char* key) override;
+
+private:
+  const char* _namespace;
+  Preferences _prefs;
+};
+
+#else
+
+/**
+ * @class FileStore
+ * @brief Host store: one file per key in a directory
+ *
+ * save() writes "<key>.tmp" and renames it, so a crash never leaves a
+ * half-written value.
+ */
+class FileStore : public GitFirmwareStore {
+public:
+  /**
+   * @param directory Existing directory for the value files
+   */
+  explicit FileStore(const char* directory);
+
+  size_t load(const char* key, void* buf, size_t capacity) override;
+  bool save(const char* key, const void* data, size_t len) override;
+  void remove(const char* key) override;
+
+private:
+  char _dir[200];
+
+  void path(const char* key, const char* suffix, char* out, size_t outSize) const;
+};
+
+#endif
@@ -0,0 +1,307 @@
+/**
+ * @file GitFirmwareTlsClient.cpp
+ * @brief Implementation of GitFirmwareTlsClient
+ */
+
+#include "GitFirmwareTlsClient.h"
+
+#if defined(ARDUINO) && defined(GIT_FIRMWARE_USE_HTTPS)
+
+#include <errno.h>
+#include <string.h>
+#include <lwip/sockets.h>
+#include <mbedtls/net_sockets.h>
+#if __has_include(<esp_random.h>)
+  #include <esp_random.h>
+#else
+  #include <esp_system.h>  // esp_fill_random() before ESP-IDF 5
+#endif
+
+// Hardware RNG (seeded by the RF subsystem while WiFi is on)
+static int tlsRandom(void* ctx, unsigned char* out, size_t len) {
+  (void)ctx;
+  esp_fill_random(out, len);
+  return 0;
+}
+
+static int tlsSend(void* ctx, const unsigned char* buf, size_t len) {
+  int n = lwip_send(*static_cast<int*>(ctx), buf, len, 0);
+  if (n < 0) {
+    return (errno == EAGAIN || errno == EWOULDBLOCK) ? MBEDTLS_ERR_SSL_WANT_WRITE : MBEDTLS_ERR_NET_SEND_FAILED;
+  }
+  return n;
+}
+
+static int tlsRecv(void* ctx, unsigned char* buf, size_t len) {
+  int n = lwip_recv(*static_cast<int*>(ctx), buf, len, 0);
+  if (n < 0) {
+    return (errno == EAGAIN || errno == EWOULDBLOCK) ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_RECV_FAILED;
+  }
+  return n;  // 0: peer closed
+}
+
+GitFirmwareTlsClient::GitFirmwareTlsClient()
+  : _socket(-1),
+    _connected(false),
+    _setup(false),
+    _insecure(false),
+    _offered(false),
+    _rootCA(nullptr),
+    _timeoutMs(30000),
+    _peeked(-1),
+    _cache(nullptr) {
+}
+
+GitFirmwareTlsClient::~GitFirmwareTlsClient() {
+  stop();
+}
+
+int GitFirmwareTlsClient::connect(IPAddress ip, uint16_t port) {
+  return connect(ip, port, _timeoutMs);
+}
+
+int GitFirmwareTlsClient::connect(IPAddress ip, uint16_t port, int32_t timeout) {
+  return connect(ip.toString().c_str(), port, timeout);
+}
+
+int GitFirmwareTlsClient::connect(const char* host, uint16_t port) {
+  return connect(host, port, _timeoutMs);
+}
+
+int GitFirmwareTlsClient::connect(const char* host, uint16_t port, int32_t timeout) {
+  stop();
+  _timeoutMs = timeout > 0 ? timeout : 30000;
+
+  IPAddress ip;
+  if (!WiFi.hostByName(host, ip)) {
+    return 0;
+  }
+  _socket = lwip_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (_socket < 0) {
+    return 0;
+  }
+
+  // Non-blocking connect bounded by the timeout, then blocking I/O with
+  // timeouts for the handshake
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = (uint32_t)ip;
+  struct timeval tv;
+  tv.tv_sec = _timeoutMs / 1000;
+  tv.tv_usec = (_timeoutMs % 1000) * 1000;
+  lwip_fcntl(_socket, F_SETFL, lwip_fcntl(_socket, F_GETFL, 0) | O_NONBLOCK);
+  if (lwip_connect(_socket, (struct sockaddr*)&addr, sizeof(addr)) != 0 && errno != EINPROGRESS) {
+    stop();
+    return 0;
+  }
+  fd_set writeSet;
+  FD_ZERO(&writeSet);
+  FD_SET(_socket, &writeSet);
+  int soError = 0;
+  socklen_t soLen = sizeof(soError);
+  if (lwip_select(_socket + 1, nullptr, &writeSet, nullptr, &tv) <= 0 ||
+      lwip_getsockopt(_socket, SOL_SOCKET, SO_ERROR, &soError, &soLen) != 0 || soError != 0) {
+    stop();
+    return 0;
+  }
+  lwip_fcntl(_socket, F_SETFL, lwip_fcntl(_socket, F_GETFL, 0) & ~O_NONBLOCK);
+  lwip_setsockopt(_socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  lwip_setsockopt(_socket, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  if (!handshake(host)) {
+    stop();
+    return 0;
+  }
+  // Reads after the handshake must not block (available() / connected())
+  lwip_fcntl(_socket, F_SETFL, lwip_fcntl(_socket, F_GETFL, 0) | O_NONBLOCK);
+  _connected = true;
+  return 1;
+}
+
+bool GitFirmwareTlsClient::handshake(const char* host) {
+  mbedtls_ssl_init(&_ssl);
+  mbedtls_ssl_config_init(&_conf);
+  mbedtls_x509_crt_init(&_ca);
+  _setup = true;
+  _offered = false;
+
+  if (mbedtls_ssl_config_defaults(&_conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                  MBEDTLS_SSL_PRESET_DEFAULT) != 0) {
+    return false;
+  }
+  mbedtls_ssl_conf_rng(&_conf, tlsRandom, nullptr);
+  if (_insecure) {
+    mbedtls_ssl_conf_authmode(&_conf, MBEDTLS_SSL_VERIFY_NONE);
+  } else if (!_rootCA) {
+    return false;
+  } else {
+    if (mbedtls_x509_crt_parse(&_ca, (const unsigned char*)_rootCA, strlen(_rootCA) + 1) != 0) {
+      return false;
+    }
+    mbedtls_ssl_conf_ca_chain(&_conf, &_ca, nullptr);
+    mbedtls_ssl_conf_authmode(&_conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+  }
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+  mbedtls_ssl_conf_session_tickets(&_conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+  if (mbedtls_ssl_setup(&_ssl, &_conf) != 0 || mbedtls_ssl_set_hostname(&_ssl, host) != 0) {
+    return false;
+  }
+  mbedtls_ssl_set_bio(&_ssl, &_socket, tlsSend, tlsRecv, nullptr);
+
+  if (_cache) {
+    // Serialized session on the heap: the TLS context is there anyway, a task stack may be small
+    uint8_t* blob = (uint8_t*)malloc(GitFirmwareTlsSessionCache::SESSION_SIZE);
+    size_t length = blob ? _cache->load(host, blob, GitFirmwareTlsSessionCache::SESSION_SIZE, !_insecure) : 0;
+    if (length > 0) {
+      mbedtls_ssl_session session;
+      mbedtls_ssl_session_init(&session);
+      _offered = mbedtls_ssl_session_load(&session, blob, length) == 0 &&
+                 mbedtls_ssl_set_session(&_ssl, &session) == 0;
+      mbedtls_ssl_session_free(&session);
+    }
+    free(blob);
+  }
+
+  uint32_t start = millis();
+  int ret;
+  while ((ret = mbedtls_ssl_handshake(&_ssl)) != 0) {
+    if ((ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) ||
+        millis() - start >= (uint32_t)_timeoutMs) {
+      if (_offered) {
+        _cache->remove(host);  // Do not offer it again
+      }
+      return false;
+    }
+  }
+  saveSession(host);
+  return true;
+}
+
+void GitFirmwareTlsClient::saveSession(const char* host) {
+  if (!_cache) {
+    return;
+  }
+  uint8_t* blob = (uint8_t*)malloc(GitFirmwareTlsSessionCache::SESSION_SIZE);
+  if (!blob) {
+    return;
+  }
+  mbedtls_ssl_session session;
+  mbedtls_ssl_session_init(&session);
+  size_t length = 0;
+  if (mbedtls_ssl_get_session(&_ssl, &session) == 0 &&
+      mbedtls_ssl_session_save(&session, blob, GitFirmwareTlsSessionCache::SESSION_SIZE, &length) == 0) {
+    _cache->save(host, blob, length, !_insecure);
+  }
+  mbedtls_ssl_session_free(&session);
+  free(blob);
+}
+
+int GitFirmwareTlsClient::pump() {
+  if (!_connected) {
+    return _setup ? (int)mbedtls_ssl_get_bytes_avail(&_ssl) : 0;
+  }
+  int avail = (int)mbedtls_ssl_get_bytes_avail(&_ssl);
+  if (avail > 0) {
+    return avail;
+  }
+  int ret = mbedtls_ssl_read(&_ssl, nullptr, 0);  // Decrypts a record if one arrived
+  if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+    _connected = false;  // Close notify, EOF or error
+  }
+  return (int)mbedtls_ssl_get_bytes_avail(&_ssl);
+}
+
+int GitFirmwareTlsClient::available() {
+  return (_peeked >= 0 ? 1 : 0) + pump();
+}
+
+int GitFirmwareTlsClient::read(uint8_t* buf, size_t size) {
+  if (size == 0) {
+    return 0;
+  }
+  int done = 0;
+  if (_peeked >= 0) {
+    buf[done++] = (uint8_t)_peeked;
+    _peeked = -1;
+  }
+  if ((size_t)done == size || !_setup) {
+    return done > 0 ? done : -1;
+  }
+  int ret = mbedtls_ssl_read(&_ssl, buf + done, size - done);
+  if (ret > 0) {
+    return done + ret;
+  }
+  if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+    _connected = false;
+  }
+  return done > 0 ? done : -1;
+}
+
+int GitFirmwareTlsClient::read() {
+  uint8_t b;
+  return read(&b, 1) == 1 ? b : -1;
+}
+
+int GitFirmwareTlsClient::peek() {
+  if (_peeked < 0) {
+    uint8_t b;
+    if (read(&b, 1) == 1) {
+      _peeked = b;
+    }
+  }
+  return _peeked;
+}
+
+size_t GitFirmwareTlsClient::write(uint8_t data) {
+  return write(&data, 1);
+}
+
+size_t GitFirmwareTlsClient::write(const uint8_t* buf, size_t size) {
+  if (!_connected) {
+    return 0;
+  }
+  size_t done = 0;
+  uint32_t start = millis();
+  while (done < size) {
+    int ret = mbedtls_ssl_write(&_ssl, buf + done, size - done);
+    if (ret > 0) {
+      done += ret;
+      continue;
+    }
+    if ((ret != MBEDTLS_ERR_SSL_WANT_WRITE && ret != MBEDTLS_ERR_SSL_WANT_READ) ||
+        millis() - start >= (uint32_t)_timeoutMs) {
+      _connected = false;
+      break;
+    }
+    delay(1);  // Socket buffer full
+  }
+  return done;
+}
+
+uint8_t GitFirmwareTlsClient::connected() {
+  // Still "connected" while decrypted data is left after the peer closed
+  return available() > 0 || _connected;
+}
+
+void GitFirmwareTlsClient::stop() {
+  if (_setup) {
+    if (_connected) {
+      mbedtls_ssl_close_notify(&_ssl);
+    }
+    mbedtls_ssl_free(&_ssl);
+    mbedtls_ssl_config_free(&_conf);
+    mbedtls_x509_crt_free(&_ca);
+    _setup = false;
+  }
+  if (_socket >= 0) {
+    lwip_close(_socket);
+    _socket = -1;
+  }
+  _connected = false;
+  _peeked = -1;
+}
+
+#endif
@@ -0,0 +1,106 @@
+/**
+ * @file GitFirmwareTlsClient.h
+ * @brief ESP32 TLS client (mbedTLS over an lwIP socket) with session resumption
+ *
+ * WiFiClientSecure sets up and completes the handshake in one call, so a
+ * saved session cannot be offered to the server. This client does the
+ * handshake itself: it offers the session cached for the host (session ID
+ * or ticket, RFC 5077) and saves the new one afterwards, so repeated
+ * connections to the same host need only an abbreviated handshake without
+ * certificate verification and key exchange.
+ *
+ * It derives from WiFiClient so HTTPClient can use it like
+ * WiFiClientSecure. Only compiled with GIT_FIRMWARE_USE_HTTPS.
+ */
+
+#pragma once
+
+#if defined(ARDUINO) && defined(GIT_FIRMWARE_USE_HTTPS)
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/x509_crt.h>
+#include "GitFirmwareTlsSessionCache.h"
+
+/**
+ * @class GitFirmwareTlsClient
+ * @brief TLS client that resumes sessions from a GitFirmwareTlsSessionCache
+ */
+class GitFirmwareTlsClient : public WiFiClient {
+public:
+  GitFirmwareTlsClient();
+  ~GitFirmwareTlsClient() override;
+
+  /**
+   * @brief Sessions to offer and update (nullptr = full handshake every time)
+   */
+  void setSessionCache(GitFirmwareTlsSessionCache* cache) { _cache = cache; }
+
+  /**
+   * @brief Skip server certificate validation (false = validate again from the next connect())
+   */
+  void setInsecure(bool insecure = true) { _insecure = insecure; }
+
+  /**
+   * @brief Validate the server against a PEM CA certificate (must stay valid)
+   *
+   * Without a CA certificate and setInsecure() the handshake fails, as with
+   * WiFiClientSecure.
+   */
+  void setCACert(const char* rootCA) { _rootCA = rootCA; _insecure = false; }
+
+  /**
+   * @brief True if the last handshake offered a cached session
+   *
+   * Whether the server accepted it shows in the handshake time.
+   */
+  bool offeredSession() const { return _offered; }
+
+  /**
+   * @brief Socket of the connection, -1 if none (WiFiClient::fd() does not know it)
+   */
+  int socketFd() const { return _socket; }
+
+  /**
+   * @brief Decrypted bytes readable without touching the socket
+   *
+   * A select() on socketFd() misses these, so check here first.
+   */
+  int pending() { return (_peeked >= 0 ? 1 : 0) + (_setup ? (int)mbedtls_ssl_get_bytes_avail(&_ssl) : 0); }
+
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(IPAddress ip, uint16_t port, int32_t timeout) override;
+  int connect(const char* host, uint16_t port) override;
+  int connect(const char* host, uint16_t port, int32_t timeout) override;
+  size_t write(uint8_t data) override;
+  size_t write(const uint8_t* buf, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t* buf, size_t size) override;
+  int peek() override;
+  void flush() override {}
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override { return connected(); }
+
+private:
+  int _socket;
+  bool _connected;
+  bool _setup;             ///< _ssl / _conf initialized
+  bool _insecure;
+  bool _offered;
+  const char* _rootCA;
+  int32_t _timeoutMs;
+  int _peeked;             ///< Byte returned by peek(), -1 if none
+  GitFirmwareTlsSessionCache* _cache;
+  mbedtls_ssl_context _ssl;
+  mbedtls_ssl_config _conf;
+  mbedtls_x509_crt _ca;
+
+  bool handshake(const char* host);
+  void saveSession(const char* host);
+  int pump();              ///< Process pending records, returns decrypted bytes available
+};
+
+#endif
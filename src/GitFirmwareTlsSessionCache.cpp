@@ -0,0 +1,87 @@
+/**
+ * @file GitFirmwareTlsSessionCache.cpp
+ * @brief Implementation of GitFirmwareTlsSessionCache
+ */
+
+#include "GitFirmwareTlsSessionCache.h"
+#include "GitFirmwareCrc32.h"
+#include <string.h>
+
+// Bump when the layout of Storage changes
+static const uint32_t SESSION_CACHE_MAGIC = 0x32534647;  // "GFS2"
+
+static uint32_t storageCrc(const GitFirmwareTlsSessionCache::Storage& storage) {
+  return gitFirmwareCrc32(0, reinterpret_cast<const uint8_t*>(&storage),
+                          offsetof(GitFirmwareTlsSessionCache::Storage, crc));
+}
+
+GitFirmwareTlsSessionCache::GitFirmwareTlsSessionCache(Storage& storage)
+  : _storage(storage) {
+  if (_storage.magic != SESSION_CACHE_MAGIC || _storage.crc != storageCrc(_storage)) {
+    clear();
+  }
+}
+
+GitFirmwareTlsSessionCache::Slot* GitFirmwareTlsSessionCache::find(const char* host) const {
+  for (uint8_t i = 0; i < SLOTS; i++) {
+    Slot& slot = _storage.slots[i];
+    if (slot.host[0] != '\0' && strcmp(slot.host, host) == 0) {
+      return &slot;
+    }
+  }
+  return nullptr;
+}
+
+size_t GitFirmwareTlsSessionCache::load(const char* host, uint8_t* buf, size_t capacity,
+                                        bool verified) const {
+  const Slot* slot = find(host);
+  if (!slot || slot->length > capacity || slot->verified != (verified ? 1 : 0)) {
+    return 0;
+  }
+  memcpy(buf, slot->session, slot->length);
+  return slot->length;
+}
+
+bool GitFirmwareTlsSessionCache::save(const char* host, const uint8_t* session, size_t length,
+                                      bool verified) {
+  if (strlen(host) >= HOST_SIZE || length == 0 || length > SESSION_SIZE) {
+    return false;
+  }
+  Slot* slot = find(host);
+  if (!slot) {
+    // Empty slot, else the least recently saved one
+    slot = &_storage.slots[0];
+    for (uint8_t i = 0; i < SLOTS && slot->host[0] != '\0'; i++) {
+      Slot& candidate = _storage.slots[i];
+      if (candidate.host[0] == '\0' || candidate.stamp < slot->stamp) {
+        slot = &candidate;
+      }
+    }
+    memset(slot->host, 0, sizeof(slot->host));
+    strcpy(slot->host, host);
+  }
+  slot->stamp = _storage.nextStamp++;
+  slot->length = (uint16_t)length;
+  slot->verified = verified ? 1 : 0;
+  memcpy(slot->session, session, length);
+  seal();
+  return true;
+}
+
+void GitFirmwareTlsSessionCache::remove(const char* host) {
+  Slot* slot = find(host);
+  if (slot) {
+    memset(slot, 0, sizeof(*slot));
+    seal();
+  }
+}
+
+void GitFirmwareTlsSessionCache::clear() {
+  memset(&_storage, 0, sizeof(_storage));
+  _storage.magic = SESSION_CACHE_MAGIC;
+  seal();
+}
+
+void GitFirmwareTlsSessionCache::seal() {
+  _storage.crc = storageCrc(_storage);
+}
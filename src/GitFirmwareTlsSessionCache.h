@@ -0,0 +1,107 @@
+/**
+ * @file GitFirmwareTlsSessionCache.h
+ * @brief TLS sessions per host, so later connections resume with an abbreviated handshake
+ *
+ * Holds serialized client sessions (mbedtls_ssl_session_save(): session ID
+ * or ticket plus master secret) in fixed slots keyed by host name. The
+ * slots are a caller-provided Storage: a plain global for RAM, or an
+ * RTC_NOINIT_ATTR variable so sessions survive deep sleep; a magic and a
+ * CRC32 detect storage that was never initialized or is torn.
+ *
+ *   RTC_NOINIT_ATTR GitFirmwareTlsSessionCache::Storage tlsSessions;
+ *   GitFirmwareTlsSessionCache tlsCache(tlsSessions);
+ *
+ * The server decides whether a session is still valid: an expired one just
+ * leads to a full handshake, whose new session then replaces it.
+ *
+ * A resumed session skips the certificate check, so each slot records
+ * whether its handshake validated the server certificate; load() only
+ * returns sessions made in the mode asked for.
+ *
+ * Plain C++ only (usable on the host).
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Sessions kept (one per host; the least recently saved one is replaced).
+// Storage is about SLOTS * (SESSION_SIZE + 72) bytes; ESP32 RTC slow memory has 8 KB.
+#ifndef GIT_FIRMWARE_TLS_SESSION_SLOTS
+  #define GIT_FIRMWARE_TLS_SESSION_SLOTS 2
+#endif
+// Serialized session capacity in bytes (includes the peer certificate when
+// mbedTLS keeps it, CONFIG_MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
+#ifndef GIT_FIRMWARE_TLS_SESSION_SIZE
+  #define GIT_FIRMWARE_TLS_SESSION_SIZE 2048
+#endif
+
+/**
+ * @class GitFirmwareTlsSessionCache
+ * @brief Host name -> serialized TLS session
+ */
+class GitFirmwareTlsSessionCache {
+public:
+  static const uint8_t SLOTS = GIT_FIRMWARE_TLS_SESSION_SLOTS;
+  static const size_t SESSION_SIZE = GIT_FIRMWARE_TLS_SESSION_SIZE;
+  static const size_t HOST_SIZE = 64;
+
+  struct Slot {
+    char host[HOST_SIZE];      ///< "" = empty
+    uint32_t stamp;            ///< Save order (replacement)
+    uint16_t length;
+    uint8_t verified;          ///< 1 = handshake validated the server certificate
+    uint8_t session[SESSION_SIZE];
+  };
+
+  /**
+   * @struct Storage
+   * @brief All slots; trivially copyable, so it can be placed in RTC memory
+   */
+  struct Storage {
+    uint32_t magic;
+    uint32_t nextStamp;
+    Slot slots[SLOTS];
+    uint32_t crc;              ///< CRC32 of everything before it
+  };
+
+  /**
+   * @param storage Slots (must outlive the cache). Kept if magic and CRC
+   *                are valid, cleared otherwise.
+   */
+  explicit GitFirmwareTlsSessionCache(Storage& storage);
+
+  /**
+   * @brief Copy the session of host
+   *
+   * @param verified Certificate validation of the connection to resume
+   * @return session length, 0 if none, saved with the other validation
+   *         mode, or it does not fit into capacity
+   */
+  size_t load(const char* host, uint8_t* buf, size_t capacity, bool verified) const;
+
+  /**
+   * @brief Store the session of host (replaces its previous one)
+   *
+   * @param verified The handshake validated the server certificate
+   * @return false if host or session are too long
+   */
+  bool save(const char* host, const uint8_t* session, size_t length, bool verified);
+
+  /**
+   * @brief Forget the session of host (e.g. after a failed resumption)
+   */
+  void remove(const char* host);
+
+  /**
+   * @brief Forget all sessions
+   */
+  void clear();
+
+private:
+  Storage& _storage;
+
+  Slot* find(const char* host) const;
+  void seal();
+};
@@ -0,0 +1,736 @@
+/**
+ * @file GitFirmwareTransport.cpp
+ * @brief ESP32 (HTTPClient) and host (POSIX socket) transports
+ */
+
+#include "GitFirmwareTransport.h"
+#include <string.h>
+#include <strings.h>
+
+const char* const GitFirmwareTransport::COLLECTED_HEADERS[] = {
+  "Content-Encoding",
+  "Content-Range",
+  "ETag",
+  "Last-Modified"
+};
+const uint8_t GitFirmwareTransport::COLLECTED_HEADER_COUNT =
+  sizeof(COLLECTED_HEADERS) / sizeof(COLLECTED_HEADERS[0]);
+
+bool GitFirmwareRequestHeaders::add(const char* name, const char* value) {
+  size_t nameLen = strlen(name) + 1;
+  size_t valueLen = strlen(value) + 1;
+  if (_len + nameLen + valueLen > CAPACITY) {
+    return false;
+  }
+  memcpy(_buf + _len, name, nameLen);
+  memcpy(_buf + _len + nameLen, value, valueLen);
+  _len += nameLen + valueLen;
+  return true;
+}
+
+bool GitFirmwareRequestHeaders::get(size_t index, const char*& name, const char*& value) const {
+  size_t pos = 0;
+  for (;;) {
+    if (pos >= _len) return false;
+    name = _buf + pos;
+    value = name + strlen(name) + 1;
+    if (index-- == 0) return true;
+    pos = (value + strlen(value) + 1) - _buf;
+  }
+}
+
+// Replace url by a redirect target: absolute, protocol-relative ("//host/...")
+// or relative to the origin of url ("/path"). False (url unchanged) if it does not fit.
+static bool followLocation(char* url, size_t size, const char* location) {
+  size_t keep = 0;
+  if (location[0] == '/') {
+    const char* hostStart = strstr(url, "://");
+    if (!hostStart) {
+      return false;
+    }
+    if (location[1] == '/') {
+      keep = (size_t)(hostStart + 1 - url);  // Scheme and ':'
+    } else {
+      const char* pathStart = strchr(hostStart + 3, '/');
+      keep = pathStart ? (size_t)(pathStart - url) : strlen(url);
+    }
+  }
+  size_t len = strlen(location);
+  if (keep + len >= size) {
+    return false;
+  }
+  memmove(url + keep, location, len + 1);
+  return true;
+}
+
+static bool isRedirect(int code) {
+  return code == 301 || code == 302 || code == 303 || code == 307 || code == 308;
+}
+
+#if defined(ARDUINO)
+
+#include <lwip/sockets.h>
+
+// Trailing body bytes (e.g. the newline after latest.json) drained by close() so the connection can be kept
+static const int32_t KEEP_ALIVE_DRAIN_MAX = 512;
+
+HttpClientTransport::HttpClientTransport(bool validateCert)
+  :
+#ifdef GIT_FIRMWARE_USE_HTTPS
+    _tlsSessions(nullptr),
+#endif
+    _client(nullptr),
+    _validateCert(validateCert),
+    _open(false),
+    _keepAlive(false),
+    _keepable(false),
+    _reused(false),
+    _timeoutMs(30000),
+    _size(-1),
+    _remaining(-1),
+    _host{0},
+    _port(0),
+    _idleHost{0},
+    _idlePort(0),
+    _headerValue{0},
+    _finalUrl{0},
+    _timing{0, 0, 0} {
+}
+
+HttpClientTransport::~HttpClientTransport() {
+  disconnect();  // HTTPClient ends before the client stops (same order as the members)
+}
+
+void HttpClientTransport::setCertificateValidation(bool validate) {
+  if (validate == _validateCert) {
+    return;
+  }
+  disconnect();  // A kept connection was opened under the old setting
+  _validateCert = validate;
+}
+
+#ifdef GIT_FIRMWARE_USE_HTTPS
+void HttpClientTransport::setTlsSessionCache(GitFirmwareTlsSessionCache* cache) {
+  _tlsSessions = cache;  // A kept connection of the other client is closed by the next open()
+}
+#endif
+
+// Split "scheme://host[:port]/..." into host and port
+static bool splitHostPort(const char* url, char* host, size_t hostSize, uint16_t& port) {
+  const char* start = strstr(url, "://");
+  if (!start) return false;
+  port = strncmp(url, "https", 5) == 0 ? 443 : 80;
+  start += 3;
+  size_t len = strcspn(start, ":/?#");
+  if (len == 0 || len >= hostSize) return false;
+  memcpy(host, start, len);
+  host[len] = '\0';
+  if (start[len] == ':') {
+    port = (uint16_t)atoi(start + len + 1);
+  }
+  return true;
+}
+
+int HttpClientTransport::open(const char* url, bool followRedirects) {
+  _timing.dnsMs = _timing.connectMs = _timing.responseMs = 0;
+
+  // Redirects are followed here rather than by HTTPClient, so each hop can
+  // use a kept connection and the final URL is known
+  const char* target = url;
+  int httpCode;
+  for (uint8_t hop = 0; ; hop++) {
+    httpCode = openUrl(target);
+    if (!isRedirect(httpCode) || !followRedirects || hop >= MAX_REDIRECTS) {
+      break;
+    }
+    String location = _http.getLocation();
+    if (target != _finalUrl) {
+      if (strlen(url) >= sizeof(_finalUrl)) {
+        break;
+      }
+      strcpy(_finalUrl, url);
+    }
+    if (location.length() == 0 || !followLocation(_finalUrl, sizeof(_finalUrl), location.c_str())) {
+      break;
+    }
+    close();
+    target = _finalUrl;
+  }
+  if (target != _finalUrl) {
+    _finalUrl[0] = '\0';
+  }
+  _requestHeaders.clear();
+  return httpCode;
+}
+
+int HttpClientTransport::openUrl(const char* url) {
+  close();
+  _host[0] = '\0';
+  _port = 0;
+  if (!splitHostPort(url, _host, sizeof(_host), _port)) {
+    _host[0] = '\0';
+  }
+
+  // The kept connection serves the same scheme, host and port only
+  bool secure = strncmp(url, "https://", 8) == 0;
+  bool reuse = _idleHost[0] != '\0' && _client && _client == clientFor(secure) &&
+               _port == _idlePort && strcmp(_host, _idleHost) == 0 &&
+               _client->connected();
+  if (!reuse) {
+    disconnect();
+  }
+  _idleHost[0] = '\0';
+
+  int httpCode = request(url, reuse);
+  _reused = reuse;
+  if (reuse && httpCode < 0) {
+    // The server closed the kept connection meanwhile: once more on a new one
+    disconnect();
+    httpCode = request(url, false);
+    _reused = false;
+  }
+  return httpCode;
+}
+
+WiFiClient* HttpClientTransport::clientFor(bool secure) {
+#ifdef GIT_FIRMWARE_USE_HTTPS
+  if (secure) {
+    return _tlsSessions ? static_cast<WiFiClient*>(&_tlsClient) : static_cast<WiFiClient*>(&_secureClient);
+  }
+#else
+  if (secure) {
+    return nullptr;  // HTTP-only build
+  }
+#endif
+  return &_plainClient;
+}
+
+int HttpClientTransport::request(const char* url, bool reuse) {
+  _size = -1;
+  _remaining = -1;
+  _keepable = _keepAlive;
+
+  _http.setTimeout(_timeoutMs);
+  _http.setReuse(_keepAlive);  // Without keep-alive: "Connection: close" and one request per connection
+  _http.setFollowRedirects(HTTPC_DISABLE_FOLLOW_REDIRECTS);  // open() follows them (important for GitHub)
+
+  // Use appropriate client based on URL scheme (HTTP vs HTTPS)
+  // HTTP saves ~30 KB heap by avoiding TLS buffers
+  bool beginOk = false;
+  if (strncmp(url, "https://", 8) == 0) {
+#ifdef GIT_FIRMWARE_USE_HTTPS
+    // The clients live across requests, so the setting is applied on every open
+    if (_tlsSessions) {
+      _tlsClient.setSessionCache(_tlsSessions);
+      _tlsClient.setInsecure(!_validateCert);
+    } else if (!_validateCert) {
+      _secureClient.setInsecure();  // Skip certificate validation
+    } else {
+      _secureClient.setCACert(nullptr);  // Undoes setInsecure(); validates like a fresh client
+    }
+    _client = clientFor(true);
+    beginOk = _http.begin(*_client, url);
+#else
+    return OPEN_FAILED;
+#endif
+  } else {
+    beginOk = _http.begin(_plainClient, url);
+    _client = &_plainClient;
+  }
+
+  if (!beginOk) {
+    return OPEN_FAILED;
+  }
+  _open = true;
+
+  // HTTPClient drops added headers in begin(), so they are applied here
+  const char* name;
+  const char* value;
+  for (size_t i = 0; _requestHeaders.get(i, name, value); i++) {
+    _http.addHeader(name, value);
+  }
+
+  _http.collectHeaders(const_cast<const char**>(COLLECTED_HEADERS), COLLECTED_HEADER_COUNT);
+
+  // Resolve and connect ahead of GET() so both can be timed; HTTPClient uses an
+  // already connected client as is. Redirect hops add up.
+  if (!reuse && _host[0] != '\0') {
+    uint32_t start = millis();
+    IPAddress ip;
+    WiFi.hostByName(_host, ip);  // Fills the lwIP DNS cache used by connect()
+    uint32_t resolved = millis();
+    _timing.dnsMs += resolved - start;
+    if (!_client->connect(_host, _port, _timeoutMs)) {
+      return HTTPC_ERROR_CONNECTION_REFUSED;  // Same result GET() reports
+    }
+    _timing.connectMs += millis() - resolved;
+  }
+
+  uint32_t requestStart = millis();
+  int httpCode = _http.GET();
+  _timing.responseMs += millis() - requestStart;
+  if (httpCode == HTTP_CODE_OK || httpCode == HTTP_CODE_PARTIAL_CONTENT) {
+    _size = _http.getSize();
+    if (_size <= 0) {
+      _size = -1;
+    }
+    _remaining = _size;
+  } else if (httpCode == HTTP_CODE_NOT_MODIFIED) {
+    _remaining = 0;  // No body
+  } else if (httpCode > 0) {
+    _remaining = _http.getSize();  // Redirect or error body; close() drains a short one
+  }
+  return httpCode;
+}
+
+int HttpClientTransport::read(uint8_t* buf, size_t capacity, uint32_t waitMs) {
+  if (!_open || _remaining == 0) {
+    return READ_EOF;
+  }
+
+  Stream* stream = _http.getStreamPtr();
+  uint32_t start = millis();
+  while (!stream->available()) {
+    if (!_http.connected()) return READ_EOF;
+    uint32_t elapsed = millis() - start;
+    if (elapsed >= waitMs) return 0;
+    waitReadable(waitMs - elapsed);
+  }
+
+  size_t toRead = stream->available();
+  if (toRead > capacity) toRead = capacity;
+  if (_remaining > 0 && toRead > (size_t)_remaining) toRead = _remaining;
+
+  int c = stream->readBytes(buf, toRead);
+  if (c <= 0) {
+    return READ_ERROR;
+  }
+  if (_remaining > 0) {
+    _remaining -= c;
+  }
+  return c;
+}
+
+const char* HttpClientTransport::header(const char* name) {
+  if (!_open || !_http.hasHeader(name)) {
+    return nullptr;
+  }
+  strncpy(_headerValue, _http.header(name).c_str(), sizeof(_headerValue) - 1);
+  _headerValue[sizeof(_headerValue) - 1] = '\0';
+  return _headerValue;
+}
+
+void HttpClientTransport::waitReadable(uint32_t timeoutMs) {
+  int fd = _client ? _client->fd() : -1;
+#ifdef GIT_FIRMWARE_USE_HTTPS
+  if (_client == &_tlsClient) {
+    if (_tlsClient.pending() > 0) {
+      return;  // Already decrypted, the socket may stay quiet
+    }
+    fd = _tlsClient.socketFd();
+  }
+#endif
+  // WiFiClientSecure keeps its socket to itself (fd() < 0): poll instead
+  if (fd < 0) {
+    delay(1);
+    return;
+  }
+  // Returns as soon as data (or FIN) arrives; a readable TLS socket may
+  // still hold only part of a record, so the caller re-checks available()
+  fd_set readSet;
+  FD_ZERO(&readSet);
+  FD_SET(fd, &readSet);
+  struct timeval tv;
+  tv.tv_sec = timeoutMs / 1000;
+  tv.tv_usec = (timeoutMs % 1000) * 1000;
+  if (select(fd + 1, &readSet, nullptr, nullptr, &tv) < 0) {
+    delay(1);  // Do not spin on a socket error; connected() reports it next
+  }
+}
+
+void HttpClientTransport::close() {
+  if (_open) {
+    if (_keepable && _remaining > 0 && _remaining <= KEEP_ALIVE_DRAIN_MAX) {
+      uint8_t scrap[64];
+      while (_remaining > 0 && read(scrap, sizeof(scrap), 0) > 0) {}
+    }
+    // end() keeps the socket only with reuse set and "keep-alive" from the server;
+    // a partly read body must not stay on a kept connection
+    bool keep = _keepable && _remaining == 0;
+    _http.setReuse(keep);
+    // Always call http.end() to free resources
+    // Modern ESP32 HTTPClient handles cleanup safely even after failed connections
+    _http.end();
+    _open = false;
+    if (keep && _client && _client->connected()) {
+      memcpy(_idleHost, _host, sizeof(_idleHost));
+      _idlePort = _port;
+    }
+  }
+}
+
+void HttpClientTransport::disconnect() {
+  close();
+  if (_client) {
+    _client->stop();
+  }
+  _idleHost[0] = '\0';
+}
+
+#else  // Host (POSIX sockets)
+
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+// Monotonic milliseconds (wraps like millis())
+static uint32_t monotonicMs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+PosixHttpTransport::PosixHttpTransport()
+  : _fd(-1),
+    _timeoutMs(30000),
+    _size(-1),
+    _remaining(-1),
+    _chunked(false),
+    _chunkTail(false),
+    _eof(false),
+    _keepAlive(false),
+    _keepable(false),
+    _reused(false),
+    _idle(false),
+    _origin{0},
+    _location{0},
+    _finalUrl{0},
+    _headers{},
+    _timing{0, 0, 0},
+    _rxStart(0),
+    _rxEnd(0) {
+}
+
+PosixHttpTransport::~PosixHttpTransport() {
+  disconnect();
+}
+
+void PosixHttpTransport::close() {
+  if (_idle) {
+    return;  // Already kept
+  }
+  // Keep the socket if the body ended exactly and nothing else is buffered
+  bool bodyDone = _chunked ? _eof : _remaining == 0;
+  if (_fd >= 0 && _keepable && bodyDone && _rxStart == _rxEnd) {
+    _idle = true;
+    return;
+  }
+  closeSocket();
+}
+
+void PosixHttpTransport::disconnect() {
+  closeSocket();
+}
+
+void PosixHttpTransport::closeSocket() {
+  if (_fd >= 0) {
+    ::close(_fd);
+    _fd = -1;
+  }
+  _idle = false;
+  _rxStart = _rxEnd = 0;
+}
+
+int PosixHttpTransport::open(const char* url, bool followRedirects) {
+  _timing.dnsMs = _timing.connectMs = _timing.responseMs = 0;
+  const char* target = url;
+  int code;
+  for (uint8_t hop = 0; ; hop++) {
+    code = request(target, true);
+    if (!isRedirect(code) || !followRedirects || _location[0] == '\0' || hop >= MAX_REDIRECTS) {
+      break;
+    }
+    if (target != _finalUrl) {
+      if (strlen(url) >= sizeof(_finalUrl)) {
+        break;
+      }
+      strcpy(_finalUrl, url);
+    }
+    if (!followLocation(_finalUrl, sizeof(_finalUrl), _location)) {
+      break;
+    }
+    close();
+    target = _finalUrl;
+  }
+  if (target != _finalUrl) {
+    _finalUrl[0] = '\0';
+  }
+  _requestHeaders.clear();
+  return code;
+}
+
+int PosixHttpTransport::request(const char* url, bool mayReuse) {
+  close();
+  _size = -1;
+  _remaining = -1;
+  _chunked = false;
+  _chunkTail = false;
+  _eof = false;
+  _location[0] = '\0';
+  for (uint8_t i = 0; i < COLLECTED_HEADER_COUNT; i++) {
+    _headers[i][0] = '\0';
+  }
+
+  if (strncmp(url, "http://", 7) != 0) {
+    return OPEN_FAILED;  // TLS is not implemented in the host transport
+  }
+
+  // Split http://host[:port]/path
+  char host[128];
+  const char* hostStart = url + 7;
+  const char* path = strchr(hostStart, '/');
+  size_t hostLen = path ? (size_t)(path - hostStart) : strlen(hostStart);
+  if (hostLen == 0 || hostLen >= sizeof(host)) {
+    return OPEN_FAILED;
+  }
+  memcpy(host, hostStart, hostLen);
+  host[hostLen] = '\0';
+  if (!path) path = "/";
+
+  const char* port = "80";
+  char* colon = strchr(host, ':');
+  if (colon) {
+    *colon = '\0';
+    port = colon + 1;
+  }
+
+  // A kept connection serves the same host and port only
+  char origin[sizeof(_origin)];
+  snprintf(origin, sizeof(origin), "%s:%s", host, port);
+  bool reuse = mayReuse && _idle && strcmp(origin, _origin) == 0;
+  if (!reuse) {
+    closeSocket();
+  }
+  _idle = false;
+  _reused = reuse;
+  _keepable = false;
+
+  uint32_t connected = monotonicMs();
+  if (!reuse) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* res = nullptr;
+    uint32_t start = monotonicMs();
+    if (getaddrinfo(host, port, &hints, &res) != 0 || !res) {
+      return OPEN_FAILED;
+    }
+    uint32_t resolved = monotonicMs();
+    _timing.dnsMs += resolved - start;
+    for (struct addrinfo* ai = res; ai && _fd < 0; ai = ai->ai_next) {
+      _fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (_fd < 0) continue;
+      struct timeval tv = { (time_t)(_timeoutMs / 1000), (suseconds_t)((_timeoutMs % 1000) * 1000) };
+      setsockopt(_fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+      if (connect(_fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+        ::close(_fd);
+        _fd = -1;
+      }
+    }
+    freeaddrinfo(res);
+    if (_fd < 0) {
+      return OPEN_FAILED;
+    }
+    connected = monotonicMs();
+    _timing.connectMs += connected - resolved;
+    memcpy(_origin, origin, sizeof(_origin));
+  }
+
+  if (colon) *colon = ':';  // Host header keeps the port
+  char req[sizeof(_location) + GitFirmwareRequestHeaders::CAPACITY + 128];  // Path up to a redirect target
+  int reqLen = snprintf(req, sizeof(req),
+                        "GET %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: GitFirmwareUpdate\r\n"
+                        "Connection: %s\r\n", path, host, _keepAlive ? "keep-alive" : "close");
+  const char* name;
+  const char* value;
+  for (size_t i = 0; _requestHeaders.get(i, name, value) && reqLen > 0 && (size_t)reqLen < sizeof(req); i++) {
+    reqLen += snprintf(req + reqLen, sizeof(req) - reqLen, "%s: %s\r\n", name, value);
+  }
+  if (reqLen > 0 && (size_t)reqLen < sizeof(req)) {
+    reqLen += snprintf(req + reqLen, sizeof(req) - reqLen, "\r\n");
+  }
+  if (reqLen <= 0 || (size_t)reqLen >= sizeof(req)) {
+    closeSocket();
+    return OPEN_FAILED;
+  }
+  char line[sizeof(_location) + 16];  // Fits "Location: <target>"
+  if (send(_fd, req, reqLen, MSG_NOSIGNAL) != reqLen || readLine(line, sizeof(line)) < 0) {
+    closeSocket();
+    // The server closed the kept connection meanwhile: once more on a new one
+    return reuse ? request(url, false) : OPEN_FAILED;
+  }
+
+  // Status line: "HTTP/1.1 200 OK"
+  const char* sp = strchr(line, ' ');
+  int code = sp ? atoi(sp + 1) : 0;
+  if (code <= 0) {
+    closeSocket();
+    return READ_ERROR;
+  }
+  _keepable = _keepAlive && strncmp(line, "HTTP/1.1", 8) == 0;
+
+  // Headers until empty line
+  for (;;) {
+    int len = readLine(line, sizeof(line));
+    if (len < 0) {
+      closeSocket();
+      return READ_ERROR;
+    }
+    if (len == 0) break;
+    if (strncasecmp(line, "Connection:", 11) == 0 && strstr(line + 11, "close")) {
+      _keepable = false;
+    } else if (strncasecmp(line, "Content-Length:", 15) == 0) {
+      _size = atol(line + 15);
+    } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0 && strstr(line + 18, "chunked")) {
+      _chunked = true;
+    } else if (strncasecmp(line, "Location:", 9) == 0) {
+      const char* v = line + 9;
+      while (*v == ' ') v++;
+      strncpy(_location, v, sizeof(_location) - 1);
+      _location[sizeof(_location) - 1] = '\0';
+    }
+    for (uint8_t i = 0; i < COLLECTED_HEADER_COUNT; i++) {
+      size_t n = strlen(COLLECTED_HEADERS[i]);
+      if (strncasecmp(line, COLLECTED_HEADERS[i], n) == 0 && line[n] == ':') {
+        const char* v = line + n + 1;
+        while (*v == ' ') v++;
+        strncpy(_headers[i], v, HEADER_VALUE_SIZE - 1);
+        _headers[i][HEADER_VALUE_SIZE - 1] = '\0';
+      }
+    }
+  }
+
+  if (_chunked) {
+    _size = -1;
+    _remaining = 0;
+  } else if (code == 204 || code == 304) {
+    _remaining = 0;  // No body
+  } else {
+    _remaining = _size;
+  }
+  _timing.responseMs += monotonicMs() - connected;
+  return code;
+}
+
+const char* PosixHttpTransport::header(const char* name) {
+  for (uint8_t i = 0; i < COLLECTED_HEADER_COUNT; i++) {
+    if (strcasecmp(name, COLLECTED_HEADERS[i]) == 0) {
+      return _headers[i][0] != '\0' ? _headers[i] : nullptr;
+    }
+  }
+  return nullptr;
+}
+
+int PosixHttpTransport::fill(uint32_t waitMs) {
+  if (_rxStart == _rxEnd) {
+    _rxStart = _rxEnd = 0;
+  } else if (_rxEnd == RX_SIZE) {
+    memmove(_rx, _rx + _rxStart, _rxEnd - _rxStart);
+    _rxEnd -= _rxStart;
+    _rxStart = 0;
+  }
+  if (_rxEnd == RX_SIZE) {
+    return READ_ERROR;  // Line longer than the receive buffer
+  }
+
+  struct pollfd pfd = { _fd, POLLIN, 0 };
+  int ready = poll(&pfd, 1, (int)waitMs);
+  if (ready == 0) return 0;
+  if (ready < 0) return errno == EINTR ? 0 : READ_ERROR;
+
+  ssize_t n = recv(_fd, _rx + _rxEnd, RX_SIZE - _rxEnd, 0);
+  if (n == 0) return READ_EOF;
+  if (n < 0) return (errno == EAGAIN || errno == EINTR) ? 0 : READ_ERROR;
+  _rxEnd += n;
+  return (int)n;
+}
+
+int PosixHttpTransport::readLine(char* line, size_t capacity) {
+  for (;;) {
+    uint8_t* nl = (uint8_t*)memchr(_rx + _rxStart, '\n', _rxEnd - _rxStart);
+    if (nl) {
+      size_t len = nl - (_rx + _rxStart);
+      size_t copyLen = len;
+      if (copyLen > 0 && _rx[_rxStart + copyLen - 1] == '\r') copyLen--;
+      if (copyLen >= capacity) copyLen = capacity - 1;
+      memcpy(line, _rx + _rxStart, copyLen);
+      line[copyLen] = '\0';
+      _rxStart += len + 1;
+      return (int)copyLen;
+    }
+    int n = fill(_timeoutMs);
+    if (n <= 0) return -1;
+  }
+}
+
+int PosixHttpTransport::readRaw(uint8_t* buf, size_t capacity, uint32_t waitMs) {
+  if (_rxStart == _rxEnd) {
+    int n = fill(waitMs);
+    if (n <= 0) return n;
+  }
+  size_t n = _rxEnd - _rxStart;
+  if (n > capacity) n = capacity;
+  memcpy(buf, _rx + _rxStart, n);
+  _rxStart += n;
+  return (int)n;
+}
+
+int PosixHttpTransport::read(uint8_t* buf, size_t capacity, uint32_t waitMs) {
+  if (_fd < 0 || _eof) {
+    return READ_EOF;
+  }
+
+  if (_chunked && _remaining == 0) {
+    char line[32];
+    if (_chunkTail && readLine(line, sizeof(line)) != 0) {
+      return READ_ERROR;
+    }
+    if (readLine(line, sizeof(line)) < 0) {
+      return READ_ERROR;
+    }
+    _remaining = (int32_t)strtol(line, nullptr, 16);
+    _chunkTail = true;
+    if (_remaining <= 0) {
+      // Last chunk: skip trailers
+      while (readLine(line, sizeof(line)) > 0) {}
+      _eof = true;
+      return READ_EOF;
+    }
+  }
+
+  if (_remaining == 0) {
+    _eof = true;
+    return READ_EOF;
+  }
+  if (_remaining > 0 && capacity > (size_t)_remaining) {
+    capacity = _remaining;
+  }
+
+  int n = readRaw(buf, capacity, waitMs);
+  if (n > 0 && _remaining > 0) {
+    _remaining -= n;
+  }
+  if (n == READ_EOF) {
+    _eof = true;
+  }
+  return n;
+}
+
+#endif
@@ -0,0 +1,356 @@
+/**
+ * @file GitFirmwareTransport.h
+ * @brief Pluggable HTTP transport for GitFirmwareUpdate
+ *
+ * GitFirmwareUpdate fetches latest.json and the firmware image through a
+ * GitFirmwareTransport. The default on ESP32 is HttpClientTransport
+ * (HTTPClient + WiFiClient / WiFiClientSecure). On a Linux host,
+ * PosixHttpTransport talks plain HTTP/1.1 over POSIX sockets so the
+ * download path can be benchmarked against a local server.
+ *
+ * The interface uses plain C++ types only so it compiles on the host.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Longest redirect target followed and reported by finalUrl(); GitHub release
+// asset redirects carry a signed query string of several hundred bytes
+#ifndef GIT_FIRMWARE_REDIRECT_URL_SIZE
+  #define GIT_FIRMWARE_REDIRECT_URL_SIZE 1024
+#endif
+
+#if defined(ARDUINO)
+  #include <Arduino.h>
+  #include <WiFi.h>
+  #ifdef GIT_FIRMWARE_USE_HTTPS
+    #include <WiFiClientSecure.h>
+    #include "GitFirmwareTlsClient.h"
+  #endif
+  #include <HTTPClient.h>
+#endif
+
+/**
+ * @class GitFirmwareRequestHeaders
+ * @brief Fixed-size copy of extra request headers for the next open()
+ *
+ * Stored as "name\0value\0name\0value\0..." in one buffer (no heap).
+ */
+class GitFirmwareRequestHeaders {
+public:
+  static const size_t CAPACITY = 192;
+
+  GitFirmwareRequestHeaders() : _len(0) {}
+
+  /**
+   * @brief Append a header
+   * @return false if it does not fit (header not added)
+   */
+  bool add(const char* name, const char* value);
+
+  /**
+   * @brief Get header by index
+   * @return false if index is out of range
+   */
+  bool get(size_t index, const char*& name, const char*& value) const;
+
+  void clear() { _len = 0; }
+
+private:
+  char _buf[CAPACITY];
+  size_t _len;
+};
+
+/**
+ * @class GitFirmwareTransport
+ * @brief Abstract GET-only HTTP transport (open/read/size/close)
+ */
+class GitFirmwareTransport {
+public:
+  /// read() result: stream finished (all bytes delivered or peer closed)
+  static const int READ_EOF = -1;
+  /// read() result: connection or protocol error
+  static const int READ_ERROR = -2;
+  /// open() result: request could not be started (bad URL, unsupported scheme, connect failed)
+  static const int OPEN_FAILED = -100;
+
+  virtual ~GitFirmwareTransport() {}
+
+  /**
+   * @brief Send a GET request and read the response headers
+   *
+   * @param url Absolute http:// or https:// URL
+   * @param followRedirects Follow 301/302/307/308 responses
+   * @return HTTP status code (> 0) or negative transport error
+   */
+  virtual int open(const char* url, bool followRedirects) = 0;
+
+  /**
+   * @brief Read body bytes
+   *
+   * @param buf Destination buffer
+   * @param capacity Maximum bytes to read
+   * @param waitMs Maximum time to wait for data
+   * @return bytes read (> 0), 0 if no data arrived within waitMs,
+   *         READ_EOF at end of body, READ_ERROR on failure
+   */
+  virtual int read(uint8_t* buf, size_t capacity, uint32_t waitMs) = 0;
+
+  /**
+   * @brief Body size from Content-Length
+   *
+   * @return size in bytes, or -1 if unknown (chunked / no header)
+   */
+  virtual int32_t size() const = 0;
+
+  /**
+   * @brief Release the connection (safe to call more than once)
+   */
+  virtual void close() = 0;
+
+  /**
+   * @brief Set connect/read timeout in milliseconds
+   */
+  virtual void setTimeout(uint32_t timeoutMs) = 0;
+
+  /**
+   * @brief Keep the connection after close() when the body was read completely
+   *
+   * The next open() to the same scheme, host and port then sends its request
+   * on it, without DNS lookup, TCP connect or TLS handshake. A kept
+   * connection the server closed meanwhile is replaced by a new one; a
+   * redirect hop to the same host is sent on the connection of the previous
+   * one. Default: off.
+   */
+  virtual void setKeepAlive(bool keepAlive) { (void)keepAlive; }
+
+  /**
+   * @brief Close the connection, including one kept by setKeepAlive()
+   */
+  virtual void disconnect() { close(); }
+
+  /**
+   * @brief True if the last open() was sent on a kept connection
+   */
+  virtual bool reused() const { return false; }
+
+  /**
+   * @brief URL that answered the last open() after following redirects
+   *
+   * @return final URL, or nullptr if no redirect was followed (or the
+   *         transport cannot tell); valid until the next open()
+   */
+  virtual const char* finalUrl() const { return nullptr; }
+
+  /**
+   * @brief Add a request header for the next open() only (e.g. Range)
+   *
+   * Name and value are copied; open() clears the list.
+   *
+   * @return false if the header did not fit
+   */
+  virtual bool addRequestHeader(const char* name, const char* value) = 0;
+
+  /**
+   * @brief Response header value from the last open()
+   *
+   * Only headers listed in COLLECTED_HEADERS are available.
+   *
+   * @param name Header name (case-insensitive)
+   * @return value, or nullptr if absent; valid until the next header() or
+   *         open() call (implementations may reuse one buffer), copy it to keep it
+   */
+  virtual const char* header(const char* name) = 0;
+
+  /**
+   * @struct Timing
+   * @brief Where the last open() spent its time (summed over redirects)
+   *
+   * Fields a transport cannot measure separately stay 0.
+   */
+  struct Timing {
+    uint32_t dnsMs;        ///< Host name lookup
+    uint32_t connectMs;    ///< TCP connect (HttpClientTransport: including the TLS handshake)
+    uint32_t responseMs;   ///< Request sent until response headers received
+  };
+
+  /**
+   * @brief Timing of the last open()
+   */
+  virtual Timing timing() const {
+    Timing t = {0, 0, 0};
+    return t;
+  }
+
+  /// Response headers the transports collect for header()
+  static const char* const COLLECTED_HEADERS[];
+  static const uint8_t COLLECTED_HEADER_COUNT;
+  static const uint8_t MAX_COLLECTED_HEADERS = 8;  ///< Upper bound for COLLECTED_HEADER_COUNT
+  static const size_t HEADER_VALUE_SIZE = 64;
+};
+
+#if defined(ARDUINO)
+
+/**
+ * @class HttpClientTransport
+ * @brief ESP32 transport based on HTTPClient (default)
+ *
+ * Clients are declared before HTTPClient so HTTPClient is destroyed first
+ * while the client is still valid (see 1.0.3 destructor-order fix).
+ */
+class HttpClientTransport : public GitFirmwareTransport {
+public:
+  /**
+   * @param validateCert Validate server certificates (HTTPS builds only)
+   */
+  explicit HttpClientTransport(bool validateCert = false);
+  ~HttpClientTransport() override;
+
+  int open(const char* url, bool followRedirects) override;
+  int read(uint8_t* buf, size_t capacity, uint32_t waitMs) override;
+  int32_t size() const override { return _size; }
+  void close() override;
+  void setTimeout(uint32_t timeoutMs) override { _timeoutMs = timeoutMs; }
+  void setKeepAlive(bool keepAlive) override { _keepAlive = keepAlive; }
+  void disconnect() override;
+  bool reused() const override { return _reused; }
+  const char* finalUrl() const override { return _finalUrl[0] != '\0' ? _finalUrl : nullptr; }
+  bool addRequestHeader(const char* name, const char* value) override {
+    return _requestHeaders.add(name, value);
+  }
+  const char* header(const char* name) override;
+  Timing timing() const override { return _timing; }
+
+  /**
+   * @brief Validate server certificates from the next open() on (HTTPS builds only)
+   *
+   * A change closes the kept connection. Cached TLS sessions are only
+   * resumed in the validation mode they were made in.
+   */
+  void setCertificateValidation(bool validate);
+
+#ifdef GIT_FIRMWARE_USE_HTTPS
+  /**
+   * @brief Resume TLS sessions from cache from the next open() on
+   *
+   * nullptr = WiFiClientSecure with full handshakes (default).
+   */
+  void setTlsSessionCache(GitFirmwareTlsSessionCache* cache);
+#endif
+
+private:
+  static const uint8_t MAX_REDIRECTS = 5;
+
+  // IMPORTANT: Declare clients BEFORE HTTPClient to ensure correct destructor order
+#ifdef GIT_FIRMWARE_USE_HTTPS
+  WiFiClientSecure _secureClient;
+  GitFirmwareTlsClient _tlsClient;  ///< Used instead of _secureClient while a session cache is set
+  GitFirmwareTlsSessionCache* _tlsSessions;
+#endif
+  WiFiClient _plainClient;
+  HTTPClient _http;
+  WiFiClient* _client;     ///< Client used by the open connection
+
+  bool _validateCert;
+  bool _open;
+  bool _keepAlive;
+  bool _keepable;          ///< Open connection may be kept
+  bool _reused;            ///< Last open() used the kept connection
+  uint32_t _timeoutMs;
+  int32_t _size;           ///< Content-Length or -1
+  int32_t _remaining;      ///< Bytes left when Content-Length known
+  char _host[128];         ///< Host of the open connection
+  uint16_t _port;
+  char _idleHost[128];     ///< Host of the kept connection, "" if none
+  uint16_t _idlePort;
+  char _headerValue[HEADER_VALUE_SIZE]; ///< Copy returned by header()
+  char _finalUrl[GIT_FIRMWARE_REDIRECT_URL_SIZE]; ///< Current redirect target, "" if none followed
+  GitFirmwareRequestHeaders _requestHeaders; ///< Extra headers for the next open()
+  Timing _timing;          ///< Timing of the last open()
+
+  /**
+   * @brief Client request() uses for the scheme
+   */
+  WiFiClient* clientFor(bool secure);
+
+  /**
+   * @brief GET url without following redirects, on the kept connection if it fits
+   */
+  int openUrl(const char* url);
+
+  /**
+   * @brief One GET on the kept connection (reuse) or a new one
+   */
+  int request(const char* url, bool reuse);
+
+  /**
+   * @brief Sleep until the socket is readable or timeoutMs passed
+   */
+  void waitReadable(uint32_t timeoutMs);
+};
+
+#else
+
+/**
+ * @class PosixHttpTransport
+ * @brief Host transport: HTTP/1.1 over POSIX sockets (http:// only)
+ *
+ * Supports Content-Length and chunked bodies and follows redirects.
+ * Intended for benchmarks and tests against a local server.
+ */
+class PosixHttpTransport : public GitFirmwareTransport {
+public:
+  PosixHttpTransport();
+  ~PosixHttpTransport() override;
+
+  int open(const char* url, bool followRedirects) override;
+  int read(uint8_t* buf, size_t capacity, uint32_t waitMs) override;
+  int32_t size() const override { return _size; }
+  void close() override;
+  void setTimeout(uint32_t timeoutMs) override { _timeoutMs = timeoutMs; }
+  void setKeepAlive(bool keepAlive) override { _keepAlive = keepAlive; }
+  void disconnect() override;
+  bool reused() const override { return _reused; }
+  const char* finalUrl() const override { return _finalUrl[0] != '\0' ? _finalUrl : nullptr; }
+  bool addRequestHeader(const char* name, const char* value) override {
+    return _requestHeaders.add(name, value);
+  }
+  const char* header(const char* name) override;
+  Timing timing() const override { return _timing; }
+
+private:
+  static const uint8_t MAX_REDIRECTS = 5;
+  static const size_t RX_SIZE = 2048;
+
+  int _fd;
+  uint32_t _timeoutMs;
+  int32_t _size;
+  int32_t _remaining;      ///< Bytes left in body (Content-Length) or current chunk
+  bool _chunked;
+  bool _chunkTail;         ///< CRLF after chunk data still to be consumed
+  bool _eof;
+  bool _keepAlive;
+  bool _keepable;          ///< Server allows another request on this connection
+  bool _reused;            ///< Last open() used the kept connection
+  bool _idle;              ///< _fd is a kept connection to _origin
+  char _origin[136];       ///< "host:port" of _fd
+  char _location[GIT_FIRMWARE_REDIRECT_URL_SIZE]; ///< Redirect target from last response
+  char _finalUrl[GIT_FIRMWARE_REDIRECT_URL_SIZE]; ///< Current redirect target, "" if none followed
+  char _headers[MAX_COLLECTED_HEADERS][HEADER_VALUE_SIZE]; ///< Values of COLLECTED_HEADERS ("" if absent)
+  GitFirmwareRequestHeaders _requestHeaders; ///< Extra headers for the next open()
+  Timing _timing;          ///< Timing of the last open()
+
+  uint8_t _rx[RX_SIZE];    ///< Receive buffer (header + body look-ahead)
+  size_t _rxStart;
+  size_t _rxEnd;
+
+  int request(const char* url, bool keep);
+  void closeSocket();
+  int fill(uint32_t waitMs);
+  int readLine(char* line, size_t capacity);
+  int readRaw(uint8_t* buf, size_t capacity, uint32_t waitMs);
+};
+
+#endif
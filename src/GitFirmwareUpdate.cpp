@@ -4,15 +4,117 @@
  */
 
 #include "GitFirmwareUpdate.h"
+#include "GitFirmwareCrc32.h"
 #include <Stream.h>
 #include <string.h>
+#if GIT_FIRMWARE_DELTA
+  #include <esp_ota_ops.h>
+#endif
+
+// Minimal Stream over a transport so ArduinoJson can parse latest.json directly
+// from the response body (one byte of look-ahead for peek())
+class TransportStream : public Stream {
+public:
+  TransportStream(GitFirmwareTransport& transport, uint32_t timeoutMs)
+    : _transport(transport), _timeoutMs(timeoutMs), _peeked(-1) {}
+
+  int available() override {
+    return peek() >= 0 ? 1 : 0;
+  }
+
+  int read() override {
+    int c = peek();
+    _peeked = -1;
+    return c;
+  }
+
+  int peek() override {
+    if (_peeked < 0) {
+      uint8_t c;
+      if (_transport.read(&c, 1, _timeoutMs) == 1) {
+        _peeked = c;
+      }
+    }
+    return _peeked;
+  }
+
+  size_t write(uint8_t) override { return 0; }
+
+private:
+  GitFirmwareTransport& _transport;
+  uint32_t _timeoutMs;
+  int _peeked;
+};
+
+// Assign a text field; false if it was truncated (zero-heap mode only)
+template <size_t N>
+static bool assignField(GitFirmwareFixedString<N>& field, const char* value) {
+  field = value;
+  return !field.overflow();
+}
+static inline bool assignField(String& field, const char* value) {
+  field = value;
+  return true;
+}
+
+// Default lifetime of a cached redirect target (GitHub signs CDN URLs for a few minutes)
+static const uint32_t REDIRECT_CACHE_MS = 300000;
+
+// Pause between download attempts
+static const uint32_t RETRY_DELAY_MS = 1000;
+
+// Time between a successful update and the restart
+static const uint32_t RESTART_DELAY_MS = 1000;
+
+// Longest wait for data per transport read in the download loop. The transport
+// sleeps on the socket until data arrives, so this only bounds how late the
+// abort flag and the poll() time slice are noticed.
+static const uint32_t READ_WAIT_MS = 50;
+
+// Download rate sample length for ProgressSnapshot::bytesPerSecond
+static const uint32_t RATE_SAMPLE_MS = 250;
+
+#if GIT_FIRMWARE_MIRRORS
+// Default probe size per unmeasured image mirror
+static const size_t MIRROR_PROBE_BYTES = 16384;
+
+// Throughput window for detecting a collapsed mirror
+static const uint32_t MIRROR_WINDOW_MS = 2000;
+
+// Switch when another mirror measured this many times the current window's rate...
+static const uint32_t MIRROR_SWITCH_RATIO = 4;
+
+// ...and at least this much of the image is left (a switch costs a new connection)
+static const size_t MIRROR_SWITCH_MIN_LEFT = 65536;
+#endif
+
+#if GIT_FIRMWARE_PIPELINE
+// Pipeline buffers live on the heap, so they can match the 4 KB flash sector
+static const size_t PIPELINE_BUF_SIZE = 4096;
+#endif
 
 GitFirmwareUpdate::GitFirmwareUpdate(const char* currentVersion, const char* githubUrl)
   : _currentVersion(currentVersion),  // Store pointer directly (no String copy)
     _githubUrl(githubUrl),            // Store pointer directly (no String copy)
+#if GIT_FIRMWARE_MIRRORS
+    _manifestUrls(&_githubUrl),
+    _manifestMirrors(),
+    _manifestSource(0),
+#endif
     _remoteVersion(),
     _releaseNotes(),
     _firmwareUrl(),
+    _compression(),
+    _sha256(),
+#if GIT_FIRMWARE_DELTA
+    _deltaFrom(),
+    _deltaUrl(),
+    _deltaCompression(),
+#endif
+#if GIT_FIRMWARE_MIRRORS
+    _firmwareMirrors(),
+    _firmwareMirrorCount(0),
+#endif
     _lastError(NO_ERROR),
     _lastErrorDetail{0},
     _progressCallback(nullptr),
@@ -20,20 +122,111 @@ GitFirmwareUpdate::GitFirmwareUpdate(const char* currentVersion, const char* git
     _timeoutMs(30000),
     _retryCount(0),
     _validateCert(false),
+    _tlsSessions(nullptr),
+#if GIT_FIRMWARE_PEERS
+    _peerFinder(nullptr),
+#endif
     _abortFlag(false),
     _isUpdating(false),
+    _pipelineBuffers(0),
+    _transport(nullptr),
+    _sink(nullptr),
+    _store(nullptr),
+    _checkpointInterval(65536),
+    _manifestEtag{0},
+    _manifestLastModified{0},
+    _memoryReserved(false),
+    _arena(nullptr),
+    _arenaWindow(nullptr),
+    _arenaPipeline(nullptr),
+    _arenaPipelineBuffers(0),
+    _tlsReserve(nullptr),
     _currentBytesRead(0),
     _totalBytes(0),
-    _currentPercent(0) {
+    _currentPercent(0),
+    _progressMinPercent(1),
+    _progressMinIntervalMs(100),
+    _reportedPercent(0),
+    _reportedMs(0),
+    _downloadStartBytes(0),
+    _rateWindowMs(0),
+    _rateWindowBytes(0),
+    _bytesPerSecond(0),
+    _timing(),
+    _updateStartMs(0),
+    _headersMs(0),
+    _firstByteMs(0),
+    _memory(),
+    _state(STATE_IDLE),
+    _blocking(false),
+    _stateSince(0),
+    _imageUrl(),
+    _imageCompression(),
+    _imageDelta(false),
+#if GIT_FIRMWARE_PEERS
+    _imagePeer(false),
+#endif
+    _redirectUrl(),
+    _redirectKey(0),
+    _redirectSince(0),
+    _redirectTtlMs(REDIRECT_CACHE_MS),
+#if GIT_FIRMWARE_MIRRORS
+    _imageMirrors(),
+    _imageSources(1),
+    _mirror(0),
+    _mirrorsTried(0),
+    _validatorMirror(GitFirmwareMirrors::NONE),
+    _mirrorProbePending(false),
+    _mirrorProbeBytes(MIRROR_PROBE_BYTES),
+#endif
+    _imageSink(nullptr),
+    _retryAttempt(0),
+    _resumable(false),
+    _hasContentLength(false),
+    _contentLength(0),
+    _validator{0},
+    _verify(false),
+    _expectedDigest{0},
+    _dl(),
+    _httpTransport(false) {
+  _httpTransport.setKeepAlive(true);
+#if GIT_FIRMWARE_ZERO_HEAP
+  _partitionSink.setBuffer(_sinkBuffer);  // Default sink in zero-heap mode (Update.begin() allocates)
+#endif
+#if GIT_FIRMWARE_MIRRORS
+  _manifestMirrors.assign(_manifestUrls, 1);
+#endif
+}
+
+#if GIT_FIRMWARE_MIRRORS
+GitFirmwareUpdate::GitFirmwareUpdate(const char* currentVersion, const char* const* manifestUrls, uint8_t count)
+  : GitFirmwareUpdate(currentVersion, manifestUrls[0]) {
+  _manifestUrls = manifestUrls;
+  _manifestMirrors.assign(manifestUrls, count > 0 ? count : 1);
+}
+#endif
+
+GitFirmwareUpdate::~GitFirmwareUpdate() {
+  free(_arena);
+  free(_tlsReserve);
 }
 
 bool GitFirmwareUpdate::checkForUpdate() {
+  // Nested in poll(): the update already lent the reserve and takes it back when it ends
+  bool lent = lendTlsReserve();
+  sampleMemory(_memory.check.before);
+  bool available = fetchManifest();
+  sampleMemory(_memory.check.after);
+  if (lent) {
+    restoreTlsReserve();
+  }
+  return available;
+}
+
+bool GitFirmwareUpdate::fetchManifest() {
   _lastError = NO_ERROR;
   _lastErrorDetail[0] = '\0';
   _abortFlag = false;
-  _remoteVersion = "";
-  _releaseNotes = "";
-  _firmwareUrl = "";
 
 #if GIT_FIRMWARE_HTTP_ONLY
   if (strncmp(_githubUrl, "https://", 8) == 0) {
@@ -42,48 +235,102 @@ bool GitFirmwareUpdate::checkForUpdate() {
   }
 #endif
 
-  // Use appropriate client based on URL scheme (HTTP vs HTTPS)
-  // HTTP saves ~30 KB heap by avoiding TLS buffers
-  // IMPORTANT: Declare clients BEFORE HTTPClient to ensure correct destructor order
-  // (HTTPClient must be destroyed first while client is still valid)
-  bool isHttps = (strncmp(_githubUrl, "https://", 8) == 0);
+  // The default transport is shared with the image download so a kept connection
+  // serves both; a check while a download runs uses a fresh one
+  bool shared = !isBusy() || _state == STATE_CHECKING;
+  HttpClientTransport ownTransport(_validateCert);
 #if !GIT_FIRMWARE_HTTP_ONLY
-  WiFiClientSecure secureClient;
+  ownTransport.setTlsSessionCache(_tlsSessions);
 #endif
-  WiFiClient plainClient;
-  
-  HTTPClient http;
-  http.setTimeout(_timeoutMs);
-  http.setReuse(false);  // Disable connection reuse for stability
-  
-  bool beginOk = false;
-  if (isHttps) {
-#if !GIT_FIRMWARE_HTTP_ONLY
-    if (!_validateCert) {
-      secureClient.setInsecure();  // Skip certificate validation
+  GitFirmwareTransport& transport = _transport ? *_transport
+                                               : (shared ? static_cast<GitFirmwareTransport&>(_httpTransport)
+                                                         : static_cast<GitFirmwareTransport&>(ownTransport));
+  transport.setTimeout(_timeoutMs);
+
+#if GIT_FIRMWARE_MIRRORS
+  // Best latest.json mirror first, the next one when a request fails
+  uint8_t tried = 0;
+  uint8_t source = _manifestMirrors.pick(millis());
+  int httpCode;
+  for (;;) {
+    // Conditional GET (see below); validators are only sent to the mirror they came from
+    if (source == _manifestSource) {
+      if (_manifestEtag[0] != '\0') {
+        transport.addRequestHeader("If-None-Match", _manifestEtag);
+      }
+      if (_manifestLastModified[0] != '\0') {
+        transport.addRequestHeader("If-Modified-Since", _manifestLastModified);
+      }
+    }
+    uint32_t start = millis();
+    httpCode = transport.open(_manifestUrls[source], false);
+    if (httpCode == HTTP_CODE_OK || httpCode == HTTP_CODE_NOT_MODIFIED) {
+      _manifestMirrors.recordLatency(source, millis() - start);
+      _manifestMirrors.recordSuccess(source);
+      break;
     }
-    beginOk = http.begin(secureClient, _githubUrl);
+    _manifestMirrors.recordFailure(source, millis());
+    tried |= (uint8_t)(1u << source);
+    uint8_t next = _manifestMirrors.pick(millis(), tried);
+    if (next == GitFirmwareMirrors::NONE) {
+      break;
+    }
+    LOGW_F("[GitFirmwareUpdate] latest.json from mirror %u failed (%d), trying mirror %u",
+           source, httpCode, next);
+    transport.close();
+    source = next;
+  }
 #else
-    setError(INVALID_URL, "HTTPS not supported in HTTP-only build");
-    return false;
+  // Conditional GET: validators are only kept while latest.json means "no update",
+  // so 304 can skip the download and the JSON parse
+  if (_manifestEtag[0] != '\0') {
+    transport.addRequestHeader("If-None-Match", _manifestEtag);
+  }
+  if (_manifestLastModified[0] != '\0') {
+    transport.addRequestHeader("If-Modified-Since", _manifestLastModified);
+  }
+
+  int httpCode = transport.open(_githubUrl, false);
 #endif
-  } else {
-    beginOk = http.begin(plainClient, _githubUrl);
+  if (transport.reused()) {
+    LOGD(F("[GitFirmwareUpdate] latest.json requested on kept connection"));
   }
-  
-  if (!beginOk) {
+  if (httpCode == HTTP_CODE_NOT_MODIFIED &&
+      (_manifestEtag[0] != '\0' || _manifestLastModified[0] != '\0')) {
+    transport.close();
+    LOGI(F("[GitFirmwareUpdate] latest.json not modified, no newer version available."));
+    _lastError = NO_UPDATE_AVAILABLE;
+    return false;  // Fields from the last check are still valid
+  }
+
+  _remoteVersion = "";
+  _releaseNotes = "";
+  _firmwareUrl = "";
+  _compression = "";
+  _sha256 = "";
+#if GIT_FIRMWARE_DELTA
+  _deltaFrom = "";
+  _deltaUrl = "";
+  _deltaCompression = "";
+#endif
+#if GIT_FIRMWARE_MIRRORS
+  _firmwareMirrorCount = 0;
+#endif
+  _manifestEtag[0] = '\0';
+  _manifestLastModified[0] = '\0';
+
+  if (httpCode == GitFirmwareTransport::OPEN_FAILED) {
     setError(NETWORK_ERROR, "Failed to begin HTTP connection");
+    transport.close();
     return false;
   }
 
-  int httpCode = http.GET();
   if (httpCode != HTTP_CODE_OK) {
     setError(HTTP_ERROR, "HTTP request failed");
     LOGE_F("[GitFirmwareUpdate] HTTP Error: %d", httpCode);
     
-    // Always call http.end() to free resources
-    // Modern ESP32 HTTPClient handles cleanup safely even after failed connections
-    http.end();
+    // Always close the transport to free resources
+    transport.close();
     
     // For connection failures (-1, -5, etc.), the WiFi stack may be in a bad state
     // Log additional debug info
@@ -95,12 +342,32 @@ bool GitFirmwareUpdate::checkForUpdate() {
     return false;
   }
 
+  // Validators of this response, cached below if it turns out to be "no update"
+  char etag[GitFirmwareTransport::HEADER_VALUE_SIZE] = {0};
+  char lastModified[GitFirmwareTransport::HEADER_VALUE_SIZE] = {0};
+  const char* header = transport.header("ETag");
+  if (header) {
+    strncpy(etag, header, sizeof(etag) - 1);
+  }
+  header = transport.header("Last-Modified");
+  if (header) {
+    strncpy(lastModified, header, sizeof(lastModified) - 1);
+  }
+
   // Parse JSON directly from stream (saves heap allocation for payload string)
   // StaticJsonDocument<512> is sufficient for typical latest.json (~150-200 bytes)
+#if GIT_FIRMWARE_DELTA && GIT_FIRMWARE_MIRRORS
+  StaticJsonDocument<1280> doc;  // "delta" object and "mirrors" array
+#elif GIT_FIRMWARE_DELTA
+  StaticJsonDocument<768> doc;  // "delta" object adds a second URL
+#elif GIT_FIRMWARE_MIRRORS
+  StaticJsonDocument<1024> doc;  // "mirrors" adds up to GIT_FIRMWARE_MAX_MIRRORS - 1 URLs
+#else
   StaticJsonDocument<512> doc;
-  WiFiClient* stream = http.getStreamPtr();
-  auto err = deserializeJson(doc, *stream);
-  http.end();
+#endif
+  TransportStream stream(transport, _timeoutMs);
+  auto err = deserializeJson(doc, stream);
+  transport.close();
   
   LOGD(F("[GitFirmwareUpdate] latest.json parsed from stream"));
   if (err) {
@@ -110,9 +377,38 @@ bool GitFirmwareUpdate::checkForUpdate() {
   }
 
   // Parse JSON with graceful handling of missing keys
-  _remoteVersion = doc["version"] | "";
-  _firmwareUrl = doc["url"] | "";
+  // Zero-heap fields must not truncate a version, URL or digest; notes may be cut
+  bool fits = assignField(_remoteVersion, doc["version"] | "");
+  fits &= assignField(_firmwareUrl, doc["url"] | "");
   _releaseNotes = doc["notes"] | "";
+  fits &= assignField(_compression, doc["compression"] | "");
+  fits &= assignField(_sha256, doc["sha256"] | "");
+#if GIT_FIRMWARE_DELTA
+  // Optional: "delta": { "from": "1.0.4", "url": "...", "compression": "gzip" }
+  fits &= assignField(_deltaFrom, doc["delta"]["from"] | "");
+  fits &= assignField(_deltaUrl, doc["delta"]["url"] | "");
+  fits &= assignField(_deltaCompression, doc["delta"]["compression"] | "");
+#endif
+#if GIT_FIRMWARE_MIRRORS
+  // Optional: "mirrors": ["http://mirror/firmware.bin", ...], the same image as "url"
+  for (JsonVariantConst mirror : doc["mirrors"].as<JsonArrayConst>()) {
+    const char* mirrorUrl = mirror | "";
+    if (_firmwareMirrorCount == GIT_FIRMWARE_MAX_MIRRORS - 1) {
+      LOGW(F("[GitFirmwareUpdate] More mirrors than GIT_FIRMWARE_MAX_MIRRORS, ignoring the rest"));
+      break;
+    }
+    if (mirrorUrl[0] != '\0' && assignField(_firmwareMirrors[_firmwareMirrorCount], mirrorUrl)) {
+      _firmwareMirrorCount++;
+    } else {
+      LOGW_F("[GitFirmwareUpdate] Ignoring mirror '%s'", mirrorUrl);  // Empty or too long
+    }
+  }
+#endif
+  if (!fits) {
+    setError(JSON_PARSE_ERROR, "latest.json field too long");
+    LOGE(F("[GitFirmwareUpdate] latest.json field exceeds GIT_FIRMWARE_URL_SIZE or version size"));
+    return false;
+  }
 
   if (_remoteVersion.length() == 0 || _firmwareUrl.length() == 0) {
     setError(INVALID_VERSION, "Invalid latest.json: missing version or URL");
@@ -120,15 +416,21 @@ bool GitFirmwareUpdate::checkForUpdate() {
     return false;
   }
   
+  uint8_t digest[GitFirmwareSha256::DIGEST_SIZE];
+  if (_sha256.length() > 0 && !GitFirmwareSha256::parseHex(_sha256.c_str(), digest)) {
+    setError(INVALID_VERSION, "Invalid sha256 in latest.json");
+    return false;
+  }
+
   // Optional: Warn if version doesn't match URL tag (e.g., version "1.0.2" but URL has "1.0.1")
   // This is a warning, not an error, as the URL might be correct but tag might differ
-  if (_firmwareUrl.indexOf(_remoteVersion) == -1) {
+  if (!strstr(_firmwareUrl.c_str(), _remoteVersion.c_str())) {
     LOGW_F("[GitFirmwareUpdate] Warning: Version '%s' not found in URL '%s'", 
            _remoteVersion.c_str(), _firmwareUrl.c_str());
   }
 
   // Validate version format (basic check for x.y.z)
-  if (_remoteVersion.indexOf('.') == -1) {
+  if (!strchr(_remoteVersion.c_str(), '.')) {
     setError(INVALID_VERSION, "Invalid version format");
     return false;
   }
@@ -139,10 +441,15 @@ bool GitFirmwareUpdate::checkForUpdate() {
     LOGI_F("[GitFirmwareUpdate] Release Notes: %s", _releaseNotes.c_str());
   }
 
-  int cmp = cmpVersion(_remoteVersion, String(_currentVersion));
+  int cmp = cmpVersion(_remoteVersion.c_str(), _currentVersion);
   if (cmp <= 0) {
     LOGI(F("[GitFirmwareUpdate] No newer version available."));
     _lastError = NO_UPDATE_AVAILABLE;
+    memcpy(_manifestEtag, etag, sizeof(_manifestEtag));
+    memcpy(_manifestLastModified, lastModified, sizeof(_manifestLastModified));
+#if GIT_FIRMWARE_MIRRORS
+    _manifestSource = source;
+#endif
     return false;
   }
 
@@ -151,26 +458,147 @@ bool GitFirmwareUpdate::checkForUpdate() {
 }
 
 bool GitFirmwareUpdate::performUpdate() {
-  if (!checkForUpdate()) {
+  return startUpdate() && runBlocking();
+}
+
+bool GitFirmwareUpdate::downloadAndInstall(const char* url, const char* sha256) {
+  return startDownload(url, sha256) && runBlocking();
+}
+
+bool GitFirmwareUpdate::startUpdate() {
+  if (isBusy()) {
+    LOGW(F("[GitFirmwareUpdate] Update already running"));
     return false;
   }
-
-  return performHttpFirmwareUpdate(_firmwareUrl);
+  _lastError = NO_ERROR;
+  _lastErrorDetail[0] = '\0';
+  _abortFlag = false;
+  _state = STATE_CHECKING;
+  resetTiming();
+  publishProgress();
+  return true;
 }
 
-bool GitFirmwareUpdate::downloadAndInstall(const String& url) {
-  if (url.isEmpty()) {
+bool GitFirmwareUpdate::startDownload(const char* url, const char* sha256) {
+  if (isBusy()) {
+    LOGW(F("[GitFirmwareUpdate] Update already running"));
+    return false;
+  }
+  if (!url || url[0] == '\0') {
     setError(INVALID_URL, "URL is empty");
     return false;
   }
 
-  return performHttpFirmwareUpdate(url);
+  if (sha256 && sha256[0] != '\0') {
+    uint8_t digest[GitFirmwareSha256::DIGEST_SIZE];
+    if (!GitFirmwareSha256::parseHex(sha256, digest)) {
+      setError(INVALID_VERSION, "Invalid sha256");
+      return false;
+    }
+  }
+
+  _abortFlag = false;
+  resetTiming();
+  beginImage(url, nullptr, false, sha256);
+  publishProgress();
+  return _state != STATE_FAILED;
+}
+
+GitFirmwareUpdate::UpdateState GitFirmwareUpdate::poll(uint32_t sliceMs) {
+  bool active = _state == STATE_CHECKING || _state == STATE_CONNECTING ||
+                _state == STATE_DOWNLOADING || _state == STATE_FINISHING;
+  UpdateState previous = _state;
+  uint32_t stepStart = millis();
+  if (active) {
+    lendTlsReserve();  // Taken back below once the update has failed
+  }
+  switch (_state) {
+    case STATE_CHECKING:
+      stepCheck();
+      _timing.checkMs = millis() - stepStart;
+      break;
+    case STATE_CONNECTING:
+      stepConnect();
+      break;
+    case STATE_DOWNLOADING:
+      stepDownload(sliceMs);
+      break;
+    case STATE_FINISHING:
+      stepFinish();
+      _timing.finishMs += millis() - stepStart;
+      break;
+    case STATE_RESTARTING:
+      if (millis() - _stateSince >= RESTART_DELAY_MS) {
+        ESP.restart();
+      }
+      break;
+    default:
+      break;
+  }
+  if (previous == STATE_DOWNLOADING && _state != STATE_DOWNLOADING) {
+    sampleMemory(_memory.download.after);
+  }
+  if (active) {
+    _timing.totalMs = millis() - _updateStartMs;
+    if (_state == STATE_FAILED) {
+      restoreTlsReserve();
+    }
+    if (_state == STATE_FAILED || _state == STATE_RESTARTING) {
+      LOGD_F("[GitFirmwareUpdate] Timing (ms): check %u, dns %u, connect %u, response %u, "
+             "first byte %u, download %u, finish %u, total %u; %u B/s",
+             (unsigned)_timing.checkMs, (unsigned)_timing.dnsMs, (unsigned)_timing.connectMs,
+             (unsigned)_timing.responseMs, (unsigned)_timing.firstByteMs,
+             (unsigned)_timing.downloadMs, (unsigned)_timing.finishMs,
+             (unsigned)_timing.totalMs, (unsigned)_timing.bytesPerSecond);
+#if GIT_FIRMWARE_HISTOGRAM
+      char buckets[160];
+      _histograms.readUs.format(buckets, sizeof(buckets));
+      LOGD_F("[GitFirmwareUpdate] Read us: %s", buckets);
+      _histograms.writeUs.format(buckets, sizeof(buckets));
+      LOGD_F("[GitFirmwareUpdate] Write us: %s", buckets);
+      _histograms.readBytes.format(buckets, sizeof(buckets));
+      LOGD_F("[GitFirmwareUpdate] Read bytes: %s", buckets);
+#endif
+#if DEBUG_LOG_ENABLED
+      const MemoryPhase* phases[] = { &_memory.check, &_memory.sinkBegin, &_memory.download };
+      const char* names[] = { "check", "sink begin", "download" };
+      for (uint8_t i = 0; i < 3; i++) {
+        LOGD_F("[GitFirmwareUpdate] Memory %s (free/largest/stack): %u/%u/%u -> %u/%u/%u", names[i],
+               (unsigned)phases[i]->before.freeHeap, (unsigned)phases[i]->before.largestBlock,
+               (unsigned)phases[i]->before.stackFree, (unsigned)phases[i]->after.freeHeap,
+               (unsigned)phases[i]->after.largestBlock, (unsigned)phases[i]->after.stackFree);
+      }
+#endif
+    }
+  }
+  publishProgress();
+  return _state;
+}
+
+bool GitFirmwareUpdate::runBlocking() {
+  _blocking = true;
+  for (;;) {
+    UpdateState state = poll(UINT32_MAX);
+    if (state == STATE_FAILED || state == STATE_IDLE) {
+      break;
+    }
+    if (state == STATE_CONNECTING || state == STATE_RESTARTING) {
+      delay(10);  // Waiting for the retry / restart delay
+    }
+  }
+  _blocking = false;
+  return false;  // Success restarts the device in poll()
 }
 
 void GitFirmwareUpdate::setProgressCallback(ProgressCallback callback) {
   _progressCallback = callback;
 }
 
+void GitFirmwareUpdate::setProgressThrottle(uint8_t minPercentDelta, uint32_t minIntervalMs) {
+  _progressMinPercent = minPercentDelta;
+  _progressMinIntervalMs = minIntervalMs;
+}
+
 void GitFirmwareUpdate::setServerHandleCallback(ServerHandleCallback callback) {
   _serverHandleCallback = callback;
 }
@@ -185,8 +613,170 @@ void GitFirmwareUpdate::setRetryCount(uint8_t count) {
 
 void GitFirmwareUpdate::setCertificateValidation(bool validate) {
   _validateCert = validate;
+  _httpTransport.setCertificateValidation(validate);
+  if (!isBusy()) {
+    _httpTransport.disconnect();  // A kept connection was set up with the old setting
+  }
+}
+
+void GitFirmwareUpdate::setConnectionReuse(bool reuse) {
+  _httpTransport.setKeepAlive(reuse);
+  if (!reuse && !isBusy()) {
+    _httpTransport.disconnect();
+  }
+}
+
+void GitFirmwareUpdate::setTlsSessionCache(GitFirmwareTlsSessionCache* cache) {
+  _tlsSessions = cache;
+#if !GIT_FIRMWARE_HTTP_ONLY
+  _httpTransport.setTlsSessionCache(cache);
+#endif
+}
+
+void GitFirmwareUpdate::setRedirectCacheTime(uint32_t ttlMs) {
+  _redirectTtlMs = ttlMs;
+}
+
+#if GIT_FIRMWARE_MIRRORS
+void GitFirmwareUpdate::setMirrorProbeBytes(size_t bytes) {
+  _mirrorProbeBytes = bytes;
+}
+#endif
+
+void GitFirmwareUpdate::setPipelineBuffers(uint8_t count) {
+  _pipelineBuffers = count;
+}
+
+void GitFirmwareUpdate::setWriteBlockSize(size_t bytes) {
+  _updateSink.setBlockSize(bytes);
+}
+
+void GitFirmwareUpdate::setYieldInterval(uint32_t intervalMs, size_t intervalBytes) {
+  _yieldPolicy.setIntervals(intervalMs, intervalBytes);
+}
+
+bool GitFirmwareUpdate::reserveMemory() {
+  if (isBusy()) {
+    LOGW(F("[GitFirmwareUpdate] Cannot reserve memory while an update is running"));
+    return false;
+  }
+  releaseMemory();
+
+  // Arena layout: sector buffer | inflate window | pipeline ring (zero-heap
+  // builds keep the first two inside the object already)
+  size_t size = 0;
+#if !GIT_FIRMWARE_ZERO_HEAP
+  size += PartitionSink::SECTOR_SIZE;  // Also the UpdateSink block (4096)
+#if GIT_FIRMWARE_GZIP
+  size_t windowOffset = size;
+  size += GIT_FIRMWARE_INFLATE_WINDOW;
+#endif
+#endif
+#if GIT_FIRMWARE_PIPELINE
+  size_t pipelineOffset = size;
+  uint8_t pipelineBuffers = 0;
+  if (_pipelineBuffers > 0) {
+    pipelineBuffers = _pipelineBuffers < GitFirmwarePipeline::MIN_BUFFERS ? GitFirmwarePipeline::MIN_BUFFERS :
+                      (_pipelineBuffers > GitFirmwarePipeline::MAX_BUFFERS ? GitFirmwarePipeline::MAX_BUFFERS
+                                                                           : _pipelineBuffers);
+    size += pipelineBuffers * PIPELINE_BUF_SIZE;
+  }
+#endif
+  size_t tlsSize = 0;
+#if !GIT_FIRMWARE_HTTP_ONLY
+  tlsSize = GIT_FIRMWARE_TLS_RESERVE;
+#endif
+
+  uint8_t* arena = size > 0 ? (uint8_t*)malloc(size) : nullptr;
+  void* tlsReserve = tlsSize > 0 ? malloc(tlsSize) : nullptr;
+  if ((size > 0 && !arena) || (tlsSize > 0 && !tlsReserve)) {
+    free(arena);
+    free(tlsReserve);
+    LOGE_F("[GitFirmwareUpdate] Cannot reserve %u + %u bytes, FreeHeap=%u, MaxAlloc=%u",
+           (unsigned)size, (unsigned)tlsSize, ESP.getFreeHeap(), ESP.getMaxAllocHeap());
+    return false;
+  }
+
+  _arena = arena;
+  _tlsReserve = tlsReserve;
+#if !GIT_FIRMWARE_ZERO_HEAP
+  _updateSink.setBuffer(_arena, PartitionSink::SECTOR_SIZE);
+  _partitionSink.setBuffer(_arena);  // Only one default sink is used per download
+#if GIT_FIRMWARE_GZIP
+  _arenaWindow = _arena + windowOffset;
+#endif
+#endif
+#if GIT_FIRMWARE_PIPELINE
+  if (pipelineBuffers > 0) {
+    _arenaPipeline = _arena + pipelineOffset;
+    _arenaPipelineBuffers = pipelineBuffers;
+  }
+#endif
+  _memoryReserved = true;
+  LOGI_F("[GitFirmwareUpdate] Reserved %u bytes for updates (+%u for TLS)", (unsigned)size, (unsigned)tlsSize);
+  return true;
+}
+
+void GitFirmwareUpdate::releaseMemory() {
+  if (isBusy()) {
+    LOGW(F("[GitFirmwareUpdate] Cannot release memory while an update is running"));
+    return;
+  }
+#if !GIT_FIRMWARE_ZERO_HEAP
+  _updateSink.setBuffer(nullptr, 0);
+  _partitionSink.setBuffer(nullptr);
+#endif
+  free(_arena);
+  free(_tlsReserve);
+  _arena = nullptr;
+  _arenaWindow = nullptr;
+  _arenaPipeline = nullptr;
+  _arenaPipelineBuffers = 0;
+  _tlsReserve = nullptr;
+  _memoryReserved = false;
+}
+
+bool GitFirmwareUpdate::lendTlsReserve() {
+  if (!_tlsReserve) {
+    return false;
+  }
+  free(_tlsReserve);
+  _tlsReserve = nullptr;
+  return true;
+}
+
+void GitFirmwareUpdate::restoreTlsReserve() {
+#if !GIT_FIRMWARE_HTTP_ONLY
+  if (!_memoryReserved || _tlsReserve || GIT_FIRMWARE_TLS_RESERVE == 0) {
+    return;
+  }
+  _httpTransport.disconnect();  // A kept TLS connection holds the memory the reserve needs
+  _tlsReserve = malloc(GIT_FIRMWARE_TLS_RESERVE);
+  if (!_tlsReserve) {
+    LOGW_F("[GitFirmwareUpdate] TLS reserve not restored, MaxAlloc=%u", ESP.getMaxAllocHeap());
+  }
+#endif
+}
+
+void GitFirmwareUpdate::setTransport(GitFirmwareTransport* transport) {
+  _transport = transport;
+}
+
+void GitFirmwareUpdate::setSink(GitFirmwareSink* sink) {
+  _sink = sink;
+}
+
+void GitFirmwareUpdate::setCheckpointStore(GitFirmwareStore* store, uint32_t intervalBytes) {
+  _store = store;
+  _checkpointInterval = intervalBytes > 0 ? intervalBytes : 65536;
 }
 
+#if GIT_FIRMWARE_PEERS
+void GitFirmwareUpdate::setPeerFinder(GitFirmwarePeerFinder* finder) {
+  _peerFinder = finder;
+}
+#endif
+
 // Static error messages in PROGMEM to save RAM
 static const char ERR_0[] PROGMEM = "No error";
 static const char ERR_1[] PROGMEM = "No update available";
@@ -199,11 +789,12 @@ static const char ERR_7[] PROGMEM = "Flash write operation failed";
 static const char ERR_8[] PROGMEM = "Invalid firmware URL";
 static const char ERR_9[] PROGMEM = "Firmware size validation failed";
 static const char ERR_10[] PROGMEM = "Update was aborted";
+static const char ERR_11[] PROGMEM = "Firmware checksum mismatch";
 static const char ERR_UNK[] PROGMEM = "Unknown error";
 
 static const char* const ERROR_MESSAGES[] PROGMEM = {
   ERR_0, ERR_1, ERR_2, ERR_3, ERR_4, ERR_5, 
-  ERR_6, ERR_7, ERR_8, ERR_9, ERR_10
+  ERR_6, ERR_7, ERR_8, ERR_9, ERR_10, ERR_11
 };
 
 const char* GitFirmwareUpdate::getLastErrorString() const {
@@ -211,12 +802,80 @@ const char* GitFirmwareUpdate::getLastErrorString() const {
   if (_lastErrorDetail[0] != '\0') {
     return _lastErrorDetail;
   }
-  if (_lastError >= 0 && _lastError <= UPDATE_ABORTED) {
+  if (_lastError >= 0 && _lastError <= VERIFY_FAILED) {
     return (const char*)pgm_read_ptr(&ERROR_MESSAGES[_lastError]);
   }
   return ERR_UNK;
 }
 
+#if GIT_FIRMWARE_DELTA
+// Delta source: the image that is currently running (ctx is its esp_partition_t)
+static bool runningPartitionRead(void* ctx, uint32_t offset, uint8_t* buf, size_t len) {
+  const esp_partition_t* partition = static_cast<const esp_partition_t*>(ctx);
+  return esp_partition_read(partition, offset, buf, len) == ESP_OK;
+}
+#endif
+
+// True if a 206 response continues the download at offset: Content-Range must
+// start there, the total must match a known size, and a returned ETag must
+// match the one the prefix came from
+static bool rangeMatches(GitFirmwareTransport& transport, size_t offset, const char* validator,
+                         int totalSize) {
+  const char* range = transport.header("Content-Range");  // "bytes 1000-4999/5000"
+  if (!range || strncmp(range, "bytes ", 6) != 0) {
+    return false;
+  }
+  if ((size_t)strtoul(range + 6, nullptr, 10) != offset) {
+    return false;
+  }
+  const char* total = strchr(range, '/');
+  if (totalSize > 0 && total && total[1] != '*' && strtol(total + 1, nullptr, 10) != totalSize) {
+    return false;
+  }
+  const char* etag = transport.header("ETag");
+  return !etag || validator[0] != '"' || strcmp(etag, validator) == 0;
+}
+
+// Validator of a response for If-Range: strong ETag preferred, weak ETags
+// cannot be used with If-Range (RFC 7233), "" if none
+static void readValidator(GitFirmwareTransport& transport, char* out, size_t size) {
+  // Copied before the next header() call, which may reuse the buffer
+  char etag[GitFirmwareTransport::HEADER_VALUE_SIZE] = {0};
+  const char* header = transport.header("ETag");
+  if (header) {
+    strncpy(etag, header, sizeof(etag) - 1);
+  }
+  const char* lastModified = transport.header("Last-Modified");
+  if (etag[0] != '\0' && strncmp(etag, "W/", 2) != 0) {
+    strncpy(out, etag, size - 1);
+  } else if (lastModified) {
+    strncpy(out, lastModified, size - 1);
+  } else {
+    out[0] = '\0';
+  }
+  out[size - 1] = '\0';
+}
+
+// Feed the first len committed bytes of the sink into hash (after a resume from a checkpoint)
+static bool rehashPrefix(GitFirmwareSink& sink, GitFirmwareSha256& hash, size_t len) {
+  uint8_t buf[512];
+  for (size_t offset = 0; offset < len;) {
+    size_t n = len - offset < sizeof(buf) ? len - offset : sizeof(buf);
+    if (!sink.read(offset, buf, n)) {
+      return false;
+    }
+    hash.update(buf, n);
+    offset += n;
+  }
+  return true;
+}
+
+#if GIT_FIRMWARE_PIPELINE
+// Wait per transport read in the reader task (only the reader polls, so this can be long)
+static const uint32_t PIPELINE_READ_WAIT_MS = 20;
+
+#endif
+
 // Parse version string "x.y.z" without sscanf (saves ~2-5KB by avoiding scanf family)
 static void parseVersion(const char* s, int v[3]) {
   v[0] = v[1] = v[2] = 0;
@@ -233,334 +892,1210 @@ static void parseVersion(const char* s, int v[3]) {
   }
 }
 
-int GitFirmwareUpdate::cmpVersion(const String& a, const String& b) {
+int GitFirmwareUpdate::cmpVersion(const char* a, const char* b) {
   int ma[3], mb[3];
-  parseVersion(a.c_str(), ma);
-  parseVersion(b.c_str(), mb);
+  parseVersion(a, ma);
+  parseVersion(b, mb);
   for (int i = 0; i < 3; i++) {
     if (ma[i] != mb[i]) return ma[i] - mb[i];
   }
   return 0;
 }
 
-bool GitFirmwareUpdate::performHttpFirmwareUpdate(const String& url) {
-  if (url.isEmpty()) {
-    setError(INVALID_URL, "URL is empty");
-    return false;
+void GitFirmwareUpdate::stepCheck() {
+  if (!checkForUpdate()) {
+    _state = STATE_FAILED;
+    return;
   }
 
-#if GIT_FIRMWARE_HTTP_ONLY
-  if (url.startsWith("https://")) {
-    setError(INVALID_URL, "HTTPS not supported in HTTP-only build");
-    _isUpdating = false;
-    return false;
+#if GIT_FIRMWARE_DELTA
+  // A patch only applies to the exact image it was made against (checked again via CRC32)
+  if (_deltaUrl.length() > 0 && strcmp(_deltaFrom.c_str(), _currentVersion) == 0) {
+    LOGI_F("[GitFirmwareUpdate] Delta patch available from %s", _currentVersion);
+    // The patched output is the full image, so the same digest applies
+    beginImage(_deltaUrl.c_str(), _deltaCompression.c_str(), true, _sha256.c_str());
+    return;
   }
 #endif
 
-  _isUpdating = true;
-  _abortFlag = false;
+#if GIT_FIRMWARE_PEERS
+  if (beginPeerImage()) {
+    return;
+  }
+#endif
+  beginFullImage();
+}
+
+void GitFirmwareUpdate::beginImage(const char* url, const char* compression, bool delta,
+                                   const char* sha256) {
+  bool urlFits = assignField(_imageUrl, url);
+  _imageCompression = compression ? compression : "";
+  _imageDelta = delta;
+#if GIT_FIRMWARE_PEERS
+  _imagePeer = false;  // Set by beginPeerImage()
+#endif
+  _resumable = false;
   _lastError = NO_ERROR;
   _lastErrorDetail[0] = '\0';
+#if GIT_FIRMWARE_MIRRORS
+  _imageSources = 1;  // beginFullImage() adds the mirrors
+  _mirror = 0;
+  _mirrorsTried = 0;
+  _validatorMirror = GitFirmwareMirrors::NONE;
+  _mirrorProbePending = false;
+#endif
 
-  LOGI_F("[GitFirmwareUpdate] Starting firmware update from: %s", url.c_str());
-
-  uint8_t retryAttempt = 0;
-  bool success = false;
-
-  while (retryAttempt <= _retryCount && !success && !_abortFlag) {
-    if (retryAttempt > 0) {
-      LOGW_F("[GitFirmwareUpdate] Retry attempt %u/%u", retryAttempt, _retryCount);
-      delay(1000);  // Wait before retry
-    }
+  if (_imageUrl.length() == 0) {
+    setError(INVALID_URL, "URL is empty");
+    failImage();
+    return;
+  }
+  if (!urlFits) {
+    setError(INVALID_URL, "URL exceeds GIT_FIRMWARE_URL_SIZE");
+    failImage();
+    return;
+  }
 
-    // Use appropriate client based on URL scheme (HTTP vs HTTPS)
-    // HTTP saves ~30 KB heap by avoiding TLS buffers
-    // IMPORTANT: Declare clients BEFORE HTTPClient to ensure correct destructor order
-    // (HTTPClient must be destroyed first while client is still valid)
-    bool isHttps = url.startsWith("https://");
-#if !GIT_FIRMWARE_HTTP_ONLY
-    WiFiClientSecure secureClient;
-#endif
-    WiFiClient plainClient;
-    
-    HTTPClient http;
-    http.setTimeout(_timeoutMs);
-    http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);  // Important for GitHub redirects
-    http.setReuse(false);  // Disable connection reuse for stability
-    
-    LOGI(F("[GitFirmwareUpdate] Connecting to server..."));
-    bool beginOk = false;
-    if (isHttps) {
-#if !GIT_FIRMWARE_HTTP_ONLY
-      if (!_validateCert) {
-        secureClient.setInsecure();  // Skip certificate validation
-      }
-      beginOk = http.begin(secureClient, url);
-#else
-      setError(INVALID_URL, "HTTPS not supported in HTTP-only build");
-      retryAttempt++;
-      continue;
+#if GIT_FIRMWARE_HTTP_ONLY
+  if (strncmp(url, "https://", 8) == 0) {
+    setError(INVALID_URL, "HTTPS not supported in HTTP-only build");
+    failImage();
+    return;
+  }
 #endif
-    } else {
-      beginOk = http.begin(plainClient, url);
-    }
-    
-    if (!beginOk) {
-      setError(NETWORK_ERROR, "Failed to begin HTTP connection");
-      retryAttempt++;
-      continue;
-    }
 
-    LOGI(F("[GitFirmwareUpdate] Downloading firmware..."));
-    int httpCode = http.GET();
-    LOGD_F("[GitFirmwareUpdate] HTTP Code: %d", httpCode);
-    
-    if (httpCode != HTTP_CODE_OK) {
-      setError(HTTP_ERROR, "HTTP request failed");
-      LOGE_F("[GitFirmwareUpdate] HTTP Error, Code=%d", httpCode);
-      
-      // Always call http.end() to free resources
-      // Modern ESP32 HTTPClient handles cleanup safely even after failed connections
-      http.end();
-      
-      // For connection failures, log debug info
-      if (httpCode < 0) {
-        LOGE_F("[GitFirmwareUpdate] Connection failed. FreeHeap: %u",
-               ESP.getFreeHeap());
-      }
-      
-      // Always abort Update if it was started
-      if (Update.isRunning()) {
-        Update.abort();
+  _isUpdating = true;
+
+  LOGI_F("[GitFirmwareUpdate] Starting firmware update from: %s", url);
+
+  // Download state outlives a failed attempt: after a dropped connection the
+  // next attempt continues at _dl.totalRead with a Range request instead of
+  // starting over. Decoders keep their state, so this works for compressed
+  // images and delta patches too.
+  // With a checkpoint store the default sink must be able to resume after a reboot;
+  // with reserved memory or zero-heap it writes from the reserved / inline sector
+  // (Update.begin() allocates)
+  bool preallocated = GIT_FIRMWARE_ZERO_HEAP || _memoryReserved;
+  _imageSink = _sink ? _sink : ((_store || preallocated) ? static_cast<GitFirmwareSink*>(&_partitionSink)
+                                                         : static_cast<GitFirmwareSink*>(&_updateSink));
+  GitFirmwareSink& sink = *_imageSink;
+  DownloadContext& dl = _dl;
+  dl = DownloadContext();
+  _retryAttempt = 0;
+  _validator[0] = '\0';
+  _hasContentLength = false;
+  _contentLength = 0;
+  // Image hash runs over everything written to the sink (after inflate / patch)
+  _verify = sha256 && GitFirmwareSha256::parseHex(sha256, _expectedDigest);
+
+  // Continue an image interrupted by a reboot (raw images only, see saveCheckpoint())
+  if (_store && !delta) {
+    GitFirmwareCheckpoint checkpoint;
+    if (checkpoint.load(*_store)) {
+      if (strcmp(checkpoint.url, url) == 0 &&
+          strncmp(checkpoint.fromVersion, _currentVersion, sizeof(checkpoint.fromVersion) - 1) == 0 &&
+          sink.resume(checkpoint.totalSize > 0 ? checkpoint.totalSize : 0, checkpoint.offset)) {
+        strncpy(_validator, checkpoint.validator, sizeof(_validator) - 1);
+        dl.self = this;
+        dl.sink = &sink;
+        dl.abortFlag = &_abortFlag;
+        dl.url = _imageUrl.c_str();
+        dl.validator = _validator;
+        dl.totalRead = checkpoint.offset;
+        dl.lastCheckpoint = checkpoint.offset;
+        _resumable = true;
+        if (_verify) {
+          // Hash state is not persisted: rebuild it from the prefix on flash
+          _hash.begin();
+          dl.hash = &_hash;
+          if (!rehashPrefix(sink, _hash, checkpoint.offset)) {
+            LOGW(F("[GitFirmwareUpdate] Cannot read back partial image, restarting"));
+            discardImage(sink);
+            dl = DownloadContext();
+            _resumable = false;
+          }
+        }
+        if (_resumable) {
+          LOGI_F("[GitFirmwareUpdate] Continuing interrupted update at byte %u", (unsigned)checkpoint.offset);
+        }
+      } else {
+        LOGW(F("[GitFirmwareUpdate] Discarding stale update checkpoint"));
+        GitFirmwareCheckpoint::clear(*_store);
       }
-      retryAttempt++;
-      continue;
     }
+  }
 
-    int contentLength = http.getSize();
-    bool hasContentLength = contentLength > 0;
+  _state = STATE_CONNECTING;
+}
 
-    if (hasContentLength) {
-      LOGI_F("[GitFirmwareUpdate] Content-Length: %d Bytes", contentLength);
-      _totalBytes = contentLength;
+void GitFirmwareUpdate::beginFullImage() {
+  beginImage(_firmwareUrl.c_str(), _compression.c_str(), false, _sha256.c_str());
+#if GIT_FIRMWARE_MIRRORS
+  if (_state != STATE_CONNECTING || _firmwareMirrorCount == 0) {
+    return;
+  }
+  const char* urls[GIT_FIRMWARE_MAX_MIRRORS];
+  urls[0] = _imageUrl.c_str();
+  for (uint8_t i = 0; i < _firmwareMirrorCount; i++) {
+    urls[i + 1] = _firmwareMirrors[i].c_str();
+  }
+  _imageSources = _firmwareMirrorCount + 1;
+  _imageMirrors.assign(urls, _imageSources);
+  _mirror = _imageMirrors.pick(millis());
+  _mirrorProbePending = _mirrorProbeBytes > 0;
+  LOGI_F("[GitFirmwareUpdate] %u image mirrors", _firmwareMirrorCount);
+#endif
+}
+
+#if GIT_FIRMWARE_PEERS
+bool GitFirmwareUpdate::beginPeerImage() {
+  // Peers are untrusted: only an image the digest can verify
+  if (!_peerFinder || _sha256.length() == 0) {
+    return false;
+  }
+  char url[112];  // "http://<ip>:<port>/gitfw/<sha256>.bin"
+  if (!_peerFinder->find(_sha256.c_str(), url, sizeof(url)) || strlen(url) >= GIT_FIRMWARE_URL_SIZE) {
+    LOGD(F("[GitFirmwareUpdate] No LAN peer has the image"));
+    return false;
+  }
+  LOGI(F("[GitFirmwareUpdate] Image available from a LAN peer"));
+  // Peers serve the raw image, whatever "compression" the latest.json URL has
+  beginImage(url, nullptr, false, _sha256.c_str());
+  _imagePeer = _state == STATE_CONNECTING;
+  return true;
+}
+#endif
+
+#if GIT_FIRMWARE_MIRRORS
+const char* GitFirmwareUpdate::imageSource(uint8_t index) const {
+  return index == 0 ? _imageUrl.c_str() : _firmwareMirrors[index - 1].c_str();
+}
+
+bool GitFirmwareUpdate::splicesMirrors() const {
+  return _verify && _validatorMirror != GitFirmwareMirrors::NONE && _validatorMirror != _mirror;
+}
+
+void GitFirmwareUpdate::probeMirrors(GitFirmwareTransport& transport) {
+  char range[32];
+  snprintf(range, sizeof(range), "bytes=0-%u", (unsigned)(_mirrorProbeBytes - 1));
+  uint8_t buf[512];
+  for (uint8_t i = 0; i < _imageSources && !_abortFlag; i++) {
+    if (_imageMirrors.stats(i).bytesPerSecond > 0 || !_imageMirrors.healthy(i, millis())) {
+      continue;
+    }
+    transport.addRequestHeader("Range", range);
+    uint32_t start = millis();
+    int httpCode = transport.open(imageSource(i), true);
+    uint32_t headersMs = millis();
+    if (httpCode != HTTP_CODE_OK && httpCode != HTTP_CODE_PARTIAL_CONTENT) {
+      LOGW_F("[GitFirmwareUpdate] Mirror %u probe failed (%d)", i, httpCode);
+      _imageMirrors.recordFailure(i, headersMs);
+      transport.close();
+      continue;
+    }
+    _imageMirrors.recordLatency(i, headersMs - start);
+    size_t received = 0;
+    uint32_t lastDataMs = headersMs;
+    while (received < _mirrorProbeBytes && !_abortFlag && millis() - lastDataMs < _timeoutMs) {
+      size_t want = _mirrorProbeBytes - received < sizeof(buf) ? _mirrorProbeBytes - received : sizeof(buf);
+      int c = transport.read(buf, want, READ_WAIT_MS);
+      if (c < 0) {
+        break;  // End of the (ranged) body or connection lost
+      }
+      if (c > 0) {
+        received += c;
+        lastDataMs = millis();
+      }
+    }
+    uint32_t elapsed = millis() - headersMs;
+    transport.close();  // Not reusable after a partial 200 body
+    _imageMirrors.recordThroughput(i, received, elapsed > 0 ? elapsed : 1);
+    LOGI_F("[GitFirmwareUpdate] Mirror %u: %u ms to headers, %u bytes in %u ms",
+           i, (unsigned)(headersMs - start), (unsigned)received, (unsigned)elapsed);
+  }
+}
+
+bool GitFirmwareUpdate::mirrorCollapsed(DownloadContext& dl) {
+  if (_imageSources < 2 || dl.collapsed) {
+    return dl.collapsed;
+  }
+  uint32_t now = millis();
+  uint32_t elapsed = now - dl.windowStartMs;
+  if (elapsed < MIRROR_WINDOW_MS) {
+    return false;
+  }
+  size_t bytes = dl.received - dl.windowBytes;
+  uint32_t rate = (uint32_t)((uint64_t)bytes * 1000 / elapsed);
+  dl.windowStartMs = now;
+  dl.windowBytes = dl.received;
+
+  size_t done = _downloadStartBytes + dl.received;
+  if (_hasContentLength && done + MIRROR_SWITCH_MIN_LEFT > (size_t)_contentLength) {
+    return false;
+  }
+  uint8_t other = _imageMirrors.pick(now, (uint8_t)(_mirrorsTried | (1u << _mirror)));
+  if (other == GitFirmwareMirrors::NONE || !_imageMirrors.healthy(other, now) ||
+      (uint64_t)rate * MIRROR_SWITCH_RATIO >= _imageMirrors.stats(other).bytesPerSecond) {
+    return false;
+  }
+  _imageMirrors.recordThroughput(_mirror, bytes, elapsed);
+  dl.collapsed = true;
+  return true;
+}
+
+bool GitFirmwareUpdate::failoverMirror() {
+  // Aborts and flash / memory failures are not the mirror's fault
+  if (_imageSources < 2 || _lastError == UPDATE_ABORTED || _lastError == UPDATE_SIZE_ERROR ||
+      _lastError == FLASH_FAILED) {
+    return false;
+  }
+  uint32_t now = millis();
+  if (!_dl.collapsed) {
+    _imageMirrors.recordFailure(_mirror, now);  // A slow mirror only lost its throughput rank
+  }
+  _dl.collapsed = false;
+  _mirrorsTried |= (uint8_t)(1u << _mirror);
+  uint8_t next = _imageMirrors.pick(now, _mirrorsTried);
+  if (next == GitFirmwareMirrors::NONE) {
+    return false;
+  }
+  LOGW_F("[GitFirmwareUpdate] Continuing on mirror %u after mirror %u", next, _mirror);
+  _mirror = next;
+  _stateSince = now;
+  _state = STATE_CONNECTING;
+  return true;
+}
+#endif
+
+void GitFirmwareUpdate::stepConnect() {
+  GitFirmwareSink& sink = *_imageSink;
+  DownloadContext& dl = _dl;
+
+  if (_abortFlag) {
+    setError(UPDATE_ABORTED, "Update aborted by user");
+    discardImage(sink);
+    _resumable = false;
+    failImage();
+    return;
+  }
+
+  if (_retryAttempt > 0 && millis() - _stateSince < RETRY_DELAY_MS) {
+    return;  // Wait before retry
+  }
+
+  GitFirmwareTransport& transport = activeTransport();
+  transport.setTimeout(_timeoutMs);
+
+#if GIT_FIRMWARE_MIRRORS
+  if (_mirrorProbePending) {
+    _mirrorProbePending = false;
+    probeMirrors(transport);
+    _mirror = _imageMirrors.pick(millis());
+  }
+  const char* url = imageSource(_mirror);
+  if (_imageSources > 1) {
+    LOGI_F("[GitFirmwareUpdate] Using mirror %u: %s", _mirror, url);
+  }
+#else
+  const char* url = _imageUrl.c_str();
+#endif
+  // Skip the redirect hop with a recently resolved target; it may have
+  // expired meanwhile (4xx), then the original URL resolves a new one
+  const char* target = cachedRedirect(url);
+  int httpCode;
+  if (target) {
+    LOGD_F("[GitFirmwareUpdate] Using cached redirect target: %s", target);
+    httpCode = openImage(transport, target);
+    if (httpCode >= 400 && httpCode < 500) {
+      LOGI_F("[GitFirmwareUpdate] Cached redirect target answered %d, requesting original URL", httpCode);
+      transport.close();
+      assignField(_redirectUrl, "");
+      target = nullptr;
+    }
+  }
+  if (!target) {
+    httpCode = openImage(transport, url);
+    if (httpCode == HTTP_CODE_OK || httpCode == HTTP_CODE_PARTIAL_CONTENT) {
+      const char* finalUrl = transport.finalUrl();
+      uint32_t key = gitFirmwareCrc32(0, (const uint8_t*)url, strlen(url));
+      if (_redirectTtlMs > 0 && finalUrl && assignField(_redirectUrl, finalUrl)) {
+        _redirectKey = key;
+        _redirectSince = millis();
+      } else if (_redirectKey == key) {
+        assignField(_redirectUrl, "");  // No longer redirected (or target too long)
+      }
+    }
+  }
+  LOGD_F("[GitFirmwareUpdate] HTTP Code: %d%s", httpCode, transport.reused() ? " (kept connection)" : "");
+  GitFirmwareTransport::Timing openTiming = transport.timing();
+  _timing.dnsMs = openTiming.dnsMs;
+  _timing.connectMs = openTiming.connectMs;
+  _timing.responseMs = openTiming.responseMs;
+#if GIT_FIRMWARE_MIRRORS
+  if (_imageSources > 1 && httpCode > 0) {
+    _imageMirrors.recordLatency(_mirror, openTiming.dnsMs + openTiming.connectMs + openTiming.responseMs);
+  }
+#endif
+
+  if (httpCode == GitFirmwareTransport::OPEN_FAILED) {
+    setError(NETWORK_ERROR, "Failed to begin HTTP connection");
+    transport.close();
+    retryImage();
+    return;
+  }
+
+  bool resumed = false;
+  if (_resumable && httpCode == HTTP_CODE_PARTIAL_CONTENT) {
+    const char* validator = _validator;
+#if GIT_FIRMWARE_MIRRORS
+    if (splicesMirrors()) {
+      validator = "";  // Another server's validator; the SHA-256 checks the splice
+    }
+#endif
+    resumed = rangeMatches(transport, dl.totalRead, validator, _hasContentLength ? _contentLength : 0);
+    if (!resumed) {
+      LOGW(F("[GitFirmwareUpdate] Partial response does not continue the download"));
+      httpCode = HTTP_CODE_RANGE_NOT_SATISFIABLE;  // Handled as error below, restarts from 0
+    }
+  }
+  
+  if (httpCode != HTTP_CODE_OK && !resumed) {
+    setError(HTTP_ERROR, "HTTP request failed");
+    LOGE_F("[GitFirmwareUpdate] HTTP Error, Code=%d", httpCode);
+    
+    // Always close the transport to free resources
+    transport.close();
+    
+    // For connection failures, log debug info
+    if (httpCode < 0) {
+      LOGE_F("[GitFirmwareUpdate] Connection failed. FreeHeap: %u",
+             ESP.getFreeHeap());
+    }
+    
+    // Keep a resumable prefix for transient errors; a rejected range starts over
+    if (!_resumable || httpCode == HTTP_CODE_RANGE_NOT_SATISFIABLE) {
+      discardImage(sink);
+      _resumable = false;
+    }
+    retryImage();
+    return;
+  }
+
+  if (_resumable && !resumed) {
+    // 200 to a Range request: range unsupported or the file changed
+    LOGW(F("[GitFirmwareUpdate] Server sent the full file, restarting download"));
+    discardImage(sink);
+    _resumable = false;
+  }
+
+  if (resumed) {
+    // 206: Content-Length is the remaining part
+    int32_t remaining = transport.size();
+    _hasContentLength = remaining > 0;
+    _contentLength = _hasContentLength ? (int)(dl.totalRead + remaining) : 0;
+    dl.contentLength = _contentLength;
+    dl.transport = &transport;
+    _totalBytes = _hasContentLength ? _contentLength : 0;
+    LOGI_F("[GitFirmwareUpdate] Resumed, %d of %d Bytes remaining", (int)remaining, _contentLength);
+#if GIT_FIRMWARE_MIRRORS
+    if (splicesMirrors()) {
+      readValidator(transport, _validator, sizeof(_validator));  // Further resumes go to this mirror
+      _validatorMirror = _mirror;
+    }
+#endif
+  } else {
+    LOGI(F("[GitFirmwareUpdate] Downloading firmware..."));
+
+    // Compressed image: Content-Encoding wins, then the latest.json "compression" field
+    const char* encoding = transport.header("Content-Encoding");
+    if (!encoding || encoding[0] == '\0') {
+      encoding = _imageCompression.c_str();
+    }
+    bool compressed = false;
+#if GIT_FIRMWARE_GZIP
+    GitFirmwareInflater::Format format = GitFirmwareInflater::FORMAT_AUTO;
+    compressed = GitFirmwareInflater::formatFromName(encoding, format);
+#else
+    if (encoding && encoding[0] != '\0' && strcmp(encoding, "identity") != 0 &&
+        strcmp(encoding, "none") != 0) {
+      setError(DOWNLOAD_FAILED, "Compressed firmware not supported in this build");
+      LOGE_F("[GitFirmwareUpdate] Encoding '%s' requires GIT_FIRMWARE_USE_GZIP", encoding);
+      failImage();
+      return;
+    }
+#endif
+    if (compressed) {
+      LOGI_F("[GitFirmwareUpdate] Compressed image (%s), inflating on the fly", encoding);
+    }
+
+    _contentLength = transport.size();
+    _hasContentLength = _contentLength > 0;
+
+    if (_hasContentLength) {
+      LOGI_F("[GitFirmwareUpdate] Content-Length: %d Bytes", _contentLength);
+      _totalBytes = _contentLength;
     } else {
       LOGI(F("[GitFirmwareUpdate] No Content-Length (chunked or unknown)"));
       _totalBytes = 0;
     }
-    
+  
     // Reset progress tracking
     _currentBytesRead = 0;
     _currentPercent = 0;
 
-    Stream* stream = http.getStreamPtr();
+    readValidator(transport, _validator, sizeof(_validator));
+#if GIT_FIRMWARE_MIRRORS
+    _validatorMirror = _mirror;
+#endif
 
     // Initialize update with retry logic for memory allocation
     // The ESP32 Update library needs a large contiguous memory block
-    // Memory fragmentation can cause allocation failures, so we retry with delays
+    // Memory fragmentation can cause allocation failures, so we retry with delays.
+    // Reserved memory and zero-heap allocate nothing here, so a failure is final.
     bool updateStarted = false;
     int beginRetries = 0;
-    const int MAX_BEGIN_RETRIES = 5;
+    const int MAX_BEGIN_RETRIES = (GIT_FIRMWARE_ZERO_HEAP || _memoryReserved) ? 1 : 5;
 
+    sampleMemory(_memory.sinkBegin.before);
     while (!updateStarted && beginRetries < MAX_BEGIN_RETRIES) {
       if (beginRetries > 0) {
         delay(200); // Wait before retry to allow memory to settle
       }
-      
-      updateStarted = Update.begin(hasContentLength ? contentLength : (int)UPDATE_SIZE_UNKNOWN);
-      
+    
+      // Content-Length of a compressed image or a patch is not the image size
+      updateStarted = sink.begin((_hasContentLength && !compressed && !_imageDelta) ? _contentLength : 0);
+    
       if (!updateStarted) {
         beginRetries++;
-        LOGW_F("[GitFirmwareUpdate] Update.begin() failed (attempt %d/%d), Error=%u, FreeHeap=%u", 
-               beginRetries, MAX_BEGIN_RETRIES, Update.getError(), ESP.getFreeHeap());
+        LOGW_F("[GitFirmwareUpdate] Update.begin() failed (attempt %d/%d), Error=%d, FreeHeap=%u", 
+               beginRetries, MAX_BEGIN_RETRIES, sink.getError(), ESP.getFreeHeap());
       }
     }
+    sampleMemory(_memory.sinkBegin.after);
 
     if (!updateStarted) {
       setError(UPDATE_SIZE_ERROR, "Update.begin() failed after retries");
-      LOGE_F("[GitFirmwareUpdate] Update.begin() failed after %d attempts, Error=%u, FreeHeap=%u", 
-             MAX_BEGIN_RETRIES, Update.getError(), ESP.getFreeHeap());
-      // Safe cleanup: http.end() is safe here since we haven't started GET yet
-      http.end();
-      retryAttempt++;
-      continue;
+      LOGE_F("[GitFirmwareUpdate] Update.begin() failed after %d attempts, Error=%d, FreeHeap=%u", 
+             MAX_BEGIN_RETRIES, sink.getError(), ESP.getFreeHeap());
+      transport.close();
+      retryImage();
+      return;
     }
 
-    // Reduced buffer size saves 1KB stack (1024 vs 2048 is sufficient for ESP32 flash writes)
-    const size_t BUF_SIZE = 1024;
-    uint8_t buff[BUF_SIZE];
-
-    size_t totalRead = 0;
-    int lastPercent = -1;
+    dl = DownloadContext();  // Zero all fields, including optional ones
+    dl.self = this;
+    dl.transport = &transport;
+    dl.sink = &sink;
+    dl.contentLength = _contentLength;
+    dl.abortFlag = &_abortFlag;
+    dl.url = _imageUrl.c_str();
+    dl.validator = _validator;
+    if (_verify) {
+      _hash.begin();
+      dl.hash = &_hash;
+    }
+    if (compressed) {
+#if GIT_FIRMWARE_GZIP
+#if GIT_FIRMWARE_ZERO_HEAP
+      uint8_t* window = _inflateWindow;
+#else
+      uint8_t* window = _arenaWindow;  // nullptr: allocated here, freed when the download ends
+#endif
+      if (!_inflater.begin(format, inflateOutput, &dl, window)) {
+        setError(UPDATE_SIZE_ERROR, "Inflate window allocation failed");
+        LOGE_F("[GitFirmwareUpdate] Inflate window allocation failed, FreeHeap=%u", ESP.getFreeHeap());
+        discardImage(sink);
+        transport.close();
+        retryImage();
+        return;
+      }
+      dl.inflater = &_inflater;
+#endif
+    }
+#if GIT_FIRMWARE_DELTA
+    if (_imageDelta) {
+      const esp_partition_t* running = esp_ota_get_running_partition();
+      if (!running) {
+        setError(DOWNLOAD_FAILED, "Running partition not found");
+        discardImage(sink);
+        failImage();
+        return;
+      }
+      _patcher.begin(runningPartitionRead, (void*)running, running->size, deltaOutput, &dl);
+      dl.patcher = &_patcher;
+      LOGI_F("[GitFirmwareUpdate] Applying delta patch against partition %s", running->label);
+    }
+#endif
 
     LOGI(F("[GitFirmwareUpdate] Starting download & flash..."));
-    reportProgress(0, hasContentLength ? contentLength : 0);
-
-    while (http.connected() && !_abortFlag) {
-      // Wait for data
-      if (!stream->available()) {
-        if (!http.connected()) break;
-        delay(1);
-        continue;
-      }
+    reportProgress(0, _hasContentLength ? _contentLength : 0, true);
+  }
 
-      size_t avail = stream->available();
-      size_t toRead = (avail > BUF_SIZE) ? BUF_SIZE : avail;
+  dl.lastDataMs = millis();
+  _yieldPolicy.reset(dl.lastDataMs);
+  _headersMs = dl.lastDataMs;
+  _downloadStartBytes = dl.totalRead;
+  _rateWindowMs = dl.lastDataMs;
+  _rateWindowBytes = dl.totalRead;
+  _bytesPerSecond = 0;
+  _timing.firstByteMs = 0;
+  _timing.downloadMs = 0;
+  _timing.bytesPerSecond = 0;
+#if GIT_FIRMWARE_MIRRORS
+  dl.received = 0;
+  dl.windowStartMs = dl.lastDataMs;
+  dl.windowBytes = 0;
+  dl.collapsed = false;
+#endif
+  sampleMemory(_memory.download.before);
+  _state = STATE_DOWNLOADING;
+}
 
-      int c = stream->readBytes(buff, toRead);
-      if (c <= 0) {
-        LOGE(F("[GitFirmwareUpdate] Read error from stream"));
-        break;
+void GitFirmwareUpdate::stepDownload(uint32_t sliceMs) {
+  GitFirmwareTransport& transport = activeTransport();
+  GitFirmwareSink& sink = *_imageSink;
+  DownloadContext& dl = _dl;
+  bool readFailed = false;
+  bool ended = false;  // Body ended, failed or was rejected: evaluated below
+
+#if GIT_FIRMWARE_PIPELINE
+  // The pipeline runs until the body ends, so it is only used by the blocking calls
+  if (_blocking && _pipelineBuffers > 0) {
+    // Reserved ring if it is large enough, else allocated by run()
+    GitFirmwarePipeline pipeline(_pipelineBuffers, PIPELINE_BUF_SIZE,
+                                 _pipelineBuffers <= _arenaPipelineBuffers ? _arenaPipeline : nullptr);
+    GitFirmwarePipeline::Result result =
+      pipeline.run(pipelineRead, &dl, pipelineWrite, &dl, &_abortFlag);
+
+    if (result == GitFirmwarePipeline::PIPELINE_SETUP_FAILED) {
+      // Nothing consumed yet: fall back to the sequential loop below
+      LOGW_F("[GitFirmwareUpdate] Pipeline setup failed, FreeHeap=%u - using sequential mode",
+             ESP.getFreeHeap());
+    } else {
+      ended = true;
+      LOGD_F("[GitFirmwareUpdate] Pipeline done, result=%d, max queue depth=%u",
+             (int)result, pipeline.getMaxQueueDepth());
+      if (result == GitFirmwarePipeline::PIPELINE_WRITE_ERROR && !dl.corrupt) {
+        // Safe cleanup: abort sink before closing the transport
+        discardImage(sink);
+        _resumable = false;
+        failImage();
+        return;
       }
-
-      if (Update.write(buff, c) != (size_t)c) {
-        setError(FLASH_FAILED, "Update.write() failed");
-        LOGE_F("[GitFirmwareUpdate] Update.write() error: %u", Update.getError());
-        // Safe cleanup: abort Update before ending HTTP
-        Update.abort();
-        // Safe cleanup: http.end() is safe here since GET succeeded
-        http.end();
-        _isUpdating = false;
-        _currentBytesRead = 0;
-        _totalBytes = 0;
-        _currentPercent = 0;
-        return false;
+      if (result == GitFirmwarePipeline::PIPELINE_READ_ERROR) {
+        LOGE(F("[GitFirmwareUpdate] Read error from stream"));
+        readFailed = true;
       }
+    }
+  }
+#endif
 
-      totalRead += c;
-      
-      // Calculate and report progress
-      int percent = 0;
-      if (hasContentLength && contentLength > 0) {
-        percent = (int)((totalRead * 100) / contentLength);
-        percent = constrain(percent, 0, 100);
-      }
-      
-      // Update progress tracking
-      _currentBytesRead = totalRead;
-      if (hasContentLength) {
-        _currentPercent = percent;
-      }
-      
-      // Report progress via callback
-      reportProgress(totalRead, hasContentLength ? contentLength : 0);
+  // Reduced buffer size saves 1KB stack (1024 vs 2048 is sufficient for ESP32 flash writes)
+  const size_t BUF_SIZE = 1024;
+  uint8_t buff[BUF_SIZE];
+  uint32_t sliceStart = millis();
+  _yieldPolicy.restart(sliceStart);  // Time outside poll() is not a stretch of this loop
+
+  while (!ended && !_abortFlag) {
+    // Sleep until data arrives, at most until the time slice ends or READ_WAIT_MS
+    uint32_t elapsed = millis() - sliceStart;
+    uint32_t waitMs = sliceMs > elapsed ? sliceMs - elapsed : 0;
+    if (waitMs > READ_WAIT_MS) waitMs = READ_WAIT_MS;
+#if GIT_FIRMWARE_HISTOGRAM
+    uint32_t readStart = micros();
+#endif
+    int c = transport.read(buff, BUF_SIZE, waitMs);
+#if GIT_FIRMWARE_HISTOGRAM
+    if (c > 0) {
+      _histograms.readUs.add(micros() - readStart);
+      _histograms.readBytes.add(c);
+    }
+#endif
+    if (c == 0 && waitMs > 0) {
+      _yieldPolicy.yielded(millis());  // Slept on the socket
+    }
+    if (c == GitFirmwareTransport::READ_EOF) {
+      break;
+    }
+    if (c < 0) {
+      LOGE(F("[GitFirmwareUpdate] Read error from stream"));
+      readFailed = true;
+      break;
+    }
 
-      // Call server handle callback to keep WebServer responsive (for progress polling)
-      if (_serverHandleCallback) {
-        _serverHandleCallback();
-      }
+    if (c == 0 && millis() - dl.lastDataMs >= _timeoutMs) {
+      LOGE_F("[GitFirmwareUpdate] No data for %u ms", (unsigned)_timeoutMs);
+      readFailed = true;
+      break;
+    }
 
-      // Cooperative yield: allow other tasks (like async_tcp) to run and reset watchdog
-      // This prevents watchdog timeout during long downloads
-      // Only yield every ~10KB to avoid excessive context switches
-      if ((totalRead % 10240) == 0) {
-        yield();  // Cooperative yield to FreeRTOS scheduler
+    if (c > 0) {
+      dl.lastDataMs = millis();
+#if GIT_FIRMWARE_MIRRORS
+      dl.received += c;
+#endif
+      if (!consumeChunk(dl, buff, c)) {
+        if (dl.corrupt) {
+          break;  // Retryable, handled below
+        }
+        // Safe cleanup: abort sink before closing the transport
+        discardImage(sink);
+        _resumable = false;
+        failImage();
+        return;
       }
 
       // Check if download is complete
-      if (hasContentLength && totalRead >= (size_t)contentLength) {
+      if (_hasContentLength && dl.totalRead >= (size_t)_contentLength) {
         break;
       }
     }
-    
-    // Download complete - ensure 100% progress
-    _currentPercent = 100;
-    _currentBytesRead = totalRead;
-    
-    // Report final progress
-    reportProgress(totalRead, hasContentLength ? contentLength : 0);
-
-    if (_abortFlag) {
-      setError(UPDATE_ABORTED, "Update aborted by user");
-      Update.abort();
-      // Safe cleanup: http.end() is safe here since GET succeeded
-      http.end();
-      _isUpdating = false;
-      _currentBytesRead = 0;
-      _totalBytes = 0;
-      _currentPercent = 0;
-      return false;
+
+#if GIT_FIRMWARE_MIRRORS
+    if (mirrorCollapsed(dl)) {
+      readFailed = true;  // Continue on a faster mirror
+      break;
     }
+#endif
 
-    if (hasContentLength && totalRead != (size_t)contentLength) {
+    if (millis() - sliceStart >= sliceMs) {
+      return;  // Time slice used up, continue on the next poll()
+    }
+  }
+  size_t totalRead = dl.totalRead;
+  if (totalRead > _downloadStartBytes) {
+    _timing.downloadMs = millis() - _firstByteMs;
+    if (_timing.downloadMs > 0) {
+      _timing.bytesPerSecond =
+        (uint32_t)((uint64_t)(totalRead - _downloadStartBytes) * 1000 / _timing.downloadMs);
+    }
+  }
+  LOGD_F("[GitFirmwareUpdate] Yields: %u, longest stretch without yield: %u ms",
+         (unsigned)_yieldPolicy.getYieldCount(), (unsigned)_yieldPolicy.getMaxStretchMs());
+  
+  // Download complete - ensure 100% progress
+  _currentPercent = 100;
+  _currentBytesRead = totalRead;
+  
+  // Report final progress
+  reportProgress(totalRead, _hasContentLength ? _contentLength : 0, true);
+
+  if (_abortFlag) {
+    setError(UPDATE_ABORTED, "Update aborted by user");
+    discardImage(sink);
+    _resumable = false;
+    failImage();
+    return;
+  }
+
+  bool incomplete = readFailed || (_hasContentLength && totalRead != (size_t)_contentLength);
+#if GIT_FIRMWARE_GZIP
+  if (dl.inflater && !dl.inflateDone && !dl.corrupt) {
+    incomplete = true;
+  }
+#endif
+#if GIT_FIRMWARE_DELTA
+  if (dl.patcher && !dl.patchDone && !dl.corrupt) {
+    incomplete = true;
+  }
+#endif
+  if (dl.corrupt || incomplete) {
+    if (dl.corrupt) {
+      setError(DOWNLOAD_FAILED, _imageDelta ? "Corrupt or mismatched delta patch"
+                                            : "Corrupt compressed firmware");
+    } else {
       setError(DOWNLOAD_FAILED, "Incomplete download");
-      LOGE_F("[GitFirmwareUpdate] Only %u of %d bytes read", (unsigned)totalRead, contentLength);
-      // Safe cleanup: abort Update before ending HTTP
-      Update.abort();
-      // Safe cleanup: http.end() is safe here since GET succeeded
-      http.end();
-      _isUpdating = false;
+    }
+#if GIT_FIRMWARE_MIRRORS
+    if (dl.collapsed) {
+      LOGW_F("[GitFirmwareUpdate] Mirror %u slowed down, switching", _mirror);
+    }
+#endif
+    LOGE_F("[GitFirmwareUpdate] Only %u of %d bytes read", (unsigned)totalRead, _contentLength);
+    transport.close();
+
+    // A clean prefix from an identifiable file can be resumed on the next attempt
+    bool identified = _validator[0] != '\0';
+#if GIT_FIRMWARE_MIRRORS
+    identified = identified || (_verify && _imageSources > 1);  // The SHA-256 checks the splice
+#endif
+    _resumable = !dl.corrupt && totalRead > 0 && identified &&
+                 (!_hasContentLength || totalRead < (size_t)_contentLength);
+    if (!_resumable) {
+      // Safe cleanup: abort sink (transport already closed)
+      discardImage(sink);
       _currentBytesRead = 0;
       _totalBytes = 0;
       _currentPercent = 0;
-      retryAttempt++;
-      continue;
     }
+    retryImage();
+    return;
+  }
+#if GIT_FIRMWARE_MIRRORS
+  if (_imageSources > 1) {
+    if (_timing.downloadMs >= RATE_SAMPLE_MS) {
+      _imageMirrors.recordThroughput(_mirror, totalRead - _downloadStartBytes, _timing.downloadMs);
+    }
+    _imageMirrors.recordSuccess(_mirror);
+  }
+#endif
+  _resumable = false;
+  _state = STATE_FINISHING;
+}
 
-    if (!Update.end()) {
-      setError(FLASH_FAILED, "Update.end() failed");
-      LOGE_F("[GitFirmwareUpdate] Update.end() error: %u", Update.getError());
-      // Update.end() failed, but Update may still be in a partial state
-      // Try to abort it (safe to call even if already aborted)
-      Update.abort();
-      // Safe cleanup: http.end() is safe here since GET succeeded
-      http.end();
-      _isUpdating = false;
+void GitFirmwareUpdate::stepFinish() {
+  GitFirmwareTransport& transport = activeTransport();
+  GitFirmwareSink& sink = *_imageSink;
+  DownloadContext& dl = _dl;
+
+  // Verify before end(): a mismatching image must never become bootable
+  if (dl.hash) {
+    uint8_t digest[GitFirmwareSha256::DIGEST_SIZE];
+    dl.hash->finish(digest);
+    if (memcmp(digest, _expectedDigest, sizeof(digest)) != 0) {
+      setError(VERIFY_FAILED, "Image SHA-256 does not match latest.json");
+      LOGE(F("[GitFirmwareUpdate] SHA-256 mismatch, image discarded"));
+      discardImage(sink);
+      transport.close();
       _currentBytesRead = 0;
       _totalBytes = 0;
       _currentPercent = 0;
-      retryAttempt++;
-      continue;
+      retryImage();
+      return;
+    }
+    LOGI(F("[GitFirmwareUpdate] SHA-256 verified"));
+  }
+
+  // Sink end() covers Update.end() and Update.isFinished()
+  if (!sink.end()) {
+    setError(FLASH_FAILED, "Update.end() failed");
+    LOGE_F("[GitFirmwareUpdate] Update.end() error: %d", sink.getError());
+    // end() failed, but the sink may still be in a partial state
+    // Try to abort it (safe to call even if already aborted)
+    discardImage(sink);
+    transport.close();
+    _currentBytesRead = 0;
+    _totalBytes = 0;
+    _currentPercent = 0;
+    retryImage();
+    return;
+  }
+
+  transport.close();
+#if GIT_FIRMWARE_GZIP
+  _inflater.end();
+#endif
+  if (_store) {
+    GitFirmwareCheckpoint::clear(*_store);
+  }
+
+  // Keep _isUpdating = true during installation phase; the restart is
+  // delayed so web UIs have time to transition to the INSTALLING state
+  LOGI(F("[GitFirmwareUpdate] Update successful – restarting..."));
+  _stateSince = millis();
+  _state = STATE_RESTARTING;
+}
+
+int GitFirmwareUpdate::openImage(GitFirmwareTransport& transport, const char* url) {
+  if (_resumable) {
+    // If-Range: the server answers 200 with the whole file if it changed meanwhile
+    char range[24];
+    snprintf(range, sizeof(range), "bytes=%u-", (unsigned)_dl.totalRead);
+    transport.addRequestHeader("Range", range);
+    bool foreign = false;
+#if GIT_FIRMWARE_MIRRORS
+    foreign = splicesMirrors();
+#endif
+    if (!foreign && _validator[0] != '\0') {
+      transport.addRequestHeader("If-Range", _validator);
     }
+    LOGI_F("[GitFirmwareUpdate] Resuming download at byte %u", (unsigned)_dl.totalRead);
+  }
+
+  LOGI(F("[GitFirmwareUpdate] Connecting to server..."));
+  return transport.open(url, true);  // Follow redirects: important for GitHub
+}
+
+const char* GitFirmwareUpdate::cachedRedirect(const char* url) const {
+  if (_redirectTtlMs == 0 || _redirectUrl.length() == 0 || millis() - _redirectSince >= _redirectTtlMs ||
+      _redirectKey != gitFirmwareCrc32(0, (const uint8_t*)url, strlen(url))) {
+    return nullptr;
+  }
+  return _redirectUrl.c_str();
+}
+
+void GitFirmwareUpdate::retryImage() {
+#if GIT_FIRMWARE_PEERS
+  if (_imagePeer) {
+    // The latest.json URL is the retry; it restarts from byte 0
+    discardImage(*_imageSink);
+    _resumable = false;
+    failImage();
+    return;
+  }
+#endif
+#if GIT_FIRMWARE_MIRRORS
+  // Other mirrors first: no retry used up, no delay
+  if (failoverMirror()) {
+    return;
+  }
+#endif
+  _retryAttempt++;
+  if (_retryAttempt > _retryCount) {
+    failImage();
+    return;
+  }
+  LOGW_F("[GitFirmwareUpdate] Retry attempt %u/%u", _retryAttempt, _retryCount);
+#if GIT_FIRMWARE_MIRRORS
+  if (_imageSources > 1) {
+    _mirrorsTried = 0;  // New round over all mirrors
+    _mirror = _imageMirrors.pick(millis());
+  }
+#endif
+  _stateSince = millis();
+  _state = STATE_CONNECTING;
+}
+
+void GitFirmwareUpdate::failImage() {
+  if (_resumable) {
+    // Retries exhausted with a partial image: keep it for the next boot if possible
+    if (_store && saveCheckpoint(_dl)) {
+      LOGI(F("[GitFirmwareUpdate] Partial image kept for resume"));
+      _imageSink->suspend();
+    } else {
+      discardImage(*_imageSink);
+    }
+    _resumable = false;
+  }
+  activeTransport().close();
+#if GIT_FIRMWARE_GZIP
+  _inflater.end();  // Frees the 32 KB window
+#endif
+  _isUpdating = false;
+  _currentBytesRead = 0;
+  _totalBytes = 0;
+  _currentPercent = 0;
+
+#if GIT_FIRMWARE_DELTA
+  if (_imageDelta && _lastError != UPDATE_ABORTED) {
+    LOGW_F("[GitFirmwareUpdate] Delta update failed (%s), downloading full image",
+           getLastErrorString());
+#if GIT_FIRMWARE_PEERS
+    if (beginPeerImage()) {
+      return;
+    }
+#endif
+    beginFullImage();
+    return;
+  }
+#endif
+#if GIT_FIRMWARE_PEERS
+  if (_imagePeer && _lastError != UPDATE_ABORTED) {
+    LOGW_F("[GitFirmwareUpdate] Peer download failed (%s), downloading from latest.json URL",
+           getLastErrorString());
+    beginFullImage();
+    return;
+  }
+#endif
+  _state = STATE_FAILED;
+}
+
+bool GitFirmwareUpdate::consumeChunk(DownloadContext& dl, const uint8_t* buf, size_t len) {
+  if (dl.totalRead == _downloadStartBytes) {
+    _firstByteMs = millis();
+    _timing.firstByteMs = _firstByteMs - _headersMs;
+  }
+#if GIT_FIRMWARE_GZIP
+  if (dl.inflater) {
+    // Inflated output goes to the sink through inflateOutput()
+    GitFirmwareInflater::Status status = dl.inflater->feed(buf, len);
+    if (status == GitFirmwareInflater::INFLATE_ERROR) {
+      // Output errors were already reported by writeImage()
+      if (_lastError != FLASH_FAILED && !dl.corrupt) {
+        dl.corrupt = true;
+        LOGE_F("[GitFirmwareUpdate] Inflate error: %s", dl.inflater->errorString());
+      }
+      return false;
+    }
+    dl.inflateDone = status == GitFirmwareInflater::INFLATE_DONE;
+  } else
+#endif
+  if (!writeImage(dl, buf, len)) {
+    return false;
+  }
+
+  dl.totalRead += len;
+  size_t totalRead = dl.totalRead;
+
+  if (_store && totalRead - dl.lastCheckpoint >= _checkpointInterval) {
+    saveCheckpoint(dl);
+  }
+  int contentLength = dl.contentLength;
+  bool hasContentLength = contentLength > 0;
+  
+  // Calculate and report progress
+  int percent = 0;
+  if (hasContentLength) {
+    percent = (int)((totalRead * 100) / contentLength);
+    percent = constrain(percent, 0, 100);
+  }
+  
+  // Update progress tracking
+  _currentBytesRead = totalRead;
+  if (hasContentLength) {
+    _currentPercent = percent;
+  }
+  
+  // Report progress via callback
+  publishProgress();
+  reportProgress(totalRead, hasContentLength ? contentLength : 0);
 
-    http.end();
+  // Call server handle callback to keep WebServer responsive (for progress polling)
+  if (_serverHandleCallback) {
+    _serverHandleCallback();
+  }
 
-    if (!Update.isFinished()) {
-      setError(FLASH_FAILED, "Update not finished");
-      LOGE(F("[GitFirmwareUpdate] Update not finished"));
-      retryAttempt++;
+  // Cooperative yield: allow other tasks (like async_tcp) to run and reset watchdog
+  // This prevents watchdog timeout during long downloads
+  // Time and byte based: read sizes vary, so totalRead rarely hits a fixed multiple
+  uint32_t now = millis();
+  if (_yieldPolicy.due(len, now)) {
+    yield();  // Cooperative yield to FreeRTOS scheduler
+    _yieldPolicy.yielded(now);
+  }
+  return true;
+}
+
+#if GIT_FIRMWARE_PIPELINE
+// Pipeline producer: runs in the reader task
+int GitFirmwareUpdate::pipelineRead(void* ctx, uint8_t* buf, size_t capacity) {
+  DownloadContext* dl = static_cast<DownloadContext*>(ctx);
+  for (;;) {
+#if GIT_FIRMWARE_MIRRORS
+    if (dl->self->mirrorCollapsed(*dl)) {
+      return -1;  // Continue on a faster mirror
+    }
+#endif
+#if GIT_FIRMWARE_HISTOGRAM
+    uint32_t readStart = micros();
+#endif
+    int c = dl->transport->read(buf, capacity, PIPELINE_READ_WAIT_MS);
+    if (c > 0) {
+      dl->lastDataMs = millis();
+#if GIT_FIRMWARE_MIRRORS
+      dl->received += c;
+#endif
+#if GIT_FIRMWARE_HISTOGRAM
+      // Reader task only; the writer task records writeUs
+      dl->self->_histograms.readUs.add(micros() - readStart);
+      dl->self->_histograms.readBytes.add(c);
+#endif
+      return c;
+    }
+    if (c == 0) {
+      if (*dl->abortFlag) return 0;
+      if (millis() - dl->lastDataMs >= dl->self->_timeoutMs) return -1;  // Stalled
       continue;
     }
+    return c == GitFirmwareTransport::READ_EOF ? 0 : -1;
+  }
+}
+bool GitFirmwareUpdate::pipelineWrite(void* ctx, const uint8_t* buf, size_t len) {
+  DownloadContext* dl = static_cast<DownloadContext*>(ctx);
+  return dl->self->consumeChunk(*dl, buf, len);
+}
+#endif
 
-    success = true;
+bool GitFirmwareUpdate::saveCheckpoint(DownloadContext& dl) {
+  dl.lastCheckpoint = dl.totalRead;
+  // Decoder state is not persisted: compressed images and patches restart after a reboot
+#if GIT_FIRMWARE_GZIP
+  if (dl.inflater) return false;
+#endif
+#if GIT_FIRMWARE_DELTA
+  if (dl.patcher) return false;
+#endif
+  GitFirmwareCheckpoint checkpoint;
+  memset(&checkpoint, 0, sizeof(checkpoint));
+  if (dl.validator[0] == '\0' || strlen(dl.url) >= sizeof(checkpoint.url)) {
+    return false;  // Resume needs an If-Range validator and the full URL
+  }
+  size_t committed = dl.sink->commit();
+  if (committed == 0) {
+    return false;
   }
+  checkpoint.offset = committed;
+  checkpoint.totalSize = dl.contentLength > 0 ? dl.contentLength : -1;
+  strncpy(checkpoint.url, dl.url, sizeof(checkpoint.url) - 1);
+  strncpy(checkpoint.validator, dl.validator, sizeof(checkpoint.validator) - 1);
+  strncpy(checkpoint.fromVersion, _currentVersion, sizeof(checkpoint.fromVersion) - 1);
+  bool ok = checkpoint.save(*_store);
+  LOGD_F("[GitFirmwareUpdate] Checkpoint at %u bytes%s", (unsigned)committed, ok ? "" : " failed");
+  return ok;
+}
 
-  // Keep _isUpdating = true during installation phase
-  // It will be set to false only if installation fails or completes
+void GitFirmwareUpdate::discardImage(GitFirmwareSink& sink) {
+  sink.abort();
+  if (_store) {
+    GitFirmwareCheckpoint::clear(*_store);
+  }
+}
 
-  if (!success) {
-    _isUpdating = false;
-    _currentBytesRead = 0;
-    _totalBytes = 0;
-    _currentPercent = 0;
+bool GitFirmwareUpdate::writeImage(DownloadContext& dl, const uint8_t* data, size_t len) {
+#if GIT_FIRMWARE_DELTA
+  if (dl.patcher) {
+    // Patched output goes to the sink through deltaOutput()
+    GitFirmwareDeltaPatcher::Status status = dl.patcher->feed(data, len);
+    if (status == GitFirmwareDeltaPatcher::DELTA_ERROR) {
+      if (_lastError != FLASH_FAILED) {
+        dl.corrupt = true;
+        LOGE_F("[GitFirmwareUpdate] Delta patch error: %s", dl.patcher->errorString());
+      }
+      return false;
+    }
+    dl.patchDone = status == GitFirmwareDeltaPatcher::DELTA_DONE;
+    return true;
+  }
+#endif
+  return writeSink(dl, data, len);
+}
+
+bool GitFirmwareUpdate::writeSink(DownloadContext& dl, const uint8_t* data, size_t len) {
+  if (dl.hash) {
+    dl.hash->update(data, len);
+  }
+#if GIT_FIRMWARE_HISTOGRAM
+  uint32_t writeStart = micros();
+#endif
+  size_t written = dl.sink->write(data, len);
+#if GIT_FIRMWARE_HISTOGRAM
+  _histograms.writeUs.add(micros() - writeStart);
+#endif
+  if (written != len) {
+    setError(FLASH_FAILED, "Update.write() failed");
+    LOGE_F("[GitFirmwareUpdate] Update.write() error: %d", dl.sink->getError());
     return false;
   }
+  return true;
+}
 
-  LOGI(F("[GitFirmwareUpdate] Update successful – restarting..."));
-  // Additional delay to ensure JavaScript has time to transition to INSTALLING state
-  delay(1000);
-  ESP.restart();
-  return true;  // Practically never reached
+#if GIT_FIRMWARE_GZIP
+bool GitFirmwareUpdate::inflateOutput(void* ctx, const uint8_t* data, size_t len) {
+  DownloadContext* dl = static_cast<DownloadContext*>(ctx);
+  return dl->self->writeImage(*dl, data, len);
 }
+#endif
+
+#if GIT_FIRMWARE_DELTA
+bool GitFirmwareUpdate::deltaOutput(void* ctx, const uint8_t* data, size_t len) {
+  DownloadContext* dl = static_cast<DownloadContext*>(ctx);
+  return dl->self->writeSink(*dl, data, len);
+}
+#endif
 
 bool GitFirmwareUpdate::getProgress(size_t& bytesRead, size_t& totalBytes, int& percent) const {
+  ProgressSnapshot snapshot = getProgressSnapshot();
   // Return progress if updating OR if we have valid progress data (download just completed)
-  if (!_isUpdating && _currentPercent == 0 && _currentBytesRead == 0) {
+  if (!snapshot.updating && snapshot.percent == 0 && snapshot.bytesRead == 0) {
     return false;
   }
-  bytesRead = _currentBytesRead;
-  totalBytes = _totalBytes;
-  percent = _currentPercent;
+  bytesRead = snapshot.bytesRead;
+  totalBytes = snapshot.totalBytes;
+  percent = snapshot.percent;
   // Return true if updating, or if we have 100% progress (download completed)
-  return _isUpdating || (_currentPercent >= 100 && _totalBytes > 0);
+  return snapshot.updating || (snapshot.percent >= 100 && snapshot.totalBytes > 0);
+}
+
+GitFirmwareUpdate::ProgressSnapshot GitFirmwareUpdate::getProgressSnapshot() const {
+  ProgressSnapshot snapshot;
+  while (!_progressSnapshot.read(snapshot)) {
+    delay(1);  // Writer preempted mid-write on this core: let it finish
+  }
+  return snapshot;
+}
+
+void GitFirmwareUpdate::publishProgress() {
+  ProgressSnapshot snapshot;
+  snapshot.state = _state;
+  snapshot.updating = _isUpdating;
+  snapshot.bytesRead = _currentBytesRead;
+  snapshot.totalBytes = _totalBytes;
+  snapshot.percent = _currentPercent;
+  snapshot.bytesPerSecond = 0;
+  snapshot.etaMs = 0;
+  if (_state == STATE_DOWNLOADING) {
+    // Rolling rate: one sample per RATE_SAMPLE_MS, smoothed over about 4 samples
+    uint32_t now = millis();
+    uint32_t elapsed = now - _rateWindowMs;
+    if (elapsed >= RATE_SAMPLE_MS && _currentBytesRead >= _rateWindowBytes) {
+      uint32_t sample = (uint32_t)((uint64_t)(_currentBytesRead - _rateWindowBytes) * 1000 / elapsed);
+      _bytesPerSecond = _bytesPerSecond == 0 ? sample : (_bytesPerSecond * 3 + sample) / 4;
+      _rateWindowMs = now;
+      _rateWindowBytes = _currentBytesRead;
+    }
+    snapshot.bytesPerSecond = _bytesPerSecond;
+    if (_bytesPerSecond > 0 && _totalBytes > _currentBytesRead) {
+      snapshot.etaMs =
+        (uint32_t)((uint64_t)(_totalBytes - _currentBytesRead) * 1000 / _bytesPerSecond);
+    }
+  }
+  _progressSnapshot.write(snapshot);
+  _timingSnapshot.write(_timing);
+}
+
+GitFirmwareUpdate::UpdateTiming GitFirmwareUpdate::getTiming() const {
+  UpdateTiming timing;
+  while (!_timingSnapshot.read(timing)) {
+    delay(1);  // Writer preempted mid-write on this core: let it finish
+  }
+  return timing;
+}
+
+GitFirmwareUpdate::MemoryReport GitFirmwareUpdate::getMemoryReport() const {
+  MemoryReport report;
+  while (!_memorySnapshot.read(report)) {
+    delay(1);  // Writer preempted mid-write on this core: let it finish
+  }
+  return report;
 }
 
-void GitFirmwareUpdate::reportProgress(size_t bytesRead, size_t totalBytes) {
+void GitFirmwareUpdate::sampleMemory(GitFirmwareMemorySample& sample) {
+  GitFirmwareMemory::sample(sample);
+  _memorySnapshot.write(_memory);
+}
+
+void GitFirmwareUpdate::resetTiming() {
+  memset(&_timing, 0, sizeof(_timing));
+  memset(&_memory, 0, sizeof(_memory));
+  _memorySnapshot.write(_memory);
+  _updateStartMs = millis();
+#if GIT_FIRMWARE_HISTOGRAM
+  _histograms.readUs.reset();
+  _histograms.writeUs.reset();
+  _histograms.readBytes.reset();
+#endif
+}
+
+void GitFirmwareUpdate::reportProgress(size_t bytesRead, size_t totalBytes, bool force) {
   int percent = 0;
   if (totalBytes > 0) {
     percent = (int)((bytesRead * 100) / totalBytes);
     percent = constrain(percent, 0, 100);
   }
 
+  // Throttle: a callback per chunk slows the download and floods slow consumers
+  uint32_t now = millis();
+  if (!force) {
+    if (now - _reportedMs < _progressMinIntervalMs) {
+      return;
+    }
+    if (totalBytes > 0 && percent - _reportedPercent < (int)_progressMinPercent) {
+      return;
+    }
+  }
+  _reportedPercent = percent;
+  _reportedMs = now;
+
   // Debug output
   if (totalBytes > 0) {
     LOGV_F("[GitFirmwareUpdate] Progress: %d%% (%u/%u bytes)", percent, (unsigned)bytesRead, (unsigned)totalBytes);
@@ -12,6 +12,39 @@
  *
  * Default: DebugLog disabled (smaller binary). Define DEBUG_LOG_ENABLED=1
  * (e.g. in build_opt.h: -DDEBUG_LOG_ENABLED=1) to enable logging.
+ *
+ * Default: raw .bin images only. Define GIT_FIRMWARE_USE_GZIP to accept
+ * gzip/deflate images (Content-Encoding or "compression" in latest.json),
+ * inflated on the fly with a 32 KB window.
+ *
+ * Default: full images only. Define GIT_FIRMWARE_USE_DELTA to accept delta
+ * patches ("delta" in latest.json) that rebuild the new image from the
+ * running partition; see extras/delta for the patch generator.
+ *
+ * Default: sequential download/flash. Define GIT_FIRMWARE_USE_PIPELINE
+ * (e.g. in build_opt.h: -DGIT_FIRMWARE_USE_PIPELINE) to compile in the
+ * pipelined mode (reader task + flash writer), then enable it at runtime
+ * with setPipelineBuffers().
+ *
+ * Default: no histograms. Define GIT_FIRMWARE_USE_HISTOGRAM to record log2
+ * histograms of read / write latency and read sizes (getHistograms()).
+ *
+ * Default: one URL for latest.json and one for the image. Define
+ * GIT_FIRMWARE_USE_MIRRORS to accept mirror lists (constructor, "mirrors" in
+ * latest.json): the fastest healthy mirror is used, and a download that
+ * fails or slows down continues on another mirror with a Range request.
+ *
+ * Default: images come from latest.json URLs only. Define
+ * GIT_FIRMWARE_USE_PEERS to fetch the image from a device on the LAN that
+ * already runs it (GitFirmwarePeerServer / setPeerFinder(), needs "sha256").
+ *
+ * Default: latest.json fields in Arduino Strings, flash and inflate buffers
+ * allocated per download. Define GIT_FIRMWARE_USE_ZERO_HEAP to keep them in
+ * fixed-size buffers inside the object instead (sizes: GIT_FIRMWARE_URL_SIZE,
+ * GIT_FIRMWARE_NOTES_SIZE), and the default sink is PartitionSink writing
+ * from an inline sector buffer; the library then allocates nothing after
+ * construction. HTTPClient / WiFiClient(Secure) internals of the default
+ * transport still use the heap.
  */
 
 #pragma once
@@ -28,6 +61,27 @@
   #define DEBUG_LOG_ENABLED 0
 #endif
 
+// Default: sequential download. Define GIT_FIRMWARE_USE_PIPELINE to compile in pipelined mode.
+#ifdef GIT_FIRMWARE_USE_PIPELINE
+  #define GIT_FIRMWARE_PIPELINE 1
+#else
+  #define GIT_FIRMWARE_PIPELINE 0
+#endif
+
+// Default: raw images only. Define GIT_FIRMWARE_USE_GZIP to inflate compressed images.
+#ifdef GIT_FIRMWARE_USE_GZIP
+  #define GIT_FIRMWARE_GZIP 1
+#else
+  #define GIT_FIRMWARE_GZIP 0
+#endif
+
+// Default: full images only. Define GIT_FIRMWARE_USE_DELTA to apply delta patches.
+#ifdef GIT_FIRMWARE_USE_DELTA
+  #define GIT_FIRMWARE_DELTA 1
+#else
+  #define GIT_FIRMWARE_DELTA 0
+#endif
+
 #include <Arduino.h>
 #include <WiFi.h>
 #if !GIT_FIRMWARE_HTTP_ONLY
@@ -37,6 +91,88 @@
 #include <Update.h>
 #include <ArduinoJson.h>
 #include <DebugLog.h>
+#include "GitFirmwareTransport.h"
+#include "GitFirmwareSink.h"
+#include "GitFirmwareCheckpoint.h"
+#include "GitFirmwareSha256.h"
+#include "GitFirmwareYield.h"
+#include "GitFirmwareSeqlock.h"
+#include "GitFirmwareFixedString.h"
+#include "GitFirmwareMemory.h"
+#include "GitFirmwareTlsSessionCache.h"
+#if GIT_FIRMWARE_PIPELINE
+  #include "GitFirmwarePipeline.h"
+#endif
+#if GIT_FIRMWARE_GZIP
+  #include "GitFirmwareInflate.h"
+#endif
+// Default: no histograms. Define GIT_FIRMWARE_USE_HISTOGRAM to record download latency histograms.
+#ifdef GIT_FIRMWARE_USE_HISTOGRAM
+  #define GIT_FIRMWARE_HISTOGRAM 1
+#else
+  #define GIT_FIRMWARE_HISTOGRAM 0
+#endif
+
+// Default: single URLs. Define GIT_FIRMWARE_USE_MIRRORS to use mirror lists.
+#ifdef GIT_FIRMWARE_USE_MIRRORS
+  #define GIT_FIRMWARE_MIRRORS 1
+#else
+  #define GIT_FIRMWARE_MIRRORS 0
+#endif
+
+// Default: no LAN peers. Define GIT_FIRMWARE_USE_PEERS to download images from peers.
+#ifdef GIT_FIRMWARE_USE_PEERS
+  #define GIT_FIRMWARE_PEERS 1
+#else
+  #define GIT_FIRMWARE_PEERS 0
+#endif
+
+// Default: String fields, per-download buffers. Define GIT_FIRMWARE_USE_ZERO_HEAP for inline buffers.
+#ifdef GIT_FIRMWARE_USE_ZERO_HEAP
+  #define GIT_FIRMWARE_ZERO_HEAP 1
+#else
+  #define GIT_FIRMWARE_ZERO_HEAP 0
+#endif
+
+#if GIT_FIRMWARE_ZERO_HEAP && GIT_FIRMWARE_PIPELINE
+  #error "GIT_FIRMWARE_USE_PIPELINE allocates buffers and a task per download, remove it or GIT_FIRMWARE_USE_ZERO_HEAP"
+#endif
+
+// Field capacities in zero-heap mode (bytes, including the terminator)
+#ifndef GIT_FIRMWARE_URL_SIZE
+  #define GIT_FIRMWARE_URL_SIZE 256
+#endif
+#ifndef GIT_FIRMWARE_NOTES_SIZE
+  #define GIT_FIRMWARE_NOTES_SIZE 256
+#endif
+
+// Heap held back by reserveMemory() for the TLS session (HTTPS builds; bytes, 0 = none)
+#ifndef GIT_FIRMWARE_TLS_RESERVE
+  #define GIT_FIRMWARE_TLS_RESERVE 40960
+#endif
+
+#if GIT_FIRMWARE_DELTA
+  #include "GitFirmwareDelta.h"
+#endif
+#if GIT_FIRMWARE_HISTOGRAM
+  #include "GitFirmwareHistogram.h"
+#endif
+#if GIT_FIRMWARE_MIRRORS
+  #include "GitFirmwareMirrors.h"
+  #if GIT_FIRMWARE_MAX_MIRRORS < 2
+    #error "GIT_FIRMWARE_USE_MIRRORS needs GIT_FIRMWARE_MAX_MIRRORS >= 2"
+  #endif
+#endif
+#if GIT_FIRMWARE_PEERS
+  #include "GitFirmwarePeer.h"
+#endif
+
+// Text field of up to N - 1 characters: inline in zero-heap mode, String otherwise
+#if GIT_FIRMWARE_ZERO_HEAP
+template <size_t N> using GitFirmwareText = GitFirmwareFixedString<N>;
+#else
+template <size_t N> using GitFirmwareText = String;
+#endif
 
 /**
  * @class GitFirmwareUpdate
@@ -59,9 +195,94 @@ public:
     FLASH_FAILED,              ///< Flash write operation failed
     INVALID_URL,               ///< Invalid firmware URL
     UPDATE_SIZE_ERROR,         ///< Firmware size validation failed
-    UPDATE_ABORTED             ///< Update was aborted by user
+    UPDATE_ABORTED,            ///< Update was aborted by user
+    VERIFY_FAILED              ///< Image SHA-256 does not match latest.json
+  };
+
+  /**
+   * @enum UpdateState
+   * @brief Phase of an update driven by startUpdate() / poll()
+   */
+  enum UpdateState {
+    STATE_IDLE = 0,            ///< No update started
+    STATE_CHECKING,            ///< Fetching latest.json
+    STATE_CONNECTING,          ///< Requesting the image (also while waiting to retry)
+    STATE_DOWNLOADING,         ///< Streaming the image into the sink
+    STATE_FINISHING,           ///< Verifying and finalizing the image
+    STATE_RESTARTING,          ///< Image installed, device restarts shortly
+    STATE_FAILED               ///< Update ended without installing, see getLastError()
+  };
+
+  /**
+   * @struct ProgressSnapshot
+   * @brief Consistent view of a running update, see getProgressSnapshot()
+   */
+  struct ProgressSnapshot {
+    UpdateState state;         ///< Current phase
+    bool updating;             ///< Image download / install in progress
+    size_t bytesRead;          ///< Bytes downloaded so far
+    size_t totalBytes;         ///< Total bytes (0 if unknown)
+    int percent;               ///< Progress percentage (0-100, 0 if size unknown)
+    uint32_t bytesPerSecond;   ///< Download rate over roughly the last second (0 if none yet)
+    uint32_t etaMs;            ///< Estimated time to complete the download (0 if unknown)
+  };
+
+  /**
+   * @struct UpdateTiming
+   * @brief Where the last (or running) update spent its time, see getTiming()
+   *
+   * Connection phases are those of the last download attempt. Phases a
+   * transport does not measure stay 0.
+   */
+  struct UpdateTiming {
+    uint32_t checkMs;          ///< latest.json request and parsing
+    uint32_t dnsMs;            ///< Image host lookup
+    uint32_t connectMs;        ///< TCP connect, including the TLS handshake for https
+    uint32_t responseMs;       ///< Image request until response headers (incl. redirects)
+    uint32_t firstByteMs;      ///< Response headers until the first body byte
+    uint32_t downloadMs;       ///< First body byte until the end of the body
+    uint32_t finishMs;         ///< Verification and sink end() (Update.end())
+    uint32_t totalMs;          ///< startUpdate() / startDownload() until now or the end
+    uint32_t bytesPerSecond;   ///< Average rate over downloadMs
+  };
+
+  /**
+   * @struct MemoryPhase
+   * @brief Heap and stack before and after one phase
+   */
+  struct MemoryPhase {
+    GitFirmwareMemorySample before;
+    GitFirmwareMemorySample after;
+  };
+
+  /**
+   * @struct MemoryReport
+   * @brief Memory around the phases of the last check / update, see getMemoryReport()
+   *
+   * Phases that did not run stay 0. stackFree is the high-water mark of the
+   * task that ran the phase (the caller of poll() / performUpdate()).
+   */
+  struct MemoryReport {
+    MemoryPhase check;         ///< checkForUpdate()
+    MemoryPhase sinkBegin;     ///< Sink begin() (Update.begin() by default) of the last attempt
+    MemoryPhase download;      ///< Download loop of the last attempt
   };
 
+#if GIT_FIRMWARE_HISTOGRAM
+  /**
+   * @struct DownloadHistograms
+   * @brief Per-call distributions of the running / last update, see getHistograms()
+   *
+   * Slow reads with fast writes mean the update is network-bound, and the
+   * other way round flash-bound.
+   */
+  struct DownloadHistograms {
+    GitFirmwareHistogram readUs;     ///< Transport read() calls that returned data, incl. waiting (µs)
+    GitFirmwareHistogram writeUs;    ///< Sink write() calls (µs)
+    GitFirmwareHistogram readBytes;  ///< Bytes returned per read()
+  };
+#endif
+
   /**
    * @typedef ProgressCallback
    * @brief Callback function type for progress reporting
@@ -86,12 +307,32 @@ public:
    */
   GitFirmwareUpdate(const char* currentVersion, const char* githubUrl);
 
+#if GIT_FIRMWARE_MIRRORS
+  /**
+   * @brief Construct with mirrors of latest.json
+   * 
+   * Each check asks the mirror with the best record first (see
+   * getManifestMirrors()) and the next one when a request fails.
+   * 
+   * @param currentVersion Current firmware version string (e.g., "1.0.2")
+   * @param manifestUrls URLs of the same latest.json (the array and the
+   *        strings must outlive this object)
+   * @param count Number of URLs (1..GIT_FIRMWARE_MAX_MIRRORS, extra ones are ignored)
+   */
+  GitFirmwareUpdate(const char* currentVersion, const char* const* manifestUrls, uint8_t count);
+#endif
+  ~GitFirmwareUpdate();
+
   /**
    * @brief Check GitHub for firmware update availability
    * 
    * Fetches latest.json from GitHub, compares versions, and stores
    * remote version info if available. Does not perform the update.
    * 
+   * After a "no update" result the ETag / Last-Modified of latest.json are
+   * kept in RAM and sent as If-None-Match / If-Modified-Since on the next
+   * check; a 304 answer returns NO_UPDATE_AVAILABLE without parsing.
+   * 
    * @return true if a newer version is available
    * @return false if no update available or check failed
    */
@@ -103,6 +344,9 @@ public:
    * Checks for update, and if available, downloads and flashes the firmware.
    * Blocks until update completes, fails, or device restarts.
    * 
+   * With GIT_FIRMWARE_USE_DELTA, a delta patch from the running version
+   * (latest.json "delta") is tried first; if it fails, the full image is used.
+   * 
    * @return true if update was successful (device will restart)
    * @return false if update failed or no update available
    */
@@ -115,10 +359,60 @@ public:
    * bypassing the GitHub check. Useful for manual updates or testing.
    * 
    * @param url URL to firmware binary
+   * @param sha256 Optional expected SHA-256 of the image (64 hex characters)
    * @return true if update was successful (device will restart)
    * @return false if update failed
    */
-  bool downloadAndInstall(const String& url);
+  bool downloadAndInstall(const char* url, const char* sha256 = nullptr);
+  bool downloadAndInstall(const String& url, const char* sha256 = nullptr) {
+    return downloadAndInstall(url.c_str(), sha256);
+  }
+
+  /**
+   * @brief Start a non-blocking update (check, download, flash)
+   * 
+   * Same steps as performUpdate(), advanced by calling poll() from loop().
+   * 
+   * @return false if an update is already running
+   */
+  bool startUpdate();
+
+  /**
+   * @brief Start a non-blocking download of a specific URL
+   * 
+   * Same as downloadAndInstall(), advanced by calling poll() from loop().
+   * 
+   * @param url URL to firmware binary
+   * @param sha256 Optional expected SHA-256 of the image (64 hex characters)
+   * @return false if an update is already running or the arguments are invalid
+   */
+  bool startDownload(const char* url, const char* sha256 = nullptr);
+  bool startDownload(const String& url, const char* sha256 = nullptr) {
+    return startDownload(url.c_str(), sha256);
+  }
+
+  /**
+   * @brief Advance a started update
+   * 
+   * Downloading stops after about sliceMs and continues on the next call.
+   * Fetching latest.json, connecting and finalizing the image still block
+   * for their duration (bounded by setTimeout()). After STATE_RESTARTING
+   * the device restarts about one second later from within poll().
+   * 
+   * With no update running this returns immediately. Progress and server
+   * handle callbacks are called from poll(). Pipelined mode
+   * (setPipelineBuffers()) only applies to the blocking calls.
+   * 
+   * @param sliceMs Time budget for downloading in this call (default: 20 ms)
+   * @return UpdateState state after this call; on STATE_FAILED see
+   *         getLastError() (NO_UPDATE_AVAILABLE if there was nothing to install)
+   */
+  UpdateState poll(uint32_t sliceMs = 20);
+
+  /**
+   * @brief Get the state of the update started with startUpdate() / startDownload()
+   */
+  UpdateState getState() const { return _state; }
 
   /**
    * @brief Set progress callback function
@@ -130,6 +424,20 @@ public:
    */
   void setProgressCallback(ProgressCallback callback);
 
+  /**
+   * @brief Limit how often progress is reported
+   * 
+   * A report (callback and verbose log) is emitted when at least minIntervalMs
+   * passed since the previous one and the percentage advanced by at least
+   * minPercentDelta (only the interval applies without Content-Length).
+   * The first (0%) and last report of a download are always emitted.
+   * 
+   * @param minPercentDelta Minimum percentage step (default: 1, 0 = no limit)
+   * @param minIntervalMs Minimum time between reports (default: 100, 0 = no limit)
+   * @note Use (0, 0) for a report after every received chunk
+   */
+  void setProgressThrottle(uint8_t minPercentDelta, uint32_t minIntervalMs);
+
   /**
    * @brief Set server handle callback function
    * 
@@ -164,6 +472,210 @@ public:
    */
   void setCertificateValidation(bool validate);
 
+  /**
+   * @brief Enable pipelined download/flash with the given number of buffers
+   * 
+   * A reader task drains the socket into a ring of pre-allocated buffers
+   * (heap, allocated per download) while the calling task writes them to
+   * flash, so network and flash phases overlap.
+   * 
+   * @param count Number of 4 KB buffers (0 = sequential mode, default; 2..8)
+   * @note No effect unless compiled with GIT_FIRMWARE_USE_PIPELINE; poll()
+   *       always downloads sequentially
+   */
+  void setPipelineBuffers(uint8_t count);
+
+  /**
+   * @brief Set how many bytes are collected before each Update.write()
+   * 
+   * Downloaded data arrives in small pieces. Update buffers one flash sector
+   * itself, so by default every chunk is passed on directly; a block size
+   * makes the default sink collect blocks first, at the cost of a copy.
+   * Takes effect with the next download. PartitionSink always writes whole
+   * 4 KB sectors.
+   * 
+   * @param bytes Block size (default: 0 = write every chunk directly; no
+   *              effect with GIT_FIRMWARE_USE_ZERO_HEAP, which uses PartitionSink)
+   */
+  void setWriteBlockSize(size_t bytes);
+
+  /**
+   * @brief Set how often the download loop yields to other tasks
+   * 
+   * The loop yields after intervalMs or intervalBytes, whichever comes first
+   * (waiting on the socket counts as a yield). Shorter intervals keep other
+   * tasks and the watchdog happier, longer ones cost less throughput.
+   * 
+   * @param intervalMs Milliseconds between yields (default: 50, 0 = no time limit)
+   * @param intervalBytes Bytes between yields (default: 10240, 0 = no byte limit)
+   */
+  void setYieldInterval(uint32_t intervalMs, size_t intervalBytes);
+
+  /**
+   * @brief Reserve the update buffers now instead of per check / update
+   * 
+   * Call once early in setup(), after setPipelineBuffers(), while the heap
+   * is still unfragmented. One block holds the flash sector buffer, the
+   * inflate window (GIT_FIRMWARE_USE_GZIP) and the pipeline ring
+   * (GIT_FIRMWARE_USE_PIPELINE); every later download reuses it. With
+   * HTTPS, GIT_FIRMWARE_TLS_RESERVE bytes are held as well and handed back
+   * to the heap just before each connection, so WiFiClientSecure finds
+   * room for its buffers; they are taken again when the update ends.
+   * 
+   * While reserved, the default sink is PartitionSink (writes the OTA
+   * partition from the reserved sector, no Update.begin() allocation), so
+   * starting the image is not retried.
+   * 
+   * @return false if the memory is not available (nothing is reserved)
+   */
+  bool reserveMemory();
+
+  /**
+   * @brief Return the memory taken by reserveMemory() (not while an update runs)
+   */
+  void releaseMemory();
+
+  /**
+   * @brief True after a successful reserveMemory()
+   */
+  bool isMemoryReserved() const { return _memoryReserved; }
+
+  /**
+   * @brief Keep the connection of the default transport between requests
+   * 
+   * When latest.json and the image (or consecutive checks) are on the same
+   * host, the image GET / next check is sent on the open connection instead
+   * of a new DNS lookup, TCP connect and TLS handshake. The connection is
+   * kept only after a completely read response and only while the server
+   * allows it. With reserveMemory() and HTTPS it is closed when the update
+   * or check ends, so the TLS reserve can be taken back.
+   * 
+   * @param reuse true to keep connections (default), false for one connection per request
+   * @note Custom transports: see GitFirmwareTransport::setKeepAlive()
+   */
+  void setConnectionReuse(bool reuse);
+
+  /**
+   * @brief Resume TLS sessions of the default transport from a cache
+   * 
+   * With a cache, HTTPS connections offer the session saved for the host
+   * (session ID or ticket) and servers that accept it skip the certificate
+   * exchange and key agreement. Covers connections that setConnectionReuse()
+   * cannot keep: after a redirect to another host, a server-side close, a
+   * restart or deep sleep (Storage in RTC memory). A rejected session just
+   * costs the full handshake it replaces. Sessions are only resumed with the
+   * setCertificateValidation() mode they were made with.
+   * 
+   *   RTC_NOINIT_ATTR GitFirmwareTlsSessionCache::Storage tlsSessions;
+   *   GitFirmwareTlsSessionCache tlsCache(tlsSessions);
+   *   updater.setTlsSessionCache(&tlsCache);
+   * 
+   * @param cache Session cache (must outlive its use; nullptr = WiFiClientSecure
+   *              with a full handshake per connection, default)
+   * @note No effect when GIT_FIRMWARE_HTTP_ONLY is 1 (HTTP-only mode)
+   */
+  void setTlsSessionCache(GitFirmwareTlsSessionCache* cache);
+
+  /**
+   * @brief Remember where the firmware URL redirects to
+   * 
+   * GitHub release asset URLs answer with a redirect to a CDN host, which
+   * costs a request (on another host also a connect and TLS handshake) per
+   * attempt. The final URL is remembered for ttlMs and requested directly
+   * by retries, resumed downloads and later updates from the same URL. If
+   * it answers with a 4xx (e.g. an expired signed URL), the original URL
+   * is requested again.
+   * 
+   * @param ttlMs How long a redirect target is used (default: 300000, 0 = off)
+   */
+  void setRedirectCacheTime(uint32_t ttlMs);
+
+#if GIT_FIRMWARE_MIRRORS
+  /**
+   * @brief Probe image mirrors that have no throughput measurement yet
+   * 
+   * When latest.json lists "mirrors", the first download fetches the first
+   * bytes of the image from each unmeasured mirror (Range request) and
+   * starts on the fastest. Later downloads rank mirrors by the throughput
+   * and failures of earlier ones. A download slower than a quarter of
+   * another mirror's throughput continues there.
+   * 
+   * @param bytes Bytes per probe (default: 16384, 0 = no probing; mirrors
+   *        are then used in list order until measured)
+   */
+  void setMirrorProbeBytes(size_t bytes);
+
+  /**
+   * @brief Statistics of the image mirrors ("url", then "mirrors" of latest.json)
+   */
+  const GitFirmwareMirrors& getImageMirrors() const { return _imageMirrors; }
+
+  /**
+   * @brief Statistics of the latest.json mirrors (constructor order)
+   */
+  const GitFirmwareMirrors& getManifestMirrors() const { return _manifestMirrors; }
+#endif
+
+  /**
+   * @brief Use a custom transport for latest.json and firmware downloads
+   * 
+   * By default one HttpClientTransport (HTTPClient + WiFiClient /
+   * WiFiClientSecure) owned by this object is used for every request. The
+   * transport must outlive this object. Set to nullptr to restore the default.
+   * 
+   * @param transport Transport implementation (not owned)
+   */
+  void setTransport(GitFirmwareTransport* transport);
+
+  /**
+   * @brief Use a custom sink for the downloaded firmware image
+   * 
+   * By default the image is written to the OTA partition through Update
+   * (UpdateSink). The sink must outlive this object. Set to nullptr to
+   * restore the default.
+   * 
+   * @param sink Sink implementation (not owned)
+   */
+  void setSink(GitFirmwareSink* sink);
+
+  /**
+   * @brief Persist download progress so an update survives a reboot
+   * 
+   * Every intervalBytes the committed image size, URL and ETag /
+   * Last-Modified are written to store. The next update of the same URL
+   * from the same running version continues at that offset with a Range
+   * request. Without a custom sink, images are then written with
+   * PartitionSink instead of Update (Update cannot resume).
+   * 
+   * Only raw images are checkpointed; compressed images and delta patches
+   * restart because decoder state is not persisted. Set to nullptr to disable.
+   * 
+   * @param store Store implementation, e.g. PreferencesStore (not owned)
+   * @param intervalBytes Downloaded bytes between checkpoints (default: 64 KB)
+   */
+  void setCheckpointStore(GitFirmwareStore* store, uint32_t intervalBytes = 65536);
+
+#if GIT_FIRMWARE_PEERS
+  /**
+   * @brief Ask devices on the LAN for the image before using the latest.json URL
+   * 
+   * When latest.json has a "sha256", the finder broadcasts a query for it
+   * and the full image is downloaded from the first peer that answers
+   * (delta patches keep precedence). The image is verified against the
+   * digest. If the peer download fails, the latest.json URL is used
+   * without waiting for a retry. Devices serve their image with
+   * GitFirmwarePeerServer, e.g. after an update:
+   * 
+   *   GitFirmwarePeerServer peerServer;
+   *   peerServer.setRunningImage();   // in setup()
+   *   peerServer.begin();
+   *   peerServer.handle();            // in loop()
+   * 
+   * @param finder Peer finder (must outlive its use; nullptr = no peers, default)
+   */
+  void setPeerFinder(GitFirmwarePeerFinder* finder);
+#endif
+
   /**
    * @brief Get the last error code
    * 
@@ -188,6 +700,45 @@ public:
    */
   bool getProgress(size_t& bytesRead, size_t& totalBytes, int& percent) const;
 
+  /**
+   * @brief Get phase, progress, rate and ETA in one consistent snapshot
+   * 
+   * Safe to call from any task or core while the update runs (e.g. web
+   * handlers): the update never waits for readers, and readers never see
+   * values from two different moments.
+   * 
+   * @return ProgressSnapshot Values as of the last received chunk or phase change
+   */
+  ProgressSnapshot getProgressSnapshot() const;
+
+  /**
+   * @brief Get the phase timing of the running or last update
+   * 
+   * Safe to call from any task, like getProgressSnapshot(). Also logged at
+   * debug level when an update ends.
+   */
+  UpdateTiming getTiming() const;
+
+  /**
+   * @brief Get free heap, largest free block and stack high-water mark around each phase
+   * 
+   * Safe to call from any task, like getTiming(). Also logged at debug
+   * level when an update ends. Use the lowest stackFree to size the stack
+   * of a task that runs updates, and largestBlock before sinkBegin /
+   * download to size buffers (setPipelineBuffers(), reserveMemory()).
+   */
+  MemoryReport getMemoryReport() const;
+
+#if GIT_FIRMWARE_HISTOGRAM
+  /**
+   * @brief Get the read / write histograms of the running or last update
+   * 
+   * Reset by startUpdate() / startDownload(). Read them after the update
+   * (or from the task driving it): they are not published like getTiming().
+   */
+  const DownloadHistograms& getHistograms() const { return _histograms; }
+#endif
+
   /**
    * @brief Get remote firmware version from last check
    * 
@@ -224,12 +775,38 @@ public:
    */
   bool isUpdating() const { return _isUpdating; }
 
+  /**
+   * @brief Longest time the last download ran without yielding
+   * 
+   * @return Milliseconds (reset when a download starts)
+   */
+  uint32_t getMaxYieldGapMs() const { return _yieldPolicy.getMaxStretchMs(); }
+
 private:
   const char* _currentVersion; ///< Current firmware version (pointer to caller's string)
   const char* _githubUrl;      ///< URL to latest.json (pointer to caller's string)
-  String _remoteVersion;       ///< Remote version from last check
-  String _releaseNotes;        ///< Release notes from last check
-  String _firmwareUrl;         ///< Firmware binary URL from last check
+#if GIT_FIRMWARE_MIRRORS
+  const char* const* _manifestUrls; ///< latest.json mirrors (caller's array, &_githubUrl for one URL)
+  GitFirmwareMirrors _manifestMirrors;
+  uint8_t _manifestSource;     ///< Mirror the stored latest.json validators came from
+#endif
+  static const size_t VERSION_SIZE = 32;     ///< Zero-heap capacity of version fields
+  static const size_t COMPRESSION_SIZE = 16; ///< Zero-heap capacity of compression fields
+
+  GitFirmwareText<VERSION_SIZE> _remoteVersion;           ///< Remote version from last check
+  GitFirmwareText<GIT_FIRMWARE_NOTES_SIZE> _releaseNotes; ///< Release notes from last check (truncated in zero-heap mode)
+  GitFirmwareText<GIT_FIRMWARE_URL_SIZE> _firmwareUrl;    ///< Firmware binary URL from last check
+  GitFirmwareText<COMPRESSION_SIZE> _compression;         ///< Optional "compression" from last check ("gzip", "deflate")
+  GitFirmwareText<GitFirmwareSha256::DIGEST_SIZE * 2 + 1> _sha256; ///< Optional "sha256" of the image from last check (hex)
+#if GIT_FIRMWARE_DELTA
+  GitFirmwareText<VERSION_SIZE> _deltaFrom;               ///< Base version of the delta patch from last check
+  GitFirmwareText<GIT_FIRMWARE_URL_SIZE> _deltaUrl;       ///< Delta patch URL from last check
+  GitFirmwareText<COMPRESSION_SIZE> _deltaCompression;    ///< Compression of the delta patch
+#endif
+#if GIT_FIRMWARE_MIRRORS
+  GitFirmwareText<GIT_FIRMWARE_URL_SIZE> _firmwareMirrors[GIT_FIRMWARE_MAX_MIRRORS - 1]; ///< "mirrors" of the image from last check
+  uint8_t _firmwareMirrorCount;
+#endif
   
   UpdateError _lastError;      ///< Last error code
   static const size_t _lastErrorMsgSize = 64;
@@ -239,13 +816,135 @@ private:
   uint32_t _timeoutMs;         ///< HTTP timeout in milliseconds
   uint8_t _retryCount;         ///< Number of retry attempts
   bool _validateCert;          ///< Certificate validation flag
+  GitFirmwareTlsSessionCache* _tlsSessions; ///< TLS session cache (nullptr = none)
+#if GIT_FIRMWARE_PEERS
+  GitFirmwarePeerFinder* _peerFinder; ///< LAN peer lookup (nullptr = none)
+#endif
   bool _abortFlag;             ///< Abort flag
   bool _isUpdating;            ///< Update in progress flag
+  uint8_t _pipelineBuffers;    ///< Pipeline buffer count (0 = sequential)
+  GitFirmwareTransport* _transport; ///< Custom transport (nullptr = HttpClientTransport)
+  GitFirmwareSink* _sink;      ///< Custom sink (nullptr = _updateSink)
+  UpdateSink _updateSink;      ///< Default sink (global Update object)
+  GitFirmwareStore* _store;    ///< Checkpoint store (nullptr = no checkpoints)
+  uint32_t _checkpointInterval; ///< Bytes between checkpoints
+  char _manifestEtag[GitFirmwareTransport::HEADER_VALUE_SIZE];         ///< ETag of the last "no update" latest.json
+  char _manifestLastModified[GitFirmwareTransport::HEADER_VALUE_SIZE]; ///< Last-Modified of the last "no update" latest.json
+  PartitionSink _partitionSink; ///< Default sink when a checkpoint store is set
+#if GIT_FIRMWARE_ZERO_HEAP
+  uint8_t _sinkBuffer[PartitionSink::SECTOR_SIZE]; ///< Sector buffer of the default sink
+#endif
+  GitFirmwareYieldPolicy _yieldPolicy; ///< Yield cadence of the download loop
+
+  // Memory from reserveMemory()
+  bool _memoryReserved;
+  uint8_t* _arena;             ///< Sector buffer, inflate window, pipeline ring (nullptr if empty)
+  uint8_t* _arenaWindow;       ///< Inflate window in _arena, nullptr if none
+  uint8_t* _arenaPipeline;     ///< Pipeline ring in _arena, nullptr if none
+  uint8_t _arenaPipelineBuffers; ///< Buffers in _arenaPipeline
+  void* _tlsReserve;           ///< Held for the TLS session, nullptr while lent to the heap
   
   // Progress tracking
   size_t _currentBytesRead;    ///< Current bytes read during download
   size_t _totalBytes;          ///< Total bytes to download (0 if unknown)
   int _currentPercent;         ///< Current download percentage (0-100)
+  uint8_t _progressMinPercent; ///< Throttle: minimum percentage step between reports
+  uint32_t _progressMinIntervalMs; ///< Throttle: minimum time between reports
+  int _reportedPercent;        ///< Percentage of the last report
+  uint32_t _reportedMs;        ///< millis() of the last report
+  size_t _downloadStartBytes;  ///< Bytes already present when the download attempt started (resume)
+  uint32_t _rateWindowMs;      ///< Start of the current rate sample
+  size_t _rateWindowBytes;     ///< Bytes at the start of the current rate sample
+  uint32_t _bytesPerSecond;    ///< Smoothed download rate
+  GitFirmwareSeqlock<ProgressSnapshot> _progressSnapshot; ///< Published by publishProgress()
+
+  // Phase timing
+  UpdateTiming _timing;        ///< Phases of the running / last update
+  uint32_t _updateStartMs;     ///< millis() at startUpdate() / startDownload()
+  uint32_t _headersMs;         ///< millis() when the image response headers arrived
+  uint32_t _firstByteMs;       ///< millis() when the first body byte arrived
+  GitFirmwareSeqlock<UpdateTiming> _timingSnapshot; ///< Published by publishProgress()
+#if GIT_FIRMWARE_HISTOGRAM
+  DownloadHistograms _histograms; ///< Read / write distributions
+#endif
+  MemoryReport _memory;        ///< Phases of the running / last update
+  GitFirmwareSeqlock<MemoryReport> _memorySnapshot; ///< Published by sampleMemory()
+
+  // State of one download attempt, shared by the sequential loop, the
+  // pipeline (reader task: transport only, writer: everything else) and
+  // the inflater output callback
+  struct DownloadContext {
+    GitFirmwareUpdate* self;
+    GitFirmwareTransport* transport;
+    GitFirmwareSink* sink;
+    size_t totalRead;        ///< Bytes received from the network
+    int contentLength;       ///< Content-Length (<= 0 if unknown)
+    volatile bool* abortFlag;
+    bool corrupt;            ///< Payload rejected (retryable), as opposed to a flash failure
+    const char* url;         ///< Image URL (for checkpoints)
+    const char* validator;   ///< ETag / Last-Modified of the image, "" if none
+    size_t lastCheckpoint;   ///< totalRead at the last checkpoint attempt
+    GitFirmwareSha256* hash; ///< Hash of the image written to the sink, nullptr if not verified
+    uint32_t lastDataMs;     ///< millis() when data last arrived (idle timeout)
+#if GIT_FIRMWARE_GZIP
+    GitFirmwareInflater* inflater;  ///< nullptr for raw images
+    bool inflateDone;        ///< Compressed stream ended with a valid trailer
+#endif
+#if GIT_FIRMWARE_DELTA
+    GitFirmwareDeltaPatcher* patcher;  ///< nullptr for full images
+    bool patchDone;          ///< Patched image complete and CRC verified
+#endif
+#if GIT_FIRMWARE_MIRRORS
+    size_t received;         ///< Bytes read by this attempt (reader side)
+    uint32_t windowStartMs;  ///< Start of the current throughput window
+    size_t windowBytes;      ///< received at windowStartMs
+    bool collapsed;          ///< Stopped for a faster mirror
+#endif
+  };
+
+  // Update in progress (startUpdate() / poll())
+  UpdateState _state;          ///< Current phase
+  bool _blocking;              ///< Driven by performUpdate() / downloadAndInstall()
+  uint32_t _stateSince;        ///< millis() at the last retry or success (delays)
+  GitFirmwareText<GIT_FIRMWARE_URL_SIZE> _imageUrl;    ///< Image or delta patch being downloaded
+  GitFirmwareText<COMPRESSION_SIZE> _imageCompression; ///< Compression hint for _imageUrl
+  bool _imageDelta;            ///< _imageUrl is a delta patch (full image is the fallback)
+#if GIT_FIRMWARE_PEERS
+  bool _imagePeer;             ///< _imageUrl is a LAN peer (latest.json URL is the fallback)
+#endif
+  GitFirmwareText<GIT_FIRMWARE_REDIRECT_URL_SIZE> _redirectUrl; ///< Final URL of the image URL with CRC32 _redirectKey
+  uint32_t _redirectKey;       ///< CRC32 of the URL that redirected to _redirectUrl
+  uint32_t _redirectSince;     ///< millis() when _redirectUrl was resolved
+  uint32_t _redirectTtlMs;     ///< How long _redirectUrl is used (0 = off)
+#if GIT_FIRMWARE_MIRRORS
+  GitFirmwareMirrors _imageMirrors; ///< Sources of the full image: "url", then _firmwareMirrors
+  uint8_t _imageSources;       ///< Sources of this image (1 = _imageUrl only)
+  uint8_t _mirror;             ///< Source of the current attempt
+  uint8_t _mirrorsTried;       ///< Sources that failed since the last regular retry (bit mask)
+  uint8_t _validatorMirror;    ///< Source _validator came from (NONE = unknown)
+  bool _mirrorProbePending;    ///< Probe the sources before the first connect
+  size_t _mirrorProbeBytes;
+#endif
+  GitFirmwareSink* _imageSink; ///< Sink used for this image
+  uint8_t _retryAttempt;       ///< Failed attempts so far
+  bool _resumable;             ///< Sink started and _dl holds a valid prefix of the file
+  bool _hasContentLength;
+  int _contentLength;          ///< Image Content-Length (0 if unknown)
+  char _validator[GitFirmwareTransport::HEADER_VALUE_SIZE]; ///< ETag / Last-Modified of the prefix
+  bool _verify;                ///< _expectedDigest is set
+  uint8_t _expectedDigest[GitFirmwareSha256::DIGEST_SIZE];
+  DownloadContext _dl;
+  GitFirmwareSha256 _hash;     ///< Hash of the image written to the sink
+#if GIT_FIRMWARE_GZIP
+  GitFirmwareInflater _inflater;
+#if GIT_FIRMWARE_ZERO_HEAP
+  uint8_t _inflateWindow[GIT_FIRMWARE_INFLATE_WINDOW]; ///< Inflate window (32 KB by default)
+#endif
+#endif
+#if GIT_FIRMWARE_DELTA
+  GitFirmwareDeltaPatcher _patcher;
+#endif
+  HttpClientTransport _httpTransport; ///< Default transport for images (kept across poll() calls)
 
   /**
    * @brief Compare two version strings (x.y.z format)
@@ -254,27 +953,230 @@ private:
    * @param b Second version string
    * @return negative if a < b, zero if a == b, positive if a > b
    */
-  static int cmpVersion(const String& a, const String& b);
+  static int cmpVersion(const char* a, const char* b);
+
+  /**
+   * @brief Measure into one field of _memory and publish the report
+   */
+  void sampleMemory(GitFirmwareMemorySample& sample);
+
+  /**
+   * @brief Fetch and evaluate latest.json (body of checkForUpdate())
+   */
+  bool fetchManifest();
+
+  /**
+   * @brief Free the TLS reserve before connecting
+   * 
+   * @return true if it was held (the caller then calls restoreTlsReserve())
+   */
+  bool lendTlsReserve();
 
   /**
-   * @brief Perform HTTPS download and flash of firmware
+   * @brief Take the TLS reserve back after the connection is closed
+   */
+  void restoreTlsReserve();
+
+  /**
+   * @brief True while an update started with startUpdate() / startDownload() is running
+   */
+  bool isBusy() const { return _state != STATE_IDLE && _state != STATE_FAILED; }
+
+  /**
+   * @brief Transport for image downloads
+   */
+  GitFirmwareTransport& activeTransport() {
+    return _transport ? *_transport : _httpTransport;
+  }
+
+  /**
+   * @brief Drive poll() until the update fails (success restarts the device)
+   */
+  bool runBlocking();
+
+  /**
+   * @brief STATE_CHECKING: fetch latest.json, then start the delta or the full image
+   */
+  void stepCheck();
+
+  /**
+   * @brief Prepare downloading an image (resuming a checkpoint if possible)
    * 
-   * Downloads firmware from the provided URL and flashes it using
-   * the Update library. Shows progress via callback and DebugLog.
+   * Moves to STATE_CONNECTING, or fails the image.
    * 
-   * @param url URL to firmware binary
-   * @return true if update successful (device will restart)
-   * @return false if update failed
+   * @param url URL to firmware binary or delta patch
+   * @param compression Compression hint from latest.json (nullptr/"" = raw,
+   *        Content-Encoding takes precedence)
+   * @param delta url is a delta patch against the running partition
+   * @param sha256 Expected SHA-256 of the image written to the sink (hex,
+   *        nullptr/"" = not verified)
    */
-  bool performHttpFirmwareUpdate(const String& url);
+  void beginImage(const char* url, const char* compression, bool delta, const char* sha256);
+
+  /**
+   * @brief beginImage() for the full image of the last check, with its mirrors
+   */
+  void beginFullImage();
+
+#if GIT_FIRMWARE_PEERS
+  /**
+   * @brief beginImage() for the full image from a LAN peer
+   * 
+   * @return false if no peer has it (nothing started)
+   */
+  bool beginPeerImage();
+#endif
+
+  /**
+   * @brief STATE_CONNECTING: request the image (Range when resuming) and start the sink
+   */
+  void stepConnect();
+
+  /**
+   * @brief Open url for the image, with Range / If-Range when resuming
+   */
+  int openImage(GitFirmwareTransport& transport, const char* url);
+
+  /**
+   * @brief Cached redirect target of url, nullptr if none or expired
+   */
+  const char* cachedRedirect(const char* url) const;
+
+#if GIT_FIRMWARE_MIRRORS
+  /**
+   * @brief URL of image source index (0 = _imageUrl, then _firmwareMirrors)
+   */
+  const char* imageSource(uint8_t index) const;
+
+  /**
+   * @brief True if resuming on _mirror would splice data from another mirror
+   * 
+   * Validators are server specific; the splice is then checked by the SHA-256.
+   */
+  bool splicesMirrors() const;
+
+  /**
+   * @brief Time a short Range request to each unmeasured healthy source
+   */
+  void probeMirrors(GitFirmwareTransport& transport);
+
+  /**
+   * @brief True once the throughput of this attempt fell far below another source's
+   */
+  bool mirrorCollapsed(DownloadContext& dl);
+
+  /**
+   * @brief After a failed attempt, continue on an untried source
+   * 
+   * @return false if none is left (a regular retry follows)
+   */
+  bool failoverMirror();
+#endif
+
+  /**
+   * @brief STATE_DOWNLOADING: stream into the sink for about sliceMs
+   */
+  void stepDownload(uint32_t sliceMs);
+
+  /**
+   * @brief STATE_FINISHING: verify the hash and end the sink
+   */
+  void stepFinish();
+
+  /**
+   * @brief Schedule another attempt, or fail the image when retries are used up
+   */
+  void retryImage();
+
+  /**
+   * @brief Give up on the image: keep a resumable prefix, then fall back
+   *        from a delta to the full image or move to STATE_FAILED
+   */
+  void failImage();
+
+  /**
+   * @brief Consume one downloaded chunk: inflate if needed, write, report progress
+   * 
+   * @param dl Download state
+   * @param buf Chunk data as received from the transport
+   * @param len Chunk length
+   * @return true on success; false on sink failure (error set) or
+   *         corrupt compressed data (dl.corrupt set, retryable)
+   */
+  bool consumeChunk(DownloadContext& dl, const uint8_t* buf, size_t len);
+
+  /**
+   * @brief Write image data (already inflated): patch if needed, then sink
+   * 
+   * @return false on sink failure (error set) or patch error (dl.corrupt set)
+   */
+  bool writeImage(DownloadContext& dl, const uint8_t* data, size_t len);
+
+  /**
+   * @brief Record the committed download position in the checkpoint store
+   * 
+   * @return true if a checkpoint was written
+   */
+  bool saveCheckpoint(DownloadContext& dl);
+
+  /**
+   * @brief Abort the sink and drop the checkpoint that points into it
+   */
+  void discardImage(GitFirmwareSink& sink);
+
+  /**
+   * @brief Write final image bytes to the sink
+   * 
+   * @return false on sink failure (FLASH_FAILED set)
+   */
+  bool writeSink(DownloadContext& dl, const uint8_t* data, size_t len);
+
+#if GIT_FIRMWARE_PIPELINE
+  /**
+   * @brief Pipeline producer trampoline, runs in the reader task (ctx is a DownloadContext)
+   */
+  static int pipelineRead(void* ctx, uint8_t* buf, size_t capacity);
+
+  /**
+   * @brief Pipeline consumer trampoline (ctx is a DownloadContext)
+   */
+  static bool pipelineWrite(void* ctx, const uint8_t* buf, size_t len);
+#endif
+
+#if GIT_FIRMWARE_GZIP
+  /**
+   * @brief Inflater output trampoline (ctx is a DownloadContext)
+   */
+  static bool inflateOutput(void* ctx, const uint8_t* data, size_t len);
+#endif
+
+#if GIT_FIRMWARE_DELTA
+  /**
+   * @brief Patcher output trampoline (ctx is a DownloadContext)
+   */
+  static bool deltaOutput(void* ctx, const uint8_t* data, size_t len);
+#endif
 
   /**
    * @brief Report progress via callback and Serial
    * 
    * @param bytesRead Bytes read so far
    * @param totalBytes Total bytes (0 if unknown)
+   * @param force Report even if throttled (first and last report)
+   */
+  void reportProgress(size_t bytesRead, size_t totalBytes, bool force = false);
+
+  /**
+   * @brief Publish the progress fields for getProgressSnapshot()
+   * 
+   * Only called from the task driving the update (the seqlock writer).
+   */
+  void publishProgress();
+
+  /**
+   * @brief Clear the phase timing for a new update
    */
-  void reportProgress(size_t bytesRead, size_t totalBytes);
+  void resetTiming();
 
   /**
    * @brief Set error code and log message
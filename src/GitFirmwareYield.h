@@ -0,0 +1,99 @@
+/**
+ * @file GitFirmwareYield.h
+ * @brief Cooperative yield policy for the download loop
+ *
+ * Decides when a long-running loop should yield: after a time interval or
+ * after a number of bytes, whichever comes first. Also records the longest
+ * stretch between two yields, to tune the intervals against the task
+ * watchdog. Plain C++ only (usable on the host); the caller supplies the
+ * clock so it works with millis() as well as a host clock.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @class GitFirmwareYieldPolicy
+ * @brief "Every N ms or M bytes" yield cadence with instrumentation
+ */
+class GitFirmwareYieldPolicy {
+public:
+  /**
+   * @param intervalMs Yield after this many ms without a yield (0 = no time limit)
+   * @param intervalBytes Yield after this many bytes without a yield (0 = no byte limit)
+   */
+  GitFirmwareYieldPolicy(uint32_t intervalMs = 50, size_t intervalBytes = 10240)
+    : _intervalMs(intervalMs),
+      _intervalBytes(intervalBytes),
+      _since(0),
+      _bytes(0),
+      _maxStretchMs(0),
+      _yieldCount(0) {
+  }
+
+  /**
+   * @brief Change the intervals (0 disables a limit; both 0 = never yield)
+   */
+  void setIntervals(uint32_t intervalMs, size_t intervalBytes) {
+    _intervalMs = intervalMs;
+    _intervalBytes = intervalBytes;
+  }
+
+  /**
+   * @brief Clear the statistics and start the first stretch
+   */
+  void reset(uint32_t nowMs) {
+    _maxStretchMs = 0;
+    _yieldCount = 0;
+    restart(nowMs);
+  }
+
+  /**
+   * @brief Start a new stretch without counting a yield
+   *
+   * Use when the loop was left and re-entered (e.g. between poll() calls).
+   */
+  void restart(uint32_t nowMs) {
+    _since = nowMs;
+    _bytes = 0;
+  }
+
+  /**
+   * @brief Account for processed bytes
+   *
+   * @return true if the caller should yield now (then call yielded())
+   */
+  bool due(size_t bytes, uint32_t nowMs) {
+    _bytes += bytes;
+    return (_intervalBytes > 0 && _bytes >= _intervalBytes) ||
+           (_intervalMs > 0 && nowMs - _since >= _intervalMs);
+  }
+
+  /**
+   * @brief Record a yield (or a blocking wait, which yields as well)
+   */
+  void yielded(uint32_t nowMs) {
+    uint32_t stretch = nowMs - _since;
+    if (stretch > _maxStretchMs) {
+      _maxStretchMs = stretch;
+    }
+    _yieldCount++;
+    restart(nowMs);
+  }
+
+  /// Longest time between two yields since reset()
+  uint32_t getMaxStretchMs() const { return _maxStretchMs; }
+
+  /// Yields since reset()
+  uint32_t getYieldCount() const { return _yieldCount; }
+
+private:
+  uint32_t _intervalMs;
+  size_t _intervalBytes;
+  uint32_t _since;         ///< Start of the current stretch
+  size_t _bytes;           ///< Bytes in the current stretch
+  uint32_t _maxStretchMs;
+  uint32_t _yieldCount;
+};